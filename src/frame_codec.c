@@ -0,0 +1,489 @@
+#include <errno.h>
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+#include "frame_codec.h"
+
+#define OP_LITERAL_MAX 128
+#define OP_RUN_MAX 64
+#define OP_REPEAT 0x80
+#define OP_SKIP 0xC0
+
+// Difference mode ops, by residual size
+#define OP_DIFF3 0x00
+#define OP_DIFF2 0x40
+#define OP_DIFF1 0xC0
+
+#define MODE_DIFF 0xFE
+#define MODE_RAW 0xFF
+
+struct frame_palette
+{
+    struct led_rgb colors[FRAME_CODEC_MAX_PALETTE];
+    size_t len;
+};
+
+static inline bool same_pixel(const struct led_rgb *a, const struct led_rgb *b)
+{
+    return a->r == b->r && a->g == b->g && a->b == b->b;
+}
+
+static int palette_index(const struct frame_palette *pal, const struct led_rgb *px)
+{
+    for (size_t i = 0; i < pal->len; i++)
+    {
+        if (same_pixel(&pal->colors[i], px))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Colors of the pixels that differ from ref, false if there are too many
+static bool build_palette(struct frame_palette *pal, const struct led_rgb *px,
+                          const struct led_rgb *ref, size_t count)
+{
+    pal->len = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if ((ref && same_pixel(&px[i], &ref[i])) || palette_index(pal, &px[i]) >= 0)
+        {
+            continue;
+        }
+        if (pal->len == FRAME_CODEC_MAX_PALETTE)
+        {
+            return false;
+        }
+        pal->colors[pal->len++] = px[i];
+    }
+    return true;
+}
+
+static uint8_t *put_pixel(uint8_t *p, const struct led_rgb *px, const struct frame_palette *pal)
+{
+    if (pal)
+    {
+        *p++ = palette_index(pal, px);
+    }
+    else
+    {
+        *p++ = px->r;
+        *p++ = px->g;
+        *p++ = px->b;
+    }
+    return p;
+}
+
+// Code the pixels as ops into out, or only measure them with out NULL
+static size_t encode_ops(uint8_t *out, const struct led_rgb *px, const struct led_rgb *ref,
+                         size_t count, const struct frame_palette *pal)
+{
+    size_t px_size = pal ? 1 : 3;
+    size_t len = 0;
+    size_t i = 0;
+
+    while (i < count)
+    {
+        size_t run = 1;
+
+        if (ref && same_pixel(&px[i], &ref[i]))
+        {
+            while (i + run < count && run < OP_RUN_MAX && same_pixel(&px[i + run], &ref[i + run]))
+            {
+                run++;
+            }
+            if (out)
+            {
+                out[len] = OP_SKIP | (run - 1);
+            }
+            len++;
+            i += run;
+            continue;
+        }
+
+        while (i + run < count && run < OP_RUN_MAX && same_pixel(&px[i + run], &px[i]))
+        {
+            run++;
+        }
+
+        if (run > 1)
+        {
+            if (out)
+            {
+                out[len] = OP_REPEAT | (run - 1);
+                put_pixel(&out[len + 1], &px[i], pal);
+            }
+            len += 1 + px_size;
+            i += run;
+            continue;
+        }
+
+        // Literal pixels up to where a skip or a repeat starts
+        while (i + run < count && run < OP_LITERAL_MAX &&
+               !(ref && same_pixel(&px[i + run], &ref[i + run])) &&
+               !(i + run + 1 < count && same_pixel(&px[i + run], &px[i + run + 1])))
+        {
+            run++;
+        }
+
+        if (out)
+        {
+            uint8_t *p = &out[len];
+
+            *p++ = run - 1;
+            for (size_t j = 0; j < run; j++)
+            {
+                p = put_pixel(p, &px[i + j], pal);
+            }
+        }
+        len += 1 + run * px_size;
+        i += run;
+    }
+
+    return len;
+}
+
+// Difference of pixel i against the reference (black for keyframes), per channel mod 256
+static inline struct led_rgb diff_at(const struct led_rgb *px, const struct led_rgb *ref, size_t i)
+{
+    if (!ref)
+    {
+        return px[i];
+    }
+    return (struct led_rgb){
+        .r = px[i].r - ref[i].r,
+        .g = px[i].g - ref[i].g,
+        .b = px[i].b - ref[i].b,
+    };
+}
+
+// Difference of pixel i minus that of pixel i - 1, small wherever the frame (or its
+// change since the reference) is smooth along the strip
+static struct led_rgb residual_at(const struct led_rgb *px, const struct led_rgb *ref, size_t i)
+{
+    struct led_rgb d = diff_at(px, ref, i);
+
+    if (i > 0)
+    {
+        struct led_rgb prev = diff_at(px, ref, i - 1);
+
+        d.r -= prev.r;
+        d.g -= prev.g;
+        d.b -= prev.b;
+    }
+    return d;
+}
+
+// Bytes a residual is coded in: signed 3-3-2 bits, 5-6-5 bits or whole bytes
+static size_t residual_size(const struct led_rgb *res)
+{
+    int8_t r = res->r;
+    int8_t g = res->g;
+    int8_t b = res->b;
+
+    if (r >= -4 && r <= 3 && g >= -4 && g <= 3 && b >= -2 && b <= 1)
+    {
+        return 1;
+    }
+    if (r >= -16 && r <= 15 && g >= -32 && g <= 31 && b >= -16 && b <= 15)
+    {
+        return 2;
+    }
+    return 3;
+}
+
+static uint8_t *put_residual(uint8_t *p, const struct led_rgb *res, size_t size)
+{
+    switch (size)
+    {
+    case 1:
+        *p++ = ((res->r + 4) & 0x07) << 5 | ((res->g + 4) & 0x07) << 2 | ((res->b + 2) & 0x03);
+        return p;
+    case 2:
+        sys_put_le16(((res->r + 16) & 0x1F) << 11 | ((res->g + 32) & 0x3F) << 5 |
+                         ((res->b + 16) & 0x1F),
+                     p);
+        return p + 2;
+    default:
+        return put_pixel(p, res, NULL);
+    }
+}
+
+static struct led_rgb get_residual(const uint8_t *p, size_t size)
+{
+    uint16_t v;
+
+    switch (size)
+    {
+    case 1:
+        return (struct led_rgb){
+            .r = ((p[0] >> 5) & 0x07) - 4,
+            .g = ((p[0] >> 2) & 0x07) - 4,
+            .b = (p[0] & 0x03) - 2,
+        };
+    case 2:
+        v = sys_get_le16(p);
+        return (struct led_rgb){
+            .r = ((v >> 11) & 0x1F) - 16,
+            .g = ((v >> 5) & 0x3F) - 32,
+            .b = (v & 0x1F) - 16,
+        };
+    default:
+        return (struct led_rgb){.r = p[0], .g = p[1], .b = p[2]};
+    }
+}
+
+// Code the residuals as difference mode ops into out, or only measure them with out NULL
+static size_t encode_diff(uint8_t *out, const struct led_rgb *px, const struct led_rgb *ref,
+                          size_t count)
+{
+    static const uint8_t ops[] = {[1] = OP_DIFF1, [2] = OP_DIFF2, [3] = OP_DIFF3};
+    size_t len = 0;
+    size_t i = 0;
+
+    while (i < count)
+    {
+        struct led_rgb res = residual_at(px, ref, i);
+        struct led_rgb next = i + 1 < count ? residual_at(px, ref, i + 1) : res;
+        size_t run = 1;
+
+        // Unchanged pixels of a delta and flat stretches of a keyframe repeat residual 0
+        while (i + run < count && run < OP_RUN_MAX && same_pixel(&next, &res))
+        {
+            run++;
+            if (i + run < count)
+            {
+                next = residual_at(px, ref, i + run);
+            }
+        }
+
+        if (run > 1)
+        {
+            if (out)
+            {
+                out[len] = OP_REPEAT | (run - 1);
+                put_residual(&out[len + 1], &res, 3);
+            }
+            len += 4;
+            i += run;
+            continue;
+        }
+
+        // Residuals of the same size up to where a repeat starts
+        size_t size = residual_size(&res);
+
+        while (i + run < count && run < OP_RUN_MAX && residual_size(&next) == size)
+        {
+            struct led_rgb after = i + run + 1 < count ? residual_at(px, ref, i + run + 1) : next;
+
+            if (i + run + 1 < count && same_pixel(&next, &after))
+            {
+                break;
+            }
+            run++;
+            next = after;
+        }
+
+        if (out)
+        {
+            uint8_t *p = &out[len];
+
+            *p++ = ops[size] | (run - 1);
+            for (size_t j = 0; j < run; j++)
+            {
+                struct led_rgb r = residual_at(px, ref, i + j);
+
+                p = put_residual(p, &r, size);
+            }
+        }
+        len += 1 + run * size;
+        i += run;
+    }
+
+    return len;
+}
+
+int frame_codec_encode(uint8_t *out, size_t size, const struct led_rgb *px,
+                       const struct led_rgb *ref, size_t count)
+{
+    struct frame_palette pal;
+    size_t len = 1 + encode_ops(NULL, px, ref, count, NULL);
+    uint8_t mode = 0;
+
+    if (build_palette(&pal, px, ref, count))
+    {
+        size_t pal_len = 1 + 3 * pal.len + encode_ops(NULL, px, ref, count, &pal);
+
+        if (pal_len < len)
+        {
+            len = pal_len;
+            mode = pal.len;
+        }
+    }
+
+    size_t diff_len = 1 + encode_diff(NULL, px, ref, count);
+
+    if (diff_len < len)
+    {
+        len = diff_len;
+        mode = MODE_DIFF;
+    }
+    if (len > 1 + 3 * count)
+    {
+        len = 1 + 3 * count;
+        mode = MODE_RAW;
+    }
+
+    if (len > size)
+    {
+        return -ENOSPC;
+    }
+
+    uint8_t *p = out;
+
+    *p++ = mode;
+    switch (mode)
+    {
+    case MODE_DIFF:
+        encode_diff(p, px, ref, count);
+        break;
+    case MODE_RAW:
+        for (size_t i = 0; i < count; i++)
+        {
+            p = put_pixel(p, &px[i], NULL);
+        }
+        break;
+    default:
+        for (size_t i = 0; i < mode; i++)
+        {
+            p = put_pixel(p, &pal.colors[i], NULL);
+        }
+        encode_ops(p, px, ref, count, mode ? &pal : NULL);
+        break;
+    }
+
+    return len;
+}
+
+static int decode_diff(const uint8_t *p, const uint8_t *end, struct led_rgb *px,
+                       const struct led_rgb *ref, size_t count)
+{
+    struct led_rgb d = {0};
+    size_t i = 0;
+
+    while (p < end)
+    {
+        uint8_t op = *p++;
+        size_t run = (op & 0x3F) + 1;
+        size_t size = op < OP_DIFF2 || (op >= OP_REPEAT && op < OP_DIFF1) ? 3
+                      : op < OP_REPEAT                                   ? 2
+                                                                         : 1;
+        size_t values = op >= OP_REPEAT && op < OP_DIFF1 ? 1 : run;
+
+        if (i + run > count || (size_t)(end - p) < values * size)
+        {
+            return -EBADMSG;
+        }
+
+        struct led_rgb res = {0};
+
+        for (size_t j = 0; j < run; j++, i++)
+        {
+            if (j < values)
+            {
+                res = get_residual(p, size);
+                p += size;
+            }
+            d.r += res.r;
+            d.g += res.g;
+            d.b += res.b;
+            px[i] = ref ? (struct led_rgb){.r = ref[i].r + d.r, .g = ref[i].g + d.g,
+                                            .b = ref[i].b + d.b}
+                        : d;
+        }
+    }
+
+    return 0;
+}
+
+int frame_codec_decode(const uint8_t *in, size_t len, struct led_rgb *px,
+                       const struct led_rgb *ref, size_t count)
+{
+    const uint8_t *end = in + len;
+
+    if (len < 1)
+    {
+        return -EBADMSG;
+    }
+    if (in[0] == MODE_RAW)
+    {
+        if (len != 1 + 3 * count)
+        {
+            return -EBADMSG;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            px[i] = (struct led_rgb){.r = in[1 + 3 * i], .g = in[2 + 3 * i], .b = in[3 + 3 * i]};
+        }
+        return 0;
+    }
+
+    if (ref)
+    {
+        memcpy(px, ref, count * sizeof(*px));
+    }
+    else
+    {
+        memset(px, 0, count * sizeof(*px));
+    }
+    if (in[0] == MODE_DIFF)
+    {
+        return decode_diff(in + 1, end, px, ref, count);
+    }
+    if (in[0] > FRAME_CODEC_MAX_PALETTE || len < 1 + 3 * (size_t)in[0])
+    {
+        return -EBADMSG;
+    }
+
+    size_t pal_len = in[0];
+    const uint8_t *pal = in + 1;
+    size_t px_size = pal_len ? 1 : 3;
+    const uint8_t *p = pal + 3 * pal_len;
+    size_t i = 0;
+
+    while (p < end)
+    {
+        uint8_t op = *p++;
+        size_t run = op < OP_REPEAT ? op + 1 : (op & 0x3F) + 1;
+        size_t values = op < OP_REPEAT ? run : (op < OP_SKIP ? 1 : 0);
+
+        if (i + run > count || (size_t)(end - p) < values * px_size || (op >= OP_SKIP && !ref))
+        {
+            return -EBADMSG;
+        }
+
+        for (size_t j = 0; j < values; j++, p += px_size)
+        {
+            const uint8_t *c = p;
+
+            if (pal_len)
+            {
+                if (*p >= pal_len)
+                {
+                    return -EBADMSG;
+                }
+                c = pal + 3 * *p;
+            }
+            px[i + j] = (struct led_rgb){.r = c[0], .g = c[1], .b = c[2]};
+        }
+
+        // A repeat fills its run with the one pixel, a skip keeps the reference
+        for (size_t j = values; op >= OP_REPEAT && op < OP_SKIP && j < run; j++)
+        {
+            px[i + j] = px[i];
+        }
+        i += run;
+    }
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ksb_common.h"
+
+/*
+ * Per-pixel frame compression for distributing frames over the mesh.
+ *
+ * An encoded frame starts with a mode byte. Modes 0-64 are a palette of
+ * that size followed by the pixel ops of the animation container (see
+ * led_anim.h):
+ *
+ *   u8 palette size (0 = pixels are RGB), palette size RGB triplets
+ *   0x00-0x7F  n+1 literal pixels follow
+ *   0x80-0xBF  (n & 0x3F)+1 copies of the pixel that follows
+ *   0xC0-0xFF  (n & 0x3F)+1 pixels same as the reference (delta frames only)
+ *
+ * Mode 0xFE codes per-channel differences mod 256: d[i] = pixel minus
+ * reference pixel (minus black for keyframes), and each op carries the
+ * residual d[i] - d[i - 1], which is small wherever the frame, or its
+ * change since the reference, is smooth along the strip:
+ *
+ *   0x00-0x3F  n+1 residuals of 3 bytes (R, G, B)
+ *   0x40-0x7F  n+1 residuals of 2 bytes (u16, signed 5-6-5 bits + 16/32/16)
+ *   0x80-0xBF  (n & 0x3F)+1 pixels with the 3-byte residual that follows
+ *   0xC0-0xFF  (n & 0x3F)+1 residuals of 1 byte (signed 3-3-2 bits + 4/4/2)
+ *
+ * Mode 0xFF is count RGB triplets, so no frame codes larger than raw plus
+ * the mode byte.
+ *
+ * Delta frames are coded against a reference frame (the last keyframe), so
+ * a receiver that missed any number of deltas decodes the next one as long
+ * as it holds the keyframe. The encoder picks whichever mode makes the
+ * frame smallest. The codec only works on caller buffers and makes no
+ * kernel calls.
+ */
+
+#define FRAME_CODEC_MAX_PALETTE 64
+
+// Largest encoding of count pixels
+#define FRAME_CODEC_MAX_SIZE(count) (1 + 3 * (count))
+
+/**
+ * Encode a frame
+ * @param out Output buffer
+ * @param size Output buffer size
+ * @param px Pixels to encode
+ * @param ref Reference pixels for a delta frame, NULL for a keyframe
+ * @param count Number of pixels
+ * @return Encoded length, -ENOSPC if it does not fit
+ */
+int frame_codec_encode(uint8_t *out, size_t size, const struct led_rgb *px,
+                       const struct led_rgb *ref, size_t count);
+
+/**
+ * Decode a frame
+ * @param in Encoded frame
+ * @param len Encoded length
+ * @param px Output pixels, must not alias ref
+ * @param ref Reference pixels for a delta frame, NULL for a keyframe
+ * @param count Number of pixels
+ * @return 0 on success, -EBADMSG if the frame is malformed
+ */
+int frame_codec_decode(const uint8_t *in, size_t len, struct led_rgb *px,
+                       const struct led_rgb *ref, size_t count);
+
+#endif // FRAME_CODEC_H
@@ -10,8 +10,7 @@
 // System configuration
 #define KSB_MAX_NETWORK_NAME_LEN 32
 #define KSB_MAX_MESH_NODES 8
-#define KSB_LED_COUNT 8
-#define KSB_LED_UPDATE_RATE_MS 33
+#define KSB_LED_MAX_COUNT CONFIG_WS2812B_MAX_PIXELS
 
 // Network configuration
 #define KSB_AP_SSID_PREFIX "KSB_Setup_"
@@ -19,6 +18,11 @@
 #define KSB_WEB_PORT 80
 #define KSB_MESH_PORT 8080
 
+// Mesh zones: a node belongs to one or more, commands are addressed to a zone mask
+#define KSB_MAX_ZONES 8
+#define KSB_ZONES_ALL 0xFF
+#define KSB_MESH_GROUP_ADDR(zone) (0xEFFF4B00U + (zone)) // 239.255.75.<zone>
+
 // Hardware pins
 #define KSB_USER_BUTTON_PIN 0
 #define KSB_STATUS_LED_RED_PIN 2
@@ -47,18 +51,24 @@ enum ksb_led_pattern
     KSB_PATTERN_RAINBOW,
     KSB_PATTERN_SPARKLE,
     KSB_PATTERN_WAVE,
+    KSB_PATTERN_SCRIPT,
+    KSB_PATTERN_ANIMATION,
     KSB_PATTERN_COUNT
 };
 
-// LED command structure for mesh communication
+// LED command exchanged between mesh nodes, see mesh_proto.h for its encoding
 struct ksb_led_command
 {
     enum ksb_led_pattern pattern;
     struct led_rgb color;
     uint32_t speed;
     uint32_t brightness;
-    uint32_t frame;
-} __packed;
+    uint32_t start_ms; // Mesh clock time of the pattern's frame 0
+    uint16_t transition_ms;
+    uint32_t seed;
+    uint32_t clock; // Lamport timestamp, the latest command wins on every node
+    uint32_t sent_us; // Origin's mesh time at sending in us (32 bits), 0 if unknown
+};
 
 // Network configuration
 struct ksb_network_config
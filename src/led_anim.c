@@ -0,0 +1,516 @@
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include "led_anim.h"
+
+LOG_MODULE_REGISTER(led_anim, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define ANIM_PARTITION_NODE DT_NODELABEL(user_data_partition)
+#define ANIM_NO_FRAME UINT32_MAX
+#define ANIM_WRITE_CHUNK 32
+
+// Sequential reader over the partition with a small read-ahead window
+struct anim_reader
+{
+    size_t pos;
+    size_t buf_start;
+    size_t buf_len;
+    uint8_t buf[CONFIG_KSB_LED_ANIM_READ_AHEAD];
+};
+
+static struct led_anim_context
+{
+    const struct flash_area *fa;
+    bool loaded;
+    bool palette_mode;
+    uint16_t pixel_count;
+    uint16_t frame_count;
+    size_t size;
+    size_t frames_offset;
+    // Frame currently in the canvas and where the one after it starts
+    uint32_t position;
+    size_t next_offset;
+    struct anim_reader reader;
+    struct led_rgb palette[LED_ANIM_MAX_PALETTE];
+    struct led_rgb canvas[KSB_LED_MAX_COUNT];
+    // Store state
+    bool storing;
+    size_t store_size;
+    size_t store_pos;
+    uint8_t store_buf[ANIM_WRITE_CHUNK];
+    size_t store_buf_len;
+} anim_ctx;
+
+static K_MUTEX_DEFINE(anim_lock);
+
+static int reader_seek(struct anim_reader *r, size_t pos)
+{
+    if (pos >= anim_ctx.size)
+    {
+        return -EINVAL;
+    }
+    r->pos = pos;
+    return 0;
+}
+
+static int reader_byte(struct anim_reader *r)
+{
+    if (r->pos < r->buf_start || r->pos >= r->buf_start + r->buf_len)
+    {
+        if (r->pos >= anim_ctx.size)
+        {
+            return -EINVAL;
+        }
+
+        r->buf_start = r->pos;
+        r->buf_len = MIN(sizeof(r->buf), anim_ctx.size - r->pos);
+
+        int ret = flash_area_read(anim_ctx.fa, r->buf_start, r->buf, r->buf_len);
+        if (ret != 0)
+        {
+            r->buf_len = 0;
+            return ret;
+        }
+    }
+    return r->buf[r->pos++ - r->buf_start];
+}
+
+static int reader_u16(struct anim_reader *r)
+{
+    int lo = reader_byte(r);
+    int hi = reader_byte(r);
+
+    if (lo < 0 || hi < 0)
+    {
+        return -EINVAL;
+    }
+    return lo | (hi << 8);
+}
+
+static int read_pixel(struct anim_reader *r, struct led_rgb *px)
+{
+    int c = reader_byte(r);
+
+    if (c < 0)
+    {
+        return c;
+    }
+    if (anim_ctx.palette_mode)
+    {
+        *px = anim_ctx.palette[c];
+        return 0;
+    }
+
+    int g = reader_byte(r);
+    int b = reader_byte(r);
+
+    if (g < 0 || b < 0)
+    {
+        return -EINVAL;
+    }
+    *px = (struct led_rgb){c, g, b};
+    return 0;
+}
+
+// Read a frame record header, returns the payload length
+static int read_frame_header(struct anim_reader *r, size_t offset, uint8_t *type)
+{
+    int ret = reader_seek(r, offset);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    int t = reader_byte(r);
+    int len = reader_u16(r);
+
+    if (t < 0 || len < 0 || t > LED_ANIM_FRAME_DELTA ||
+        offset + LED_ANIM_FRAME_HEADER_SIZE + len > anim_ctx.size)
+    {
+        return -EINVAL;
+    }
+    *type = t;
+    return len;
+}
+
+// Apply one frame's ops to the canvas
+static int decode_payload(struct anim_reader *r, size_t len, bool key)
+{
+    size_t end = r->pos + len;
+    size_t px = 0;
+    size_t n = anim_ctx.pixel_count;
+    struct led_rgb c;
+    int ret;
+
+    while (r->pos < end && px < n)
+    {
+        int op = reader_byte(r);
+        if (op < 0)
+        {
+            return op;
+        }
+
+        size_t run = (op < 0x80) ? op + 1 : (op & 0x3F) + 1;
+
+        if (op < 0x80)
+        {
+            for (size_t i = 0; i < run && px < n; i++)
+            {
+                ret = read_pixel(r, &anim_ctx.canvas[px++]);
+                if (ret != 0)
+                {
+                    return ret;
+                }
+            }
+        }
+        else if (op < 0xC0)
+        {
+            ret = read_pixel(r, &c);
+            if (ret != 0)
+            {
+                return ret;
+            }
+            for (size_t i = 0; i < run && px < n; i++)
+            {
+                anim_ctx.canvas[px++] = c;
+            }
+        }
+        else if (!key)
+        {
+            px += run;
+        }
+        else
+        {
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+// Bring the canvas to frame target, decoding from the closest keyframe
+static int anim_advance(uint32_t target)
+{
+    struct anim_reader *r = &anim_ctx.reader;
+    uint32_t idx = 0;
+    size_t off = anim_ctx.frames_offset;
+    uint8_t type;
+    int len;
+
+    if (anim_ctx.position != ANIM_NO_FRAME && target > anim_ctx.position)
+    {
+        idx = anim_ctx.position + 1;
+        off = anim_ctx.next_offset;
+    }
+
+    // Only frame headers are read while looking for a later keyframe
+    uint32_t start_idx = idx;
+    size_t start_off = off;
+
+    for (; idx < target; idx++)
+    {
+        len = read_frame_header(r, off, &type);
+        if (len < 0)
+        {
+            return len;
+        }
+        off += LED_ANIM_FRAME_HEADER_SIZE + len;
+
+        if (type == LED_ANIM_FRAME_KEY)
+        {
+            start_idx = idx;
+            start_off = off - LED_ANIM_FRAME_HEADER_SIZE - len;
+        }
+    }
+
+    // Target itself may be a keyframe
+    len = read_frame_header(r, off, &type);
+    if (len < 0)
+    {
+        return len;
+    }
+    if (type == LED_ANIM_FRAME_KEY)
+    {
+        start_idx = target;
+        start_off = off;
+    }
+
+    off = start_off;
+    for (idx = start_idx; idx <= target; idx++)
+    {
+        len = read_frame_header(r, off, &type);
+        if (len < 0)
+        {
+            return len;
+        }
+
+        int ret = decode_payload(r, len, type == LED_ANIM_FRAME_KEY);
+        if (ret != 0)
+        {
+            return ret;
+        }
+        off += LED_ANIM_FRAME_HEADER_SIZE + len;
+    }
+
+    anim_ctx.position = target;
+    anim_ctx.next_offset = off;
+    return 0;
+}
+
+// Parse the container header and walk the frame records once to bound every seek
+static int anim_open(void)
+{
+    uint8_t hdr[LED_ANIM_HEADER_SIZE];
+    int ret;
+
+    anim_ctx.loaded = false;
+
+    ret = flash_area_read(anim_ctx.fa, 0, hdr, sizeof(hdr));
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    uint16_t palette_size = sys_get_le16(&hdr[8]);
+
+    anim_ctx.palette_mode = hdr[3] & LED_ANIM_FLAG_PALETTE;
+    anim_ctx.pixel_count = sys_get_le16(&hdr[4]);
+    anim_ctx.frame_count = sys_get_le16(&hdr[6]);
+    anim_ctx.size = sys_get_le32(&hdr[12]);
+    anim_ctx.frames_offset = LED_ANIM_HEADER_SIZE + (anim_ctx.palette_mode ? palette_size * 3 : 0);
+
+    if (hdr[0] != 'K' || hdr[1] != 'A' || hdr[2] != LED_ANIM_VERSION ||
+        anim_ctx.pixel_count == 0 || anim_ctx.pixel_count > KSB_LED_MAX_COUNT ||
+        anim_ctx.frame_count == 0 || palette_size > LED_ANIM_MAX_PALETTE ||
+        anim_ctx.size > anim_ctx.fa->fa_size || anim_ctx.frames_offset >= anim_ctx.size)
+    {
+        return -EINVAL;
+    }
+
+    memset(anim_ctx.palette, 0, sizeof(anim_ctx.palette));
+    if (anim_ctx.palette_mode)
+    {
+        ret = flash_area_read(anim_ctx.fa, LED_ANIM_HEADER_SIZE, anim_ctx.palette, palette_size * 3);
+        if (ret != 0)
+        {
+            return ret;
+        }
+    }
+
+    anim_ctx.reader.buf_len = 0;
+    size_t off = anim_ctx.frames_offset;
+
+    for (uint32_t i = 0; i < anim_ctx.frame_count; i++)
+    {
+        uint8_t type;
+        int len = read_frame_header(&anim_ctx.reader, off, &type);
+
+        if (len < 0 || (i == 0 && type != LED_ANIM_FRAME_KEY))
+        {
+            return -EINVAL;
+        }
+        off += LED_ANIM_FRAME_HEADER_SIZE + len;
+    }
+
+    anim_ctx.position = ANIM_NO_FRAME;
+    anim_ctx.loaded = true;
+
+    LOG_INF("Animation loaded: %d frames of %d pixels, %zu bytes%s",
+            anim_ctx.frame_count, anim_ctx.pixel_count, anim_ctx.size,
+            anim_ctx.palette_mode ? ", palette" : "");
+    return 0;
+}
+
+int led_anim_init(void)
+{
+#if DT_NODE_EXISTS(ANIM_PARTITION_NODE)
+    int ret = flash_area_open(DT_FIXED_PARTITION_ID(ANIM_PARTITION_NODE), &anim_ctx.fa);
+    if (ret != 0)
+    {
+        LOG_ERR("Failed to open user data partition: %d", ret);
+        return ret;
+    }
+
+    k_mutex_lock(&anim_lock, K_FOREVER);
+    ret = anim_open();
+    k_mutex_unlock(&anim_lock);
+
+    if (ret != 0)
+    {
+        LOG_INF("No animation stored");
+    }
+    return ret;
+#else
+    return -ENODEV;
+#endif
+}
+
+bool led_anim_is_loaded(void)
+{
+    return anim_ctx.loaded;
+}
+
+void led_anim_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                     const struct led_layer *layer)
+{
+    size_t n = 0;
+
+    k_mutex_lock(&anim_lock, K_FOREVER);
+
+    if (anim_ctx.loaded)
+    {
+        uint32_t target = ((uint64_t)frame * layer->speed / 100) % anim_ctx.frame_count;
+
+        if (target != anim_ctx.position && anim_advance(target) != 0)
+        {
+            LOG_ERR("Animation frame %d is corrupt, stopping playback", target);
+            anim_ctx.loaded = false;
+        }
+        else
+        {
+            n = MIN(count, anim_ctx.pixel_count);
+            memcpy(leds, anim_ctx.canvas, n * sizeof(*leds));
+        }
+    }
+
+    k_mutex_unlock(&anim_lock);
+
+    memset(&leds[n], 0, (count - n) * sizeof(*leds));
+}
+
+static int store_flush(void)
+{
+    if (anim_ctx.store_buf_len == 0)
+    {
+        return 0;
+    }
+
+    // Pad the tail to the flash write block
+    size_t len = ROUND_UP(anim_ctx.store_buf_len, flash_area_align(anim_ctx.fa));
+
+    memset(&anim_ctx.store_buf[anim_ctx.store_buf_len], 0xFF, len - anim_ctx.store_buf_len);
+
+    int ret = flash_area_write(anim_ctx.fa, anim_ctx.store_pos, anim_ctx.store_buf, len);
+    if (ret != 0)
+    {
+        LOG_ERR("Animation write failed at %zu: %d", anim_ctx.store_pos, ret);
+        return ret;
+    }
+
+    anim_ctx.store_pos += anim_ctx.store_buf_len;
+    anim_ctx.store_buf_len = 0;
+    return 0;
+}
+
+int led_anim_store_begin(size_t size)
+{
+    struct flash_pages_info page;
+    int ret;
+
+    if (anim_ctx.fa == NULL)
+    {
+        return -ENODEV;
+    }
+    if (size < LED_ANIM_HEADER_SIZE || size > anim_ctx.fa->fa_size ||
+        flash_area_align(anim_ctx.fa) > ANIM_WRITE_CHUNK)
+    {
+        return -ENOMEM;
+    }
+
+    ret = flash_get_page_info_by_offs(flash_area_get_device(anim_ctx.fa),
+                                      anim_ctx.fa->fa_off, &page);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    k_mutex_lock(&anim_lock, K_FOREVER);
+    anim_ctx.loaded = false;
+
+    ret = flash_area_erase(anim_ctx.fa, 0,
+                           MIN(ROUND_UP(size, page.size), anim_ctx.fa->fa_size));
+    anim_ctx.storing = (ret == 0);
+    anim_ctx.store_size = size;
+    anim_ctx.store_pos = 0;
+    anim_ctx.store_buf_len = 0;
+
+    k_mutex_unlock(&anim_lock);
+
+    if (ret != 0)
+    {
+        LOG_ERR("Failed to erase user data partition: %d", ret);
+    }
+    return ret;
+}
+
+int led_anim_store(const uint8_t *data, size_t len)
+{
+    int ret = 0;
+
+    k_mutex_lock(&anim_lock, K_FOREVER);
+
+    if (!anim_ctx.storing ||
+        anim_ctx.store_pos + anim_ctx.store_buf_len + len > anim_ctx.store_size)
+    {
+        ret = -EINVAL;
+    }
+
+    while (ret == 0 && len > 0)
+    {
+        size_t n = MIN(len, ANIM_WRITE_CHUNK - anim_ctx.store_buf_len);
+
+        memcpy(&anim_ctx.store_buf[anim_ctx.store_buf_len], data, n);
+        anim_ctx.store_buf_len += n;
+        data += n;
+        len -= n;
+
+        if (anim_ctx.store_buf_len == ANIM_WRITE_CHUNK)
+        {
+            ret = store_flush();
+        }
+    }
+
+    if (ret != 0)
+    {
+        anim_ctx.storing = false;
+    }
+
+    k_mutex_unlock(&anim_lock);
+    return ret;
+}
+
+int led_anim_store_end(void)
+{
+    int ret;
+
+    k_mutex_lock(&anim_lock, K_FOREVER);
+
+    if (!anim_ctx.storing)
+    {
+        k_mutex_unlock(&anim_lock);
+        return -EINVAL;
+    }
+
+    anim_ctx.storing = false;
+    ret = store_flush();
+    if (ret == 0)
+    {
+        ret = (anim_ctx.store_pos == anim_ctx.store_size) ? anim_open() : -EINVAL;
+    }
+    if (ret == 0 && anim_ctx.size != anim_ctx.store_size)
+    {
+        anim_ctx.loaded = false;
+        ret = -EINVAL;
+    }
+
+    k_mutex_unlock(&anim_lock);
+
+    if (ret != 0)
+    {
+        LOG_ERR("Stored animation rejected: %d", ret);
+    }
+    return ret;
+}
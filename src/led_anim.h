@@ -0,0 +1,91 @@
+#ifndef LED_ANIM_H
+#define LED_ANIM_H
+
+#include <stddef.h>
+#include "ksb_common.h"
+#include "led_compositor.h"
+
+/*
+ * Pre-rendered animation playback from the user-data flash partition.
+ *
+ * Frames are decoded straight from flash into a canvas through a small
+ * read-ahead buffer, so RAM use is one frame plus the palette however long
+ * the animation is. Playback needs no per-pixel compute beyond decoding.
+ *
+ * Container (little-endian):
+ *   header  'K' 'A' version flags, u16 pixel_count, u16 frame_count,
+ *           u16 palette_size, u16 reserved, u32 total size in bytes
+ *   palette palette_size RGB triplets (if LED_ANIM_FLAG_PALETTE)
+ *   frames  u8 type, u16 payload length, payload
+ *
+ * A payload is a run of ops on the previous frame's pixels:
+ *   0x00-0x7F  n+1 literal pixels follow
+ *   0x80-0xBF  (n & 0x3F)+1 copies of the pixel that follows
+ *   0xC0-0xFF  (n & 0x3F)+1 pixels unchanged (delta frames only)
+ * A pixel is a palette index with LED_ANIM_FLAG_PALETTE, RGB otherwise.
+ * Frame 0 must be a keyframe; keyframes let playback seek and loop
+ * without decoding the animation from the start.
+ */
+
+#define LED_ANIM_VERSION 1
+#define LED_ANIM_HEADER_SIZE 16
+#define LED_ANIM_FRAME_HEADER_SIZE 3
+#define LED_ANIM_MAX_PALETTE 256
+
+#define LED_ANIM_FLAG_PALETTE BIT(0)
+
+enum led_anim_frame_type
+{
+    LED_ANIM_FRAME_KEY,
+    LED_ANIM_FRAME_DELTA,
+};
+
+/**
+ * Open the animation stored in the user-data partition, if any
+ * @return 0 on success, -ENODEV without a partition, -EINVAL if no valid
+ *         animation is stored
+ */
+int led_anim_init(void);
+
+/**
+ * Check if an animation is ready for playback
+ * @return true if an animation is loaded
+ */
+bool led_anim_is_loaded(void);
+
+/**
+ * Render one frame of the animation (black if none is loaded)
+ *
+ * At speed 100 the animation advances one frame per LED frame, looping.
+ *
+ * @param leds Output pixels
+ * @param count Number of pixels
+ * @param frame Frame number
+ * @param layer Layer parameters (speed)
+ */
+void led_anim_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                     const struct led_layer *layer);
+
+/**
+ * Start writing a new animation, stops playback and erases the partition
+ * @param size Total size of the animation container in bytes
+ * @return 0 on success, -ENOMEM if it does not fit, negative error code
+ *         on flash failure
+ */
+int led_anim_store_begin(size_t size);
+
+/**
+ * Append the next chunk of the animation container
+ * @param data Chunk data
+ * @param len Chunk length, any size
+ * @return 0 on success, negative error code on failure
+ */
+int led_anim_store(const uint8_t *data, size_t len);
+
+/**
+ * Finish writing, validate and start playing the new animation
+ * @return 0 on success, -EINVAL if the written container is malformed
+ */
+int led_anim_store_end(void);
+
+#endif // LED_ANIM_H
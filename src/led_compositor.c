@@ -0,0 +1,60 @@
+#include "led_compositor.h"
+#include "led_math.h"
+
+// dst + (src - dst) * opacity / 255
+static inline uint8_t lerp8(uint8_t dst, uint8_t src, uint8_t opacity)
+{
+    return ksb_scale8(src, opacity) + ksb_scale8(dst, 255 - opacity);
+}
+
+static inline uint8_t add8(uint8_t a, uint8_t b)
+{
+    uint16_t sum = a + b;
+
+    return sum > 255 ? 255 : sum;
+}
+
+void led_compositor_blend(struct led_rgb *dst, const struct led_rgb *src, size_t count,
+                          enum led_blend_mode mode, uint8_t opacity)
+{
+    // Mode is fixed for the whole pass, so each loop stays branch-free per pixel
+    switch (mode)
+    {
+    case LED_BLEND_ADD:
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i].r = add8(dst[i].r, ksb_scale8(src[i].r, opacity));
+            dst[i].g = add8(dst[i].g, ksb_scale8(src[i].g, opacity));
+            dst[i].b = add8(dst[i].b, ksb_scale8(src[i].b, opacity));
+        }
+        break;
+
+    case LED_BLEND_MULTIPLY:
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i].r = lerp8(dst[i].r, ksb_scale8(dst[i].r, src[i].r), opacity);
+            dst[i].g = lerp8(dst[i].g, ksb_scale8(dst[i].g, src[i].g), opacity);
+            dst[i].b = lerp8(dst[i].b, ksb_scale8(dst[i].b, src[i].b), opacity);
+        }
+        break;
+
+    case LED_BLEND_MAX:
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i].r = lerp8(dst[i].r, MAX(dst[i].r, src[i].r), opacity);
+            dst[i].g = lerp8(dst[i].g, MAX(dst[i].g, src[i].g), opacity);
+            dst[i].b = lerp8(dst[i].b, MAX(dst[i].b, src[i].b), opacity);
+        }
+        break;
+
+    case LED_BLEND_ALPHA:
+    default:
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i].r = lerp8(dst[i].r, src[i].r, opacity);
+            dst[i].g = lerp8(dst[i].g, src[i].g, opacity);
+            dst[i].b = lerp8(dst[i].b, src[i].b, opacity);
+        }
+        break;
+    }
+}
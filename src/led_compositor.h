@@ -0,0 +1,41 @@
+#ifndef LED_COMPOSITOR_H
+#define LED_COMPOSITOR_H
+
+#include <stddef.h>
+#include "ksb_common.h"
+
+#define KSB_LED_MAX_LAYERS CONFIG_KSB_LED_MAX_LAYERS
+
+// Layer blend modes
+enum led_blend_mode
+{
+    LED_BLEND_ALPHA,    // Cross-fade over the layers below
+    LED_BLEND_ADD,      // Saturating add
+    LED_BLEND_MULTIPLY, // Multiply, e.g. a breathing mask
+    LED_BLEND_MAX,      // Per-channel maximum (lighten)
+    LED_BLEND_COUNT
+};
+
+// One pattern layer; layer 0 is the base and is always drawn opaque
+struct led_layer
+{
+    enum ksb_led_pattern pattern;
+    struct led_rgb color;
+    uint32_t speed;
+    uint32_t seed;
+    enum led_blend_mode blend;
+    uint8_t opacity;
+};
+
+/**
+ * Blend a rendered layer onto the frame below it
+ * @param dst Frame composed so far, updated in place
+ * @param src Rendered layer
+ * @param count Number of pixels
+ * @param mode Blend mode
+ * @param opacity Layer opacity (255 = fully applied)
+ */
+void led_compositor_blend(struct led_rgb *dst, const struct led_rgb *src, size_t count,
+                          enum led_blend_mode mode, uint8_t opacity);
+
+#endif // LED_COMPOSITOR_H
@@ -1,236 +1,364 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/random/random.h>
+#include <string.h>
 
-#include <math.h>
 #include "ksb_common.h"
 #include "led_control.h"
+#include "led_anim.h"
+#include "led_compositor.h"
+#include "led_math.h"
+#include "led_pattern.h"
+#include "led_postproc.h"
+#include "led_power.h"
+#include "led_scheduler.h"
+#include "led_vm.h"
+#include "mesh_clock.h"
 #include "mesh_network.h"
+#include "nvs_storage.h"
+#include "pixel_stream.h"
 #include "../ws2812/ws2812_driver.h"
 
 LOG_MODULE_REGISTER(led_control, CONFIG_LOG_DEFAULT_LEVEL);
 
+// Crossfade from the previous base pattern to the current one
+struct led_transition
+{
+    bool active;
+    struct led_layer from;
+    uint32_t from_frame;
+    uint8_t from_brightness;
+    uint64_t start_us; // Mesh clock
+    uint32_t duration_ms;
+};
+
 static struct led_control_context
 {
     struct ws2812_driver ws_driver;
-    enum ksb_led_pattern current_pattern;
-    struct led_rgb current_color;
+    struct led_postproc post;
+    struct led_scheduler sched;
+    struct led_power power;
+    uint32_t user_fps;
+    struct k_spinlock lock;
+    struct led_layer layers[KSB_LED_MAX_LAYERS];
+    size_t num_layers;
+    struct led_transition transition;
+    // Pattern instances owned by the render thread: one per layer, one for the outgoing pattern
+    struct led_pattern_instance instances[KSB_LED_MAX_LAYERS];
+    struct led_pattern_instance from_instance;
     uint32_t current_brightness;
-    uint32_t current_speed;
-    uint32_t frame_counter;
+    // Mesh clock time of frame 0 of the base pattern, frames count from it
+    uint64_t start_us;
+    size_t led_count;
     bool running;
+    struct k_sem wake;
+    struct led_rgb leds[KSB_LED_MAX_COUNT];
+    struct led_rgb layer_buf[KSB_LED_MAX_COUNT];
+    struct led_rgb last_pushed[KSB_LED_MAX_COUNT];
+    bool have_pushed;
+    uint8_t last_scale;
+    uint32_t since_full;
+    struct led_output_stats stats;
     struct k_thread led_thread;
     K_KERNEL_STACK_MEMBER(led_stack, 2048);
 } led_ctx;
 
-// Pattern implementations
-static void pattern_off(struct led_rgb *leds, uint32_t frame)
+// Number of leading pixels up to and including the last one that differs
+static size_t dirty_prefix(const struct led_rgb *a, const struct led_rgb *b, size_t count)
 {
-    struct led_rgb black = {0, 0, 0};
-    for (int i = 0; i < KSB_LED_COUNT; i++)
+    while (count > 0 && a[count - 1].r == b[count - 1].r && a[count - 1].g == b[count - 1].g &&
+           a[count - 1].b == b[count - 1].b)
     {
-        leds[i] = black;
+        count--;
     }
+    return count;
 }
 
-static void pattern_solid(struct led_rgb *leds, uint32_t frame)
+static bool layers_are_static(size_t num_layers)
 {
-    for (int i = 0; i < KSB_LED_COUNT; i++)
+    for (size_t i = 0; i < num_layers; i++)
     {
-        leds[i] = led_ctx.current_color;
+        if (!led_ctx.instances[i].pattern->is_static)
+        {
+            return false;
+        }
     }
+    return true;
 }
 
-static void pattern_breathing(struct led_rgb *leds, uint32_t frame)
+// Wake the render thread after a parameter change
+static void led_control_wake(void)
 {
-    // Sine wave breathing effect
-    float breath = (sin((frame * led_ctx.current_speed) / 1000.0f) + 1.0f) / 2.0f;
-    uint8_t brightness = (uint8_t)(breath * led_ctx.current_brightness);
+    k_sem_give(&led_ctx.wake);
+}
+
+// Transition progress (0-255), or -1 once it has run its course
+static int transition_progress(const struct led_transition *tr, uint64_t now_us)
+{
+    if (now_us < tr->start_us)
+    {
+        return 0;
+    }
 
-    struct led_rgb color = {
-        (led_ctx.current_color.r * brightness) / 255,
-        (led_ctx.current_color.g * brightness) / 255,
-        (led_ctx.current_color.b * brightness) / 255};
+    uint64_t elapsed = now_us - tr->start_us;
 
-    for (int i = 0; i < KSB_LED_COUNT; i++)
+    if (elapsed >= (uint64_t)tr->duration_ms * USEC_PER_MSEC)
     {
-        leds[i] = color;
+        return -1;
     }
+    return (elapsed * 255) / ((uint64_t)tr->duration_ms * USEC_PER_MSEC);
 }
 
-static void pattern_running_light(struct led_rgb *leds, uint32_t frame)
+// Frame of a pattern started at start_us, so every node renders the same frame at the same time
+static uint32_t frame_at(uint64_t now_us, uint64_t start_us, uint32_t fps)
 {
-    // Clear all LEDs
-    struct led_rgb black = {0, 0, 0};
-    for (int i = 0; i < KSB_LED_COUNT; i++)
+    if (now_us <= start_us)
     {
-        leds[i] = black;
+        return 0;
     }
+    return ((now_us - start_us) * fps + USEC_PER_SEC / 2) / USEC_PER_SEC;
+}
 
-    // Calculate position
-    int pos = (frame * led_ctx.current_speed / 100) % KSB_LED_COUNT;
-    leds[pos] = led_ctx.current_color;
+// Full 64-bit mesh time of a 32-bit millisecond stamp within 24 days of now
+static uint64_t mesh_time_from_ms(uint64_t now_us, uint32_t ms)
+{
+    int32_t ahead_ms = ms - (uint32_t)(now_us / USEC_PER_MSEC);
 
-    // Add trail
-    int trail_pos = (pos - 1 + KSB_LED_COUNT) % KSB_LED_COUNT;
-    leds[trail_pos] = (struct led_rgb){
-        led_ctx.current_color.r / 3,
-        led_ctx.current_color.g / 3,
-        led_ctx.current_color.b / 3};
+    return now_us - now_us % USEC_PER_MSEC + (int64_t)ahead_ms * USEC_PER_MSEC;
 }
 
-static void pattern_rainbow(struct led_rgb *leds, uint32_t frame)
+// A crossfade renders the base pattern twice; cut it short rather than miss frames
+static bool transition_over_budget(void)
 {
-    for (int i = 0; i < KSB_LED_COUNT; i++)
+    uint32_t period_us = USEC_PER_SEC / led_ctx.sched.fps;
+
+    return led_ctx.stats.render_us > period_us;
+}
+
+static void transition_finish(const struct led_transition *tr)
+{
+    k_spinlock_key_t key = k_spin_lock(&led_ctx.lock);
+    // Only if no newer transition replaced it meanwhile
+    if (led_ctx.transition.start_us == tr->start_us)
     {
-        float hue = ((frame * led_ctx.current_speed / 10) + (i * 360 / KSB_LED_COUNT)) % 360;
+        led_ctx.transition.active = false;
+    }
+    k_spin_unlock(&led_ctx.lock, key);
+}
 
-        // Simple HSV to RGB conversion
-        float c = (float)led_ctx.current_brightness / 255.0f;
-        float x = c * (1 - fabs(fmod(hue / 60.0f, 2) - 1));
-        float m = 0;
+// Render the base layer, then render and blend each overlay through one scratch buffer
+static void compose_frame(struct led_rgb *leds, const struct led_layer *layers,
+                          size_t num_layers, uint32_t frame,
+                          const struct led_transition *tr, uint8_t progress)
+{
+    size_t count = led_ctx.led_count;
 
-        float r, g, b;
-        if (hue < 60)
-        {
-            r = c;
-            g = x;
-            b = 0;
-        }
-        else if (hue < 120)
-        {
-            r = x;
-            g = c;
-            b = 0;
-        }
-        else if (hue < 180)
-        {
-            r = 0;
-            g = c;
-            b = x;
-        }
-        else if (hue < 240)
+    for (size_t i = 0; i < num_layers; i++)
+    {
+        uint32_t start = k_cycle_get_32();
+
+        struct led_pattern_instance *inst = &led_ctx.instances[i];
+
+        led_pattern_bind(inst, &layers[i], count);
+
+        if (i == 0 && tr->active)
         {
-            r = 0;
-            g = x;
-            b = c;
+            // Outgoing pattern keeps animating from where it was, incoming fades in over it
+            led_pattern_bind(&led_ctx.from_instance, &tr->from, count);
+            led_pattern_render(&led_ctx.from_instance, leds, tr->from_frame + frame);
+            led_pattern_render(inst, led_ctx.layer_buf, frame);
+            led_compositor_blend(leds, led_ctx.layer_buf, count, LED_BLEND_ALPHA, progress);
         }
-        else if (hue < 300)
+        else if (i == 0)
         {
-            r = x;
-            g = 0;
-            b = c;
+            led_pattern_render(inst, leds, frame);
         }
         else
         {
-            r = c;
-            g = 0;
-            b = x;
+            led_pattern_render(inst, led_ctx.layer_buf, frame);
+            led_compositor_blend(leds, led_ctx.layer_buf, count, layers[i].blend, layers[i].opacity);
         }
 
-        leds[i] = (struct led_rgb){
-            (uint8_t)((r + m) * 255),
-            (uint8_t)((g + m) * 255),
-            (uint8_t)((b + m) * 255)};
+        led_ctx.stats.layer_us[i] = k_cyc_to_us_near32(k_cycle_get_32() - start);
     }
 }
 
-static void pattern_sparkle(struct led_rgb *leds, uint32_t frame)
+// Post-process a frame into the driver and send the part of it that changed
+static bool push_frame(const struct led_rgb *leds, uint32_t start)
 {
-    // Start with dim background
-    struct led_rgb dim_color = {
-        led_ctx.current_color.r / 10,
-        led_ctx.current_color.g / 10,
-        led_ctx.current_color.b / 10};
+    // The chain is clocked from pixel 0, so only pixels up to the last
+    // changed one need sending; the rest hold what they latched last time.
+    // A new output mapping changes every pixel and needs a full push, as
+    // does the periodic refresh that repairs pixels hit by line noise
+    bool full = !led_ctx.have_pushed || led_postproc_is_dirty(&led_ctx.post) ||
+                led_power_is_dirty(&led_ctx.power) ||
+                (CONFIG_KSB_LED_FULL_REFRESH_FRAMES > 0 &&
+                 led_ctx.since_full >= CONFIG_KSB_LED_FULL_REFRESH_FRAMES);
+    size_t count = full ? led_ctx.led_count
+                        : dirty_prefix(leds, led_ctx.last_pushed, led_ctx.led_count);
+
+    if (count == 0)
+    {
+        led_ctx.stats.pushes_skipped++;
+        return false;
+    }
+
+    // Brightness, gamma and white balance in one pass straight into the
+    // driver's back buffer, then hand it off; transmission overlaps the
+    // next frame's render
+    led_postproc_apply(&led_ctx.post, leds, led_ctx.ws_driver.pixels, led_ctx.led_count);
 
-    for (int i = 0; i < KSB_LED_COUNT; i++)
+    // The current limit scales the whole frame, a new scale touches every pixel
+    uint8_t scale = led_power_limit(&led_ctx.power, led_ctx.ws_driver.pixels,
+                                    led_ctx.led_count);
+    if (scale != led_ctx.last_scale)
     {
-        leds[i] = dim_color;
+        count = led_ctx.led_count;
+        led_ctx.last_scale = scale;
     }
 
-    // Add random sparkles
-    if ((frame % (200 - led_ctx.current_speed)) == 0)
+    led_ctx.stats.render_us = k_cyc_to_us_near32(k_cycle_get_32() - start);
+    ws2812_submit(&led_ctx.ws_driver, count);
+    led_ctx.stats.push_us = led_ctx.ws_driver.tx_us;
+
+    memcpy(led_ctx.last_pushed, leds, count * sizeof(struct led_rgb));
+    led_ctx.have_pushed = true;
+    led_ctx.since_full = count == led_ctx.led_count ? 0 : led_ctx.since_full + 1;
+    led_ctx.stats.pushes++;
+    if (count < led_ctx.led_count)
     {
-        int sparkle_pos = sys_rand32_get() % KSB_LED_COUNT;
-        leds[sparkle_pos] = led_ctx.current_color;
+        led_ctx.stats.pushes_partial++;
     }
+    return true;
 }
 
-static void pattern_wave(struct led_rgb *leds, uint32_t frame)
+#ifdef CONFIG_KSB_PIXEL_STREAM
+// Show frames from a show controller as they complete, the sender sets the pace
+static bool stream_frame(uint32_t start)
 {
-    for (int i = 0; i < KSB_LED_COUNT; i++)
-    {
-        float wave = sin((frame * led_ctx.current_speed / 100.0f) + (i * 3.14159f / KSB_LED_COUNT));
-        wave = (wave + 1.0f) / 2.0f; // Normalize to 0-1
+    bool fresh;
+    const struct led_rgb *frame = pixel_stream_frame(&fresh);
 
-        uint8_t brightness = (uint8_t)(wave * led_ctx.current_brightness);
+    if (frame == NULL)
+    {
+        return false;
+    }
 
-        leds[i] = (struct led_rgb){
-            (led_ctx.current_color.r * brightness) / 255,
-            (led_ctx.current_color.g * brightness) / 255,
-            (led_ctx.current_color.b * brightness) / 255};
+    if (fresh)
+    {
+        led_postproc_set_brightness(&led_ctx.post, led_ctx.current_brightness);
+        push_frame(frame, start);
+        led_ctx.stats.frames_streamed++;
+#ifdef CONFIG_KSB_MESH_FRAMES
+        // The master passes the stream on, nodes apply their own brightness; the frame
+        // is only copied here and sent from the system work queue
+        if (mesh_network_is_connected())
+        {
+            mesh_broadcast_frame(frame, led_ctx.led_count, mesh_network_get_zones());
+        }
+#endif
     }
+
+    // Woken by the next frame, patterns resume once the stream times out
+    k_sem_take(&led_ctx.wake, K_MSEC(CONFIG_KSB_PIXEL_STREAM_TIMEOUT_MS));
+    led_scheduler_reset(&led_ctx.sched);
+    return true;
 }
+#endif
 
 // LED control thread
 static void led_control_thread(void *arg1, void *arg2, void *arg3)
 {
-    struct led_rgb leds[KSB_LED_COUNT];
+    struct led_rgb *leds = led_ctx.leds;
+    struct led_layer layers[KSB_LED_MAX_LAYERS];
+    struct led_transition tr;
+    size_t num_layers;
+    uint32_t frame;
+    uint64_t start_us;
+    uint8_t brightness;
 
     while (led_ctx.running)
     {
-        // Apply brightness scaling
-        uint8_t brightness_scale = led_ctx.current_brightness;
+        uint32_t start = k_cycle_get_32();
 
-        // Generate pattern
-        switch (led_ctx.current_pattern)
+#ifdef CONFIG_KSB_PIXEL_STREAM
+        // A streaming show controller bypasses the pattern engine entirely
+        if (stream_frame(start))
         {
-        case KSB_PATTERN_OFF:
-            pattern_off(leds, led_ctx.frame_counter);
-            break;
-        case KSB_PATTERN_SOLID:
-            pattern_solid(leds, led_ctx.frame_counter);
-            break;
-        case KSB_PATTERN_BREATHING:
-            pattern_breathing(leds, led_ctx.frame_counter);
-            break;
-        case KSB_PATTERN_RUNNING_LIGHT:
-            pattern_running_light(leds, led_ctx.frame_counter);
-            break;
-        case KSB_PATTERN_RAINBOW:
-            pattern_rainbow(leds, led_ctx.frame_counter);
-            break;
-        case KSB_PATTERN_SPARKLE:
-            pattern_sparkle(leds, led_ctx.frame_counter);
-            break;
-        case KSB_PATTERN_WAVE:
-            pattern_wave(leds, led_ctx.frame_counter);
-            break;
-        default:
-            pattern_off(leds, led_ctx.frame_counter);
-            break;
+            continue;
+        }
+#endif
+
+        uint64_t now_us = mesh_clock_now_us();
+
+        // Snapshot parameters so a concurrent update cannot tear a frame
+        k_spinlock_key_t key = k_spin_lock(&led_ctx.lock);
+        // Joining a mesh steps the clock, which can leave the start far ahead
+        if (led_ctx.start_us > now_us + USEC_PER_SEC)
+        {
+            led_ctx.start_us = now_us;
+            led_ctx.transition.active = false;
         }
+        num_layers = led_ctx.num_layers;
+        memcpy(layers, led_ctx.layers, num_layers * sizeof(layers[0]));
+        tr = led_ctx.transition;
+        brightness = led_ctx.current_brightness;
+        start_us = led_ctx.start_us;
+        k_spin_unlock(&led_ctx.lock, key);
 
-        // Apply global brightness scaling (except for breathing which handles its own)
-        if (led_ctx.current_pattern != KSB_PATTERN_BREATHING)
+        frame = frame_at(now_us, start_us, led_ctx.user_fps);
+
+        uint8_t progress = 255;
+        if (tr.active)
         {
-            for (int i = 0; i < KSB_LED_COUNT; i++)
+            int p = transition_progress(&tr, now_us);
+
+            if (p < 0 || transition_over_budget())
             {
-                leds[i].r = (leds[i].r * brightness_scale) / 255;
-                leds[i].g = (leds[i].g * brightness_scale) / 255;
-                leds[i].b = (leds[i].b * brightness_scale) / 255;
+                if (p >= 0)
+                {
+                    led_ctx.stats.transitions_cut++;
+                }
+                transition_finish(&tr);
+                tr.active = false;
+            }
+            else
+            {
+                progress = p;
+                brightness = ksb_scale8(tr.from_brightness, 255 - progress) +
+                             ksb_scale8(brightness, progress);
             }
         }
+        led_postproc_set_brightness(&led_ctx.post, brightness);
 
-        // Update physical LEDs
-        for (int i = 0; i < KSB_LED_COUNT; i++)
+        // Generate pattern
+        compose_frame(leds, layers, num_layers, frame, &tr, progress);
+
+        led_ctx.stats.frames_rendered++;
+
+        bool changed = push_frame(leds, start);
+
+        // A static frame that has settled cannot change until a parameter does
+        if (!changed && !tr.active && layers_are_static(num_layers))
         {
-            led_ctx.ws_driver.pixels[i] = leds[i];
+            led_ctx.stats.parks++;
+            k_sem_take(&led_ctx.wake, K_FOREVER);
+            led_scheduler_reset(&led_ctx.sched);
+            continue;
         }
-        led_strip_update_rgb(led_ctx.ws_driver.dev, led_ctx.ws_driver.pixels, KSB_LED_COUNT);
 
-        led_ctx.frame_counter++;
-        k_msleep(KSB_LED_UPDATE_RATE_MS);
+        // Follow the battery frame rate cap
+        uint32_t fps = led_power_cap_fps(&led_ctx.power, led_ctx.user_fps);
+        if (fps != led_ctx.sched.requested_fps)
+        {
+            led_scheduler_set_fps(&led_ctx.sched, fps);
+        }
+
+        // Phase-lock frame deadlines to the pattern start on the mesh clock
+        led_scheduler_align(&led_ctx.sched,
+                            k_us_to_ticks_near64(mesh_clock_to_local_us(start_us)));
+
+        led_scheduler_wait(&led_ctx.sched);
     }
 }
 
@@ -246,13 +374,43 @@ int led_control_init(void)
         return ret;
     }
 
+    led_ctx.led_count = led_ctx.ws_driver.num_leds;
+    led_pattern_registry_init();
+
+#ifdef CONFIG_KSB_LED_VM
+    // Restore the last effect program pushed to this node
+    uint8_t program[LED_VM_MAX_BYTECODE];
+
+    ret = nvs_storage_load_program(program, sizeof(program));
+    if (ret > 0)
+    {
+        led_vm_load(program, ret);
+    }
+#endif
+
+#ifdef CONFIG_KSB_LED_PATTERN_ANIMATION
+    led_anim_init();
+#endif
+
     // Set default pattern
-    led_ctx.current_pattern = KSB_PATTERN_OFF;
-    led_ctx.current_color = (struct led_rgb){100, 100, 100};
+    led_ctx.layers[0] = (struct led_layer){
+        .pattern = KSB_PATTERN_OFF,
+        .color = {100, 100, 100},
+        .speed = 100,
+        .blend = LED_BLEND_ALPHA,
+        .opacity = 255};
+    led_ctx.num_layers = 1;
     led_ctx.current_brightness = 128;
-    led_ctx.current_speed = 100;
-    led_ctx.frame_counter = 0;
+    led_ctx.start_us = mesh_clock_now_us();
+    led_ctx.last_scale = 255;
     led_ctx.running = true;
+    k_sem_init(&led_ctx.wake, 0, 1);
+
+    led_postproc_init(&led_ctx.post);
+    led_postproc_set_brightness(&led_ctx.post, led_ctx.current_brightness);
+    led_scheduler_init(&led_ctx.sched, CONFIG_KSB_LED_DEFAULT_FPS);
+    led_ctx.user_fps = CONFIG_KSB_LED_DEFAULT_FPS;
+    led_power_init(&led_ctx.power, CONFIG_KSB_POWER_BUDGET_MA, led_control_wake);
 
     // Start LED control thread
     k_thread_create(&led_ctx.led_thread, led_ctx.led_stack,
@@ -261,31 +419,73 @@ int led_control_init(void)
                     7, 0, K_NO_WAIT);
     k_thread_name_set(&led_ctx.led_thread, "led_ctrl");
 
-    LOG_INF("LED control initialized");
+#ifdef CONFIG_KSB_PIXEL_STREAM
+    ret = pixel_stream_init(led_ctx.led_count, led_control_wake);
+    if (ret != 0)
+    {
+        LOG_WRN("Pixel stream receiver unavailable: %d", ret);
+    }
+#endif
+
+    LOG_INF("LED control initialized: %zu LEDs", led_ctx.led_count);
     return 0;
 }
 
 void led_control_set_pattern(enum ksb_led_pattern pattern, struct led_rgb color,
                              uint8_t brightness, uint32_t speed)
 {
-    led_ctx.current_pattern = pattern;
-    led_ctx.current_color = color;
+    led_control_fade_to_pattern(pattern, color, brightness, speed, led_ctx.layers[0].seed,
+                                CONFIG_KSB_LED_TRANSITION_MS, mesh_clock_now_ms());
+}
+
+void led_control_fade_to_pattern(enum ksb_led_pattern pattern, struct led_rgb color,
+                                 uint8_t brightness, uint32_t speed, uint32_t seed,
+                                 uint32_t transition_ms, uint32_t start_ms)
+{
+    uint64_t start_us = mesh_time_from_ms(mesh_clock_now_us(), start_ms);
+
+    k_spinlock_key_t key = k_spin_lock(&led_ctx.lock);
+    if (transition_ms > 0)
+    {
+        // The outgoing pattern keeps running on its own frame count
+        led_ctx.transition = (struct led_transition){
+            .active = true,
+            .from = led_ctx.layers[0],
+            .from_frame = frame_at(start_us, led_ctx.start_us, led_ctx.user_fps),
+            .from_brightness = led_ctx.current_brightness,
+            .start_us = start_us,
+            .duration_ms = transition_ms};
+        led_ctx.stats.transitions++;
+    }
+    else
+    {
+        led_ctx.transition.active = false;
+    }
+    led_ctx.layers[0].pattern = pattern;
+    led_ctx.layers[0].color = color;
+    led_ctx.layers[0].speed = speed;
+    led_ctx.layers[0].seed = seed;
     led_ctx.current_brightness = brightness;
-    led_ctx.current_speed = speed;
-    led_ctx.frame_counter = 0;
+    led_ctx.start_us = start_us;
+    k_spin_unlock(&led_ctx.lock, key);
+    led_control_wake();
 
-    LOG_INF("LED pattern set: %d, color: (%d,%d,%d), brightness: %d, speed: %d",
-            pattern, color.r, color.g, color.b, brightness, speed);
+    LOG_INF("LED pattern set: %d, color: (%d,%d,%d), brightness: %d, speed: %d, fade: %d ms",
+            pattern, color.r, color.g, color.b, brightness, speed, transition_ms);
 }
 
 void led_control_next_pattern(void)
 {
-    enum ksb_led_pattern next = (led_ctx.current_pattern + 1) % KSB_PATTERN_COUNT;
+    enum ksb_led_pattern next = led_control_get_current_pattern();
 
-    // Skip OFF pattern when cycling
-    if (next == KSB_PATTERN_OFF)
+    // Skip OFF and patterns that are not built in when cycling
+    for (int i = 0; i < KSB_PATTERN_COUNT; i++)
     {
-        next = KSB_PATTERN_SOLID;
+        next = (next + 1) % KSB_PATTERN_COUNT;
+        if (next != KSB_PATTERN_OFF && led_pattern_find(next) != NULL)
+        {
+            break;
+        }
     }
 
     struct led_rgb colors[] = {
@@ -299,8 +499,13 @@ void led_control_next_pattern(void)
     };
 
     struct led_rgb color = colors[sys_rand32_get() % ARRAY_SIZE(colors)];
+    // One seed per pattern change keeps random effects identical on every node
+    uint32_t seed = sys_rand32_get();
+    // Same start on the mesh clock keeps every node in phase
+    uint32_t start_ms = mesh_clock_now_ms();
 
-    led_control_set_pattern(next, color, 128, 100);
+    led_control_fade_to_pattern(next, color, 128, 100, seed, CONFIG_KSB_LED_TRANSITION_MS,
+                                start_ms);
 
     // Broadcast to mesh if connected
     if (mesh_network_is_connected())
@@ -310,12 +515,124 @@ void led_control_next_pattern(void)
             .color = color,
             .brightness = 128,
             .speed = 100,
-            .frame = 0};
-        mesh_broadcast_led_command(&cmd);
+            .start_ms = start_ms,
+            .transition_ms = CONFIG_KSB_LED_TRANSITION_MS,
+            .seed = seed};
+        // Addressed to the zones of this node, the rest of the mesh keeps its pattern
+        mesh_broadcast_led_command(&cmd, mesh_network_get_zones());
     }
 }
 
+int led_control_set_layer(size_t index, const struct led_layer *layer)
+{
+    if (index == 0 || index >= KSB_LED_MAX_LAYERS || layer->pattern >= KSB_PATTERN_COUNT ||
+        layer->blend >= LED_BLEND_COUNT)
+    {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&led_ctx.lock);
+    led_ctx.layers[index] = *layer;
+    // Unused layers below the new one stay transparent
+    for (size_t i = led_ctx.num_layers; i < index; i++)
+    {
+        led_ctx.layers[i] = (struct led_layer){.pattern = KSB_PATTERN_OFF, .opacity = 0};
+    }
+    led_ctx.num_layers = MAX(led_ctx.num_layers, index + 1);
+    k_spin_unlock(&led_ctx.lock, key);
+    led_control_wake();
+
+    LOG_INF("LED layer %zu set: pattern %d, blend %d, opacity %d",
+            index, layer->pattern, layer->blend, layer->opacity);
+    return 0;
+}
+
+void led_control_clear_layers(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&led_ctx.lock);
+    led_ctx.num_layers = 1;
+    k_spin_unlock(&led_ctx.lock, key);
+    led_control_wake();
+}
+
+int led_control_load_program(const uint8_t *bytecode, size_t len)
+{
+#ifdef CONFIG_KSB_LED_VM
+    int ret = led_vm_load(bytecode, len);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    nvs_storage_save_program(bytecode, len);
+    led_control_wake();
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+void led_control_set_color_correction(struct led_rgb correction)
+{
+    led_postproc_set_correction(&led_ctx.post, correction);
+    led_control_wake();
+
+    LOG_INF("LED color correction set: (%d,%d,%d)", correction.r, correction.g, correction.b);
+}
+
+int led_control_set_frame_rate(uint32_t fps)
+{
+    // The battery cap may lower fps, check what was asked for
+    if (fps > LED_SCHEDULER_MAX_FPS)
+    {
+        return -EINVAL;
+    }
+
+    int ret = led_scheduler_set_fps(&led_ctx.sched, led_power_cap_fps(&led_ctx.power, fps));
+
+    if (ret == 0)
+    {
+        led_ctx.user_fps = fps;
+        led_control_wake();
+        LOG_INF("LED frame rate set: %d fps", fps);
+    }
+    return ret;
+}
+
+void led_control_set_power_budget(uint32_t budget_ma)
+{
+    led_power_set_budget(&led_ctx.power, budget_ma);
+    led_control_wake();
+
+    LOG_INF("LED power budget set: %d mA", budget_ma);
+}
+
+void led_control_get_frame_stats(struct led_scheduler_stats *stats)
+{
+    led_scheduler_get_stats(&led_ctx.sched, stats);
+}
+
+void led_control_get_output_stats(struct led_output_stats *stats)
+{
+    struct ws2812_tx_stats tx;
+
+    *stats = led_ctx.stats;
+    ws2812_get_tx_stats(&led_ctx.ws_driver, &tx);
+    stats->bytes_sent = tx.pixels_sent * 3;
+    stats->bytes_full = tx.pixels_full * 3;
+}
+
+void led_control_get_power_stats(struct led_power_stats *stats)
+{
+    led_power_get_stats(&led_ctx.power, stats);
+}
+
+size_t led_control_get_led_count(void)
+{
+    return led_ctx.led_count;
+}
+
 enum ksb_led_pattern led_control_get_current_pattern(void)
 {
-    return led_ctx.current_pattern;
+    return led_ctx.layers[0].pattern;
 }
\ No newline at end of file
@@ -2,6 +2,27 @@
 #define LED_CONTROL_H
 
 #include "ksb_common.h"
+#include "led_compositor.h"
+#include "led_power.h"
+#include "led_scheduler.h"
+
+/* Strip output statistics */
+struct led_output_stats
+{
+    uint32_t frames_rendered; // Frames produced by the pattern engine
+    uint32_t frames_streamed; // Frames shown from a pixel stream (see pixel_stream.h)
+    uint32_t pushes;          // Frames sent to the strip
+    uint32_t pushes_skipped;  // Frames identical to the last push
+    uint32_t pushes_partial;  // Pushes that sent only the changed prefix of the chain
+    uint32_t parks;           // Times the render thread idled on a static frame
+    uint32_t render_us;       // Last render + post-processing time
+    uint32_t layer_us[KSB_LED_MAX_LAYERS]; // Last render + blend time per layer
+    uint32_t transitions;     // Crossfades started
+    uint32_t transitions_cut; // Crossfades ended early to hold the frame deadline
+    uint32_t push_us;         // Last strip transmission time
+    uint64_t bytes_sent;      // Pixel data bytes sent to the strips
+    uint64_t bytes_full;      // Pixel data bytes full-frame pushes would have sent
+};
 
 /**
  * Initialize LED control subsystem
@@ -10,7 +31,8 @@
 int led_control_init(void);
 
 /**
- * Set LED pattern with parameters
+ * Set LED pattern with parameters, crossfading over CONFIG_KSB_LED_TRANSITION_MS.
+ * The random seed of the base layer is kept.
  * @param pattern LED pattern to set
  * @param color Base color for the pattern
  * @param brightness Overall brightness (0-255)
@@ -19,11 +41,92 @@ int led_control_init(void);
 void led_control_set_pattern(enum ksb_led_pattern pattern, struct led_rgb color,
                              uint8_t brightness, uint32_t speed);
 
+/**
+ * Set LED pattern with an explicit crossfade duration
+ * @param pattern LED pattern to set
+ * @param color Base color for the pattern
+ * @param brightness Overall brightness (0-255)
+ * @param speed Pattern animation speed
+ * @param seed Seed for random effects, nodes with the same seed render the same frames
+ * @param transition_ms Crossfade duration, 0 for a hard cut
+ * @param start_ms Mesh clock time (mesh_clock_now_ms()) of the pattern's first
+ *                 frame and the start of the crossfade; nodes given the same
+ *                 start render the same frame at the same time
+ */
+void led_control_fade_to_pattern(enum ksb_led_pattern pattern, struct led_rgb color,
+                                 uint8_t brightness, uint32_t speed, uint32_t seed,
+                                 uint32_t transition_ms, uint32_t start_ms);
+
+/**
+ * Set an overlay layer composed on top of the base pattern
+ * @param index Layer index (1 .. KSB_LED_MAX_LAYERS - 1, layer 0 is the base pattern)
+ * @param layer Layer pattern, parameters and blend mode
+ * @return 0 on success, -EINVAL on invalid index or parameters
+ */
+int led_control_set_layer(size_t index, const struct led_layer *layer);
+
+/**
+ * Remove all overlay layers, leaving only the base pattern
+ */
+void led_control_clear_layers(void);
+
 /**
  * Cycle to next LED pattern (for button control)
  */
 void led_control_next_pattern(void);
 
+/**
+ * Load an effect program for the script pattern and persist it
+ * @param bytecode Program in led_vm wire format
+ * @param len Length in bytes
+ * @return 0 on success, -EINVAL if the program is malformed,
+ *         -ENOTSUP if the VM is not built in
+ */
+int led_control_load_program(const uint8_t *bytecode, size_t len);
+
+/**
+ * Set per-channel white balance applied to every frame
+ * @param correction Channel gains (255 = unity)
+ */
+void led_control_set_color_correction(struct led_rgb correction);
+
+/**
+ * Set LED frame rate, applied at the next frame boundary
+ * @param fps Frame rate (frames per second)
+ * @return 0 on success, -EINVAL if fps is zero or above LED_SCHEDULER_MAX_FPS
+ */
+int led_control_set_frame_rate(uint32_t fps);
+
+/**
+ * Set strip current budget, frames that would draw more are dimmed
+ * @param budget_ma Budget in mA (0 = unlimited)
+ */
+void led_control_set_power_budget(uint32_t budget_ma);
+
+/**
+ * Get frame timing statistics (overruns, missed deadlines, jitter)
+ * @param stats Pointer to store statistics
+ */
+void led_control_get_frame_stats(struct led_scheduler_stats *stats);
+
+/**
+ * Get strip output statistics (pushes sent and skipped)
+ * @param stats Pointer to store statistics
+ */
+void led_control_get_output_stats(struct led_output_stats *stats);
+
+/**
+ * Get power governor statistics (limiting events, battery, energy)
+ * @param stats Pointer to store statistics
+ */
+void led_control_get_power_stats(struct led_power_stats *stats);
+
+/**
+ * Get number of LEDs on the attached chain
+ * @return Chain length (at most CONFIG_WS2812B_MAX_PIXELS)
+ */
+size_t led_control_get_led_count(void);
+
 /**
  * Get current LED pattern
  * @return Current pattern
@@ -0,0 +1,95 @@
+#include "led_math.h"
+
+/* sin(2*pi*i/256) in Q15 */
+static const int16_t sin_table[256] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+    6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+    32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285,
+    32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571,
+    30273, 29956, 29621, 29268, 28898, 28510, 28105, 27683,
+    27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+    23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868,
+    18204, 17530, 16846, 16151, 15446, 14732, 14010, 13279,
+    12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179,
+    6393, 5602, 4808, 4011, 3212, 2410, 1608, 804,
+    0, -804, -1608, -2410, -3212, -4011, -4808, -5602,
+    -6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+    -12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530,
+    -18204, -18868, -19519, -20159, -20787, -21403, -22005, -22594,
+    -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+    -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956,
+    -30273, -30571, -30852, -31113, -31356, -31580, -31785, -31971,
+    -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+    -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285,
+    -32137, -31971, -31785, -31580, -31356, -31113, -30852, -30571,
+    -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683,
+    -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731,
+    -23170, -22594, -22005, -21403, -20787, -20159, -19519, -18868,
+    -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+    -12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179,
+    -6393, -5602, -4808, -4011, -3212, -2410, -1608, -804,
+};
+
+/* 2^32 / (2*pi) */
+#define BAM_PER_RAD 683565276ULL
+
+uint32_t ksb_rad_to_bam(uint32_t num, uint32_t den)
+{
+    return (uint32_t)(((uint64_t)num * BAM_PER_RAD) / den);
+}
+
+int16_t ksb_sin_q15(uint32_t bam)
+{
+    uint8_t idx = bam >> 24;
+    int32_t frac = (bam >> 16) & 0xFF;
+    int32_t a = sin_table[idx];
+    int32_t b = sin_table[(uint8_t)(idx + 1)];
+
+    return (int16_t)(a + (((b - a) * frac) >> 8));
+}
+
+uint16_t ksb_wave_q16(uint32_t bam)
+{
+    return (uint16_t)(ksb_sin_q15(bam) + 32768);
+}
+
+struct led_rgb ksb_hsv_to_rgb(uint16_t hue, uint8_t sat, uint8_t val)
+{
+    uint16_t h = hue % 360;
+    uint8_t c = ksb_scale8(val, sat);
+    uint8_t m = val - c;
+    int32_t t = h % 120;
+    uint8_t x = (c * (60 - (t < 60 ? 60 - t : t - 60))) / 60;
+    uint8_t cm = c + m;
+    uint8_t xm = x + m;
+
+    // Same six-sector split as the float reference implementation
+    if (h < 60)
+    {
+        return (struct led_rgb){cm, xm, m};
+    }
+    else if (h < 120)
+    {
+        return (struct led_rgb){xm, cm, m};
+    }
+    else if (h < 180)
+    {
+        return (struct led_rgb){m, cm, xm};
+    }
+    else if (h < 240)
+    {
+        return (struct led_rgb){m, xm, cm};
+    }
+    else if (h < 300)
+    {
+        return (struct led_rgb){xm, m, cm};
+    }
+
+    return (struct led_rgb){cm, m, xm};
+}
@@ -0,0 +1,120 @@
+#ifndef LED_MATH_H
+#define LED_MATH_H
+
+#include <stdint.h>
+#include <zephyr/drivers/led_strip.h>
+
+/*
+ * Fixed-point helpers for the LED pattern engine.
+ *
+ * Angles are 32-bit binary angles (BAM): a full turn is 2^32, so phase
+ * accumulation wraps for free. Sines are returned in Q15, hues in degrees.
+ */
+
+#define KSB_BAM_HALF_TURN 0x80000000UL
+
+/**
+ * Scale an 8-bit value: floor(value * scale / 255) without a divide
+ * @param value Input value
+ * @param scale Scale factor (255 = unity)
+ * @return Scaled value
+ */
+static inline uint8_t ksb_scale8(uint8_t value, uint8_t scale)
+{
+    uint32_t x = (uint32_t)value * scale;
+
+    return (uint8_t)((x + 1 + (x >> 8)) >> 8);
+}
+
+/**
+ * Scale all channels of a color by an 8-bit factor
+ * @param color Input color
+ * @param scale Scale factor (255 = unity)
+ * @return Scaled color
+ */
+static inline struct led_rgb ksb_scale_rgb(struct led_rgb color, uint8_t scale)
+{
+    return (struct led_rgb){
+        .r = ksb_scale8(color.r, scale),
+        .g = ksb_scale8(color.g, scale),
+        .b = ksb_scale8(color.b, scale)};
+}
+
+/**
+ * Counter-based random number: a stateless hash of (seed, counter)
+ *
+ * Equal inputs give equal outputs on every node, so random effects keyed
+ * by a shared seed and the frame index stay in sync without extra
+ * traffic, and there is no generator state to keep or lock.
+ *
+ * @param seed Stream key
+ * @param counter Position in the stream, e.g. frame index
+ * @return 32 uniformly distributed random bits
+ */
+static inline uint32_t ksb_rand32(uint32_t seed, uint32_t counter)
+{
+    // Weyl step on the counter, then a 32-bit avalanche finalizer
+    uint32_t x = seed ^ ((counter + 1) * 0x9E3779B9UL);
+
+    x ^= x >> 16;
+    x *= 0x7FEB352DUL;
+    x ^= x >> 15;
+    x *= 0x846CA68BUL;
+    x ^= x >> 16;
+    return x;
+}
+
+/**
+ * Map random bits onto [0, range) without a divide
+ * @param rand Random bits (e.g. from ksb_rand32)
+ * @param range Size of the range
+ * @return Value in [0, range)
+ */
+static inline uint32_t ksb_rand_range(uint32_t rand, uint32_t range)
+{
+    return ((uint64_t)rand * range) >> 32;
+}
+
+/**
+ * Convert num/den radians to a binary angle
+ * @param num Angle numerator in radians
+ * @param den Angle denominator (must be non-zero)
+ * @return Binary angle, wrapped to one turn
+ */
+uint32_t ksb_rad_to_bam(uint32_t num, uint32_t den);
+
+/**
+ * Sine of a binary angle (256-entry table, linearly interpolated)
+ * @param bam Binary angle
+ * @return sin(angle) in Q15 (-32767..32767)
+ */
+int16_t ksb_sin_q15(uint32_t bam);
+
+/**
+ * Sine remapped to an unsigned wave: (sin + 1) / 2
+ * @param bam Binary angle
+ * @return Wave level in Q16 (0..65535)
+ */
+uint16_t ksb_wave_q16(uint32_t bam);
+
+/**
+ * Integer HSV to RGB conversion
+ * @param hue Hue in degrees (0-359, larger values wrap)
+ * @param sat Saturation (0-255)
+ * @param val Value (0-255)
+ * @return RGB color
+ */
+struct led_rgb ksb_hsv_to_rgb(uint16_t hue, uint8_t sat, uint8_t val);
+
+/**
+ * Fully saturated color on the hue wheel
+ * @param hue Hue in degrees (0-359, larger values wrap)
+ * @param val Value (0-255)
+ * @return RGB color
+ */
+static inline struct led_rgb ksb_hue_wheel(uint16_t hue, uint8_t val)
+{
+    return ksb_hsv_to_rgb(hue, 255, val);
+}
+
+#endif // LED_MATH_H
@@ -0,0 +1,63 @@
+#include <string.h>
+#include <zephyr/logging/log.h>
+#include "led_pattern.h"
+
+LOG_MODULE_REGISTER(led_pattern, CONFIG_LOG_DEFAULT_LEVEL);
+
+static const struct led_pattern *pattern_table[KSB_PATTERN_COUNT];
+
+void led_pattern_registry_init(void)
+{
+    STRUCT_SECTION_FOREACH(led_pattern, pattern)
+    {
+        if (pattern->id < KSB_PATTERN_COUNT)
+        {
+            pattern_table[pattern->id] = pattern;
+            LOG_DBG("Registered pattern %d: %s", pattern->id, pattern->name);
+        }
+    }
+}
+
+const struct led_pattern *led_pattern_find(enum ksb_led_pattern id)
+{
+    if (id >= KSB_PATTERN_COUNT)
+    {
+        return NULL;
+    }
+    return pattern_table[id];
+}
+
+static bool layer_equal(const struct led_layer *a, const struct led_layer *b)
+{
+    return a->pattern == b->pattern && a->speed == b->speed && a->seed == b->seed &&
+           a->color.r == b->color.r && a->color.g == b->color.g && a->color.b == b->color.b &&
+           a->blend == b->blend && a->opacity == b->opacity;
+}
+
+void led_pattern_bind(struct led_pattern_instance *inst, const struct led_layer *layer,
+                      size_t count)
+{
+    if (inst->pattern != NULL && inst->count == count &&
+        layer_equal(&inst->layer, layer))
+    {
+        return;
+    }
+
+    const struct led_pattern *pattern = led_pattern_find(layer->pattern);
+
+    // Patterns compiled out render as OFF, which is always built in
+    inst->pattern = pattern ? pattern : pattern_table[KSB_PATTERN_OFF];
+    inst->layer = *layer;
+    inst->count = count;
+    memset(inst->state, 0, sizeof(inst->state));
+
+    if (inst->pattern->activate)
+    {
+        inst->pattern->activate(inst->state, layer, count);
+    }
+}
+
+void led_pattern_render(struct led_pattern_instance *inst, struct led_rgb *leds, uint32_t frame)
+{
+    inst->pattern->render(leds, inst->count, frame, &inst->layer, inst->state);
+}
@@ -0,0 +1,88 @@
+#ifndef LED_PATTERN_H
+#define LED_PATTERN_H
+
+#include <zephyr/sys/iterable_sections.h>
+#include "ksb_common.h"
+#include "led_compositor.h"
+
+// Per-instance private state available to each pattern
+#define KSB_LED_PATTERN_STATE_SIZE 16
+
+/*
+ * Pattern descriptor. Patterns register themselves with LED_PATTERN_DEFINE
+ * and are collected in an iterable section, so a pattern can be compiled
+ * out through Kconfig without touching the LED engine.
+ *
+ * activate() runs on the render thread whenever a layer switches to the
+ * pattern or its parameters change, and precomputes frame invariants into
+ * the instance state. render() then draws one frame from that state.
+ */
+struct led_pattern
+{
+    enum ksb_led_pattern id;
+    const char *name;
+    bool is_static;
+    void (*activate)(void *state, const struct led_layer *layer, size_t count);
+    void (*render)(struct led_rgb *leds, size_t count, uint32_t frame,
+                   const struct led_layer *layer, void *state);
+};
+
+// A pattern bound to one layer, with its precomputed state
+struct led_pattern_instance
+{
+    const struct led_pattern *pattern;
+    struct led_layer layer;
+    size_t count;
+    uint8_t state[KSB_LED_PATTERN_STATE_SIZE] __aligned(4);
+};
+
+/**
+ * Register an LED pattern
+ * @param _name Pattern name
+ * @param _id Pattern identifier (enum ksb_led_pattern)
+ * @param _state_size Size of the pattern's private state
+ * @param _activate Precompute hook, may be NULL
+ * @param _render Per-frame render hook
+ * @param _is_static True if output never changes while parameters stay the same
+ */
+#define LED_PATTERN_DEFINE(_name, _id, _state_size, _activate, _render, _is_static) \
+    BUILD_ASSERT((_state_size) <= KSB_LED_PATTERN_STATE_SIZE,                      \
+                 "LED pattern state too large");                                   \
+    const STRUCT_SECTION_ITERABLE(led_pattern, led_pattern_##_name) = {            \
+        .id = _id,                                                                 \
+        .name = #_name,                                                            \
+        .is_static = _is_static,                                                   \
+        .activate = _activate,                                                     \
+        .render = _render,                                                         \
+    }
+
+/**
+ * Build the pattern lookup table (call once at init)
+ */
+void led_pattern_registry_init(void);
+
+/**
+ * Find a registered pattern
+ * @param id Pattern identifier
+ * @return Pattern descriptor, or NULL if the pattern is not built in
+ */
+const struct led_pattern *led_pattern_find(enum ksb_led_pattern id);
+
+/**
+ * Bind a layer to an instance, running the activate hook if anything changed
+ * @param inst Pattern instance
+ * @param layer Layer parameters
+ * @param count Number of pixels
+ */
+void led_pattern_bind(struct led_pattern_instance *inst, const struct led_layer *layer,
+                      size_t count);
+
+/**
+ * Render one frame of a bound instance
+ * @param inst Pattern instance
+ * @param leds Output pixels
+ * @param frame Frame number
+ */
+void led_pattern_render(struct led_pattern_instance *inst, struct led_rgb *leds, uint32_t frame);
+
+#endif // LED_PATTERN_H
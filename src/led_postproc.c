@@ -0,0 +1,89 @@
+#include "led_postproc.h"
+#include "led_math.h"
+
+#ifdef CONFIG_KSB_LED_GAMMA_CORRECTION
+/* round(255 * (i / 255)^2.2) */
+static const uint8_t gamma_table[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6,
+    6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10, 11, 11, 11, 12,
+    12, 13, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 19,
+    20, 20, 21, 22, 22, 23, 23, 24, 25, 25, 26, 26, 27, 28, 28, 29,
+    30, 30, 31, 32, 33, 33, 34, 35, 35, 36, 37, 38, 39, 39, 40, 41,
+    42, 43, 43, 44, 45, 46, 47, 48, 49, 49, 50, 51, 52, 53, 54, 55,
+    56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+    73, 74, 75, 76, 77, 78, 79, 81, 82, 83, 84, 85, 87, 88, 89, 90,
+    91, 93, 94, 95, 97, 98, 99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+#endif
+
+static void led_postproc_rebuild(struct led_postproc *pp)
+{
+    const uint8_t gain[3] = {pp->correction.r, pp->correction.g, pp->correction.b};
+
+    pp->dirty = false;
+
+    for (int v = 0; v < 256; v++)
+    {
+        uint8_t level = ksb_scale8(v, pp->brightness);
+
+#ifdef CONFIG_KSB_LED_GAMMA_CORRECTION
+        level = gamma_table[level];
+#endif
+        for (int ch = 0; ch < 3; ch++)
+        {
+            pp->lut[ch][v] = ksb_scale8(level, gain[ch]);
+        }
+    }
+}
+
+void led_postproc_init(struct led_postproc *pp)
+{
+    pp->brightness = 255;
+    pp->correction = (struct led_rgb){255, 255, 255};
+    led_postproc_rebuild(pp);
+}
+
+void led_postproc_set_brightness(struct led_postproc *pp, uint8_t brightness)
+{
+    if (pp->brightness != brightness)
+    {
+        pp->brightness = brightness;
+        pp->dirty = true;
+    }
+}
+
+void led_postproc_set_correction(struct led_postproc *pp, struct led_rgb correction)
+{
+    pp->correction = correction;
+    pp->dirty = true;
+}
+
+void led_postproc_apply(struct led_postproc *pp, const struct led_rgb *src,
+                        struct led_rgb *dst, size_t count)
+{
+    if (pp->dirty)
+    {
+        led_postproc_rebuild(pp);
+    }
+
+    const uint8_t *lut_r = pp->lut[0];
+    const uint8_t *lut_g = pp->lut[1];
+    const uint8_t *lut_b = pp->lut[2];
+
+    // Branch-free, one pass, no divides
+    for (size_t i = 0; i < count; i++)
+    {
+        struct led_rgb px = src[i];
+
+        dst[i].r = lut_r[px.r];
+        dst[i].g = lut_g[px.g];
+        dst[i].b = lut_b[px.b];
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef LED_POSTPROC_H
+#define LED_POSTPROC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <zephyr/drivers/led_strip.h>
+
+/*
+ * Per-frame output stage: global brightness, gamma and per-channel white
+ * balance folded into one 256-entry lookup table per channel. The tables
+ * are rebuilt lazily on the render thread when a parameter changes, so
+ * the per-pixel cost is three byte loads.
+ */
+struct led_postproc
+{
+    uint8_t lut[3][256];
+    uint8_t brightness;
+    struct led_rgb correction;
+    volatile bool dirty;
+};
+
+/**
+ * Initialize post-processing stage (full brightness, no correction)
+ * @param pp Post-processing context
+ */
+void led_postproc_init(struct led_postproc *pp);
+
+/**
+ * Set global output brightness
+ * @param pp Post-processing context
+ * @param brightness Brightness (0-255), applied before gamma
+ */
+void led_postproc_set_brightness(struct led_postproc *pp, uint8_t brightness);
+
+/**
+ * Set per-channel white balance
+ * @param pp Post-processing context
+ * @param correction Channel gains (255 = unity)
+ */
+void led_postproc_set_correction(struct led_postproc *pp, struct led_rgb correction);
+
+/**
+ * Check whether output mapping changed since the last applied frame
+ * @param pp Post-processing context
+ * @return true if the tables will be rebuilt on the next apply
+ */
+static inline bool led_postproc_is_dirty(const struct led_postproc *pp)
+{
+    return pp->dirty;
+}
+
+/**
+ * Map a rendered frame to output pixels in a single pass
+ * @param pp Post-processing context
+ * @param src Rendered pixels
+ * @param dst Output pixels (may alias src)
+ * @param count Number of pixels
+ */
+void led_postproc_apply(struct led_postproc *pp, const struct led_rgb *src,
+                        struct led_rgb *dst, size_t count);
+
+#endif // LED_POSTPROC_H
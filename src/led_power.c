@@ -0,0 +1,260 @@
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/drivers/adc.h>
+#include "led_math.h"
+#include "led_power.h"
+
+#ifdef CONFIG_ADC_EMUL
+#include <zephyr/drivers/adc/adc_emul.h>
+#endif
+
+LOG_MODULE_REGISTER(led_power, CONFIG_LOG_DEFAULT_LEVEL);
+
+// WS2812B draw: ~20 mA per channel at full duty plus ~1 mA quiescent per LED
+#define LED_CHANNEL_MA 20
+#define LED_IDLE_MA 1
+
+#define BATTERY_LEVELS 10
+#define BATTERY_HYSTERESIS_PCT 5
+#define BATTERY_MIN_SCALE 64
+
+/*
+ * The battery is measured through the io-channels of the zephyr,user node,
+ * behind a resistor divider of CONFIG_KSB_POWER_BATTERY_DIVIDER / 1000.
+ */
+#define ZEPHYR_USER_NODE DT_PATH(zephyr_user)
+
+#if defined(CONFIG_ADC) && DT_NODE_HAS_PROP(ZEPHYR_USER_NODE, io_channels)
+#define LED_POWER_HAS_BATTERY 1
+static const struct adc_dt_spec battery_adc = ADC_DT_SPEC_GET(ZEPHYR_USER_NODE);
+#endif
+
+#ifdef LED_POWER_HAS_BATTERY
+static int battery_init(void)
+{
+    int ret;
+
+    if (!adc_is_ready_dt(&battery_adc))
+    {
+        LOG_ERR("Battery ADC %s not ready", battery_adc.dev->name);
+        return -ENODEV;
+    }
+
+    ret = adc_channel_setup_dt(&battery_adc);
+    if (ret != 0)
+    {
+        LOG_ERR("Failed to set up battery ADC channel: %d", ret);
+        return ret;
+    }
+
+#ifdef CONFIG_ADC_EMUL
+    // Emulated battery starts out full
+    adc_emul_const_value_set(battery_adc.dev, battery_adc.channel_id,
+                             CONFIG_KSB_POWER_BATTERY_FULL_MV * 1000 /
+                                 CONFIG_KSB_POWER_BATTERY_DIVIDER);
+#endif
+    return 0;
+}
+
+static int battery_read_mv(void)
+{
+    int16_t raw;
+    int32_t mv;
+    struct adc_sequence sequence = {
+        .buffer = &raw,
+        .buffer_size = sizeof(raw),
+    };
+
+    adc_sequence_init_dt(&battery_adc, &sequence);
+
+    int ret = adc_read(battery_adc.dev, &sequence);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    mv = raw;
+    ret = adc_raw_to_millivolts_dt(&battery_adc, &mv);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    return mv * CONFIG_KSB_POWER_BATTERY_DIVIDER / 1000;
+}
+
+static uint8_t battery_percent(uint32_t mv)
+{
+    const uint32_t empty = CONFIG_KSB_POWER_BATTERY_EMPTY_MV;
+    const uint32_t full = CONFIG_KSB_POWER_BATTERY_FULL_MV;
+
+    if (mv <= empty)
+    {
+        return 0;
+    }
+    if (mv >= full)
+    {
+        return 100;
+    }
+    return (mv - empty) * 100 / (full - empty);
+}
+
+// Level in 10% steps; rising needs a margin so load-induced sag does not flap
+static uint8_t battery_level(uint8_t current, uint8_t pct)
+{
+    uint8_t level = MIN(pct / (100 / BATTERY_LEVELS), BATTERY_LEVELS);
+
+    if (level > current && pct < level * (100 / BATTERY_LEVELS) + BATTERY_HYSTERESIS_PCT)
+    {
+        return current;
+    }
+    return level;
+}
+
+// Full output down to half charge, then brightness tapers and fps drops when nearly empty
+static void battery_policy(struct led_power *pw, uint8_t level)
+{
+    const uint8_t taper = BATTERY_LEVELS / 2;
+    uint8_t scale = 255;
+    uint32_t fps_cap = 0;
+
+    if (level < taper)
+    {
+        scale = BATTERY_MIN_SCALE + level * (255 - BATTERY_MIN_SCALE) / taper;
+    }
+    if (level < 2)
+    {
+        fps_cap = CONFIG_KSB_POWER_LOW_BATTERY_FPS;
+    }
+
+    if (scale < pw->battery_scale || (fps_cap != 0 && (pw->fps_cap == 0 || fps_cap < pw->fps_cap)))
+    {
+        pw->stats.battery_throttles++;
+    }
+
+    if (scale != pw->battery_scale || fps_cap != pw->fps_cap)
+    {
+        pw->battery_scale = scale;
+        pw->fps_cap = fps_cap;
+        pw->dirty = true;
+
+        LOG_INF("Battery %d%%: brightness cap %d, fps cap %d",
+                pw->stats.battery_pct, scale, fps_cap);
+
+        if (pw->on_change)
+        {
+            pw->on_change();
+        }
+    }
+}
+
+static void battery_work_handler(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    struct led_power *pw = CONTAINER_OF(dwork, struct led_power, battery_work);
+    int mv = battery_read_mv();
+
+    if (mv > 0)
+    {
+        // Smooth out load transients
+        pw->stats.battery_mv = pw->stats.battery_mv ? (3 * pw->stats.battery_mv + mv) / 4 : mv;
+        pw->stats.battery_pct = battery_percent(pw->stats.battery_mv);
+        pw->battery_level = battery_level(pw->battery_level, pw->stats.battery_pct);
+        battery_policy(pw, pw->battery_level);
+    }
+    else
+    {
+        LOG_WRN("Battery read failed: %d", mv);
+    }
+
+    k_work_schedule(dwork, K_MSEC(CONFIG_KSB_POWER_BATTERY_INTERVAL_MS));
+}
+#endif
+
+void led_power_init(struct led_power *pw, uint32_t budget_ma, void (*on_change)(void))
+{
+    pw->budget_ma = budget_ma;
+    pw->battery_scale = 255;
+    pw->fps_cap = 0;
+    pw->dirty = false;
+    pw->battery_level = BATTERY_LEVELS;
+    pw->last_ma = 0;
+    pw->start_ms = k_uptime_get_32();
+    pw->last_ms = pw->start_ms;
+    pw->charge_ma_ms = 0;
+    pw->on_change = on_change;
+    pw->stats = (struct led_power_stats){.battery_pct = 100};
+
+#ifdef LED_POWER_HAS_BATTERY
+    if (battery_init() == 0)
+    {
+        k_work_init_delayable(&pw->battery_work, battery_work_handler);
+        k_work_schedule(&pw->battery_work, K_NO_WAIT);
+    }
+#else
+    LOG_INF("No battery ADC, brightness limited by current budget only");
+#endif
+}
+
+void led_power_set_budget(struct led_power *pw, uint32_t budget_ma)
+{
+    pw->budget_ma = budget_ma;
+    pw->dirty = true;
+}
+
+uint8_t led_power_limit(struct led_power *pw, struct led_rgb *pixels, size_t count)
+{
+    uint32_t channel_sum = 0;
+    uint32_t idle_ma = count * LED_IDLE_MA;
+    uint32_t budget = pw->budget_ma;
+    uint8_t scale = pw->battery_scale;
+
+    pw->dirty = false;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        channel_sum += pixels[i].r + pixels[i].g + pixels[i].b;
+    }
+
+    uint32_t channel_ma = channel_sum * LED_CHANNEL_MA / 255;
+
+    pw->stats.peak_request_ma = MAX(pw->stats.peak_request_ma, channel_ma + idle_ma);
+
+    if (budget != 0 && channel_ma != 0 && channel_ma * scale / 255 + idle_ma > budget)
+    {
+        uint32_t avail = budget > idle_ma ? budget - idle_ma : 0;
+
+        scale = MIN(scale, avail * 255 / channel_ma);
+        pw->stats.frames_limited++;
+    }
+
+    if (scale < 255)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            pixels[i] = ksb_scale_rgb(pixels[i], scale);
+        }
+    }
+
+    // The previous frame was lit until now
+    uint32_t now = k_uptime_get_32();
+
+    pw->charge_ma_ms += (uint64_t)pw->last_ma * (now - pw->last_ms);
+    pw->last_ms = now;
+    pw->last_ma = channel_ma * scale / 255 + idle_ma;
+    pw->stats.frame_ma = pw->last_ma;
+
+    return scale;
+}
+
+void led_power_get_stats(const struct led_power *pw, struct led_power_stats *stats)
+{
+    uint32_t now = k_uptime_get_32();
+    uint64_t charge = pw->charge_ma_ms + (uint64_t)pw->last_ma * (now - pw->last_ms);
+    uint32_t elapsed = now - pw->start_ms;
+
+    *stats = pw->stats;
+    stats->energy_mwh_per_hour =
+        elapsed ? charge * CONFIG_KSB_POWER_SUPPLY_MV / 1000 / elapsed : 0;
+}
@@ -0,0 +1,97 @@
+#ifndef LED_POWER_H
+#define LED_POWER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/led_strip.h>
+
+/* Power governor statistics */
+struct led_power_stats
+{
+    uint32_t frames_limited;      // Frames scaled down to fit the current budget
+    uint32_t battery_throttles;   // Battery level drops that lowered brightness or fps
+    uint32_t frame_ma;            // Estimated strip current of the last pushed frame
+    uint32_t peak_request_ma;     // Highest current a frame asked for before limiting
+    uint32_t battery_mv;          // Filtered battery voltage, 0 without a battery ADC
+    uint8_t battery_pct;          // Battery level (100 without a battery ADC)
+    uint32_t energy_mwh_per_hour; // Average strip power since boot
+};
+
+/*
+ * Strip current limiter. Every outgoing frame is costed from its channel
+ * values and scaled down in place when it would exceed the budget or the
+ * brightness cap derived from the battery level. The battery is sampled
+ * from the system workqueue; a low battery also caps the frame rate.
+ */
+struct led_power
+{
+    volatile uint32_t budget_ma;
+    volatile uint8_t battery_scale;
+    volatile uint32_t fps_cap;
+    volatile bool dirty;
+    uint8_t battery_level;
+    uint32_t last_ma;
+    uint32_t last_ms;
+    uint32_t start_ms;
+    uint64_t charge_ma_ms;
+    void (*on_change)(void);
+    struct led_power_stats stats;
+    struct k_work_delayable battery_work;
+};
+
+/**
+ * Initialize power governor and start battery sampling
+ * @param pw Governor context
+ * @param budget_ma Strip current budget in mA (0 = unlimited)
+ * @param on_change Called when the battery level changes the output caps
+ */
+void led_power_init(struct led_power *pw, uint32_t budget_ma, void (*on_change)(void));
+
+/**
+ * Set strip current budget
+ * @param pw Governor context
+ * @param budget_ma Budget in mA (0 = unlimited)
+ */
+void led_power_set_budget(struct led_power *pw, uint32_t budget_ma);
+
+/**
+ * Check whether the caps changed since the last limited frame
+ * @param pw Governor context
+ * @return true if the next frame must be pushed even if unchanged
+ */
+static inline bool led_power_is_dirty(const struct led_power *pw)
+{
+    return pw->dirty;
+}
+
+/**
+ * Apply the battery frame rate cap
+ * @param pw Governor context
+ * @param fps Requested frame rate
+ * @return Frame rate to run at
+ */
+static inline uint32_t led_power_cap_fps(const struct led_power *pw, uint32_t fps)
+{
+    uint32_t cap = pw->fps_cap;
+
+    return (cap != 0 && cap < fps) ? cap : fps;
+}
+
+/**
+ * Cost an outgoing frame and scale it in place to fit the caps
+ * @param pw Governor context
+ * @param pixels Frame as it will be sent to the strip
+ * @param count Number of pixels
+ * @return Scale applied (255 = unchanged)
+ */
+uint8_t led_power_limit(struct led_power *pw, struct led_rgb *pixels, size_t count);
+
+/**
+ * Get power governor statistics
+ * @param pw Governor context
+ * @param stats Pointer to store statistics
+ */
+void led_power_get_stats(const struct led_power *pw, struct led_power_stats *stats);
+
+#endif // LED_POWER_H
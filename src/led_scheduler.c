@@ -0,0 +1,98 @@
+#include <errno.h>
+#include <string.h>
+#include "led_scheduler.h"
+
+static k_ticks_t slot_deadline(const struct led_scheduler *sched, uint32_t slot)
+{
+    return sched->anchor + ((int64_t)slot * CONFIG_SYS_CLOCK_TICKS_PER_SEC) / sched->fps;
+}
+
+void led_scheduler_init(struct led_scheduler *sched, uint32_t fps)
+{
+    memset(&sched->stats, 0, sizeof(sched->stats));
+    sched->jitter_avg_x16 = 0;
+    sched->fps = fps;
+    sched->requested_fps = fps;
+    sched->anchor = k_uptime_ticks();
+    sched->slot = 1;
+    sched->deadline = slot_deadline(sched, sched->slot);
+}
+
+void led_scheduler_reset(struct led_scheduler *sched)
+{
+    sched->fps = sched->requested_fps;
+    sched->anchor = k_uptime_ticks();
+    sched->slot = 1;
+    sched->deadline = slot_deadline(sched, sched->slot);
+}
+
+int led_scheduler_set_fps(struct led_scheduler *sched, uint32_t fps)
+{
+    if (fps == 0 || fps > LED_SCHEDULER_MAX_FPS)
+    {
+        return -EINVAL;
+    }
+
+    sched->requested_fps = fps;
+    return 0;
+}
+
+void led_scheduler_align(struct led_scheduler *sched, k_ticks_t origin)
+{
+    if (origin > sched->deadline)
+    {
+        return;
+    }
+
+    sched->fps = sched->requested_fps;
+    sched->anchor = origin;
+    sched->slot = ((sched->deadline - origin) * sched->fps + CONFIG_SYS_CLOCK_TICKS_PER_SEC / 2) /
+                  CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+    sched->deadline = slot_deadline(sched, sched->slot);
+}
+
+void led_scheduler_wait(struct led_scheduler *sched)
+{
+    uint32_t fps = sched->requested_fps;
+    k_ticks_t now = k_uptime_ticks();
+
+    // Re-anchor on the pending deadline so a rate change keeps phase
+    if (fps != sched->fps)
+    {
+        sched->anchor = sched->deadline;
+        sched->slot = 0;
+        sched->fps = fps;
+    }
+
+    if (now > sched->deadline)
+    {
+        // Frame work ran past its deadline: start the next one immediately,
+        // and drop any whole slots that have already gone by
+        uint32_t late_slots = ((now - sched->deadline) * sched->fps) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+
+        sched->stats.overruns++;
+        sched->stats.missed_deadlines += late_slots;
+        sched->slot += late_slots;
+    }
+    else
+    {
+        k_sleep(K_TIMEOUT_ABS_TICKS(sched->deadline));
+
+        uint32_t jitter_us = k_ticks_to_us_near32(k_uptime_ticks() - sched->deadline);
+
+        // EMA with weight 1/16 on a x16 accumulator, a plain integer EMA would stop
+        // up to 15 us short of the mean
+        sched->jitter_avg_x16 += jitter_us - (sched->jitter_avg_x16 >> 4);
+        sched->stats.jitter_avg_us = sched->jitter_avg_x16 >> 4;
+        sched->stats.jitter_max_us = MAX(sched->stats.jitter_max_us, jitter_us);
+    }
+
+    sched->stats.frames++;
+    sched->slot++;
+    sched->deadline = slot_deadline(sched, sched->slot);
+}
+
+void led_scheduler_get_stats(const struct led_scheduler *sched, struct led_scheduler_stats *stats)
+{
+    *stats = sched->stats;
+}
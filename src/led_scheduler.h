@@ -0,0 +1,80 @@
+#ifndef LED_SCHEDULER_H
+#define LED_SCHEDULER_H
+
+#include <zephyr/kernel.h>
+
+// Highest frame rate, the period must stay at least one tick (and 1 ms)
+#define LED_SCHEDULER_MAX_FPS MIN(1000, CONFIG_SYS_CLOCK_TICKS_PER_SEC)
+
+/* Frame timing statistics */
+struct led_scheduler_stats
+{
+    uint32_t frames;           // Frames completed
+    uint32_t overruns;         // Frames whose work ran past their deadline
+    uint32_t missed_deadlines; // Whole frame slots dropped to catch up
+    uint32_t jitter_avg_us;    // Smoothed wake-up lateness
+    uint32_t jitter_max_us;    // Worst wake-up lateness
+};
+
+/*
+ * Absolute-deadline frame clock. Deadline n is anchor + n / fps, computed
+ * from the frame index rather than accumulated, so the period never drifts
+ * regardless of render or push time.
+ */
+struct led_scheduler
+{
+    k_ticks_t anchor;
+    k_ticks_t deadline;
+    uint32_t slot;
+    uint32_t fps;
+    volatile uint32_t requested_fps;
+    // Jitter average times 16, so the EMA keeps its fractional part
+    uint32_t jitter_avg_x16;
+    struct led_scheduler_stats stats;
+};
+
+/**
+ * Initialize frame scheduler, first deadline is one period from now
+ * @param sched Scheduler context
+ * @param fps Frame rate (frames per second)
+ */
+void led_scheduler_init(struct led_scheduler *sched, uint32_t fps);
+
+/**
+ * Re-anchor the frame clock on the current time, e.g. after the render
+ * thread was parked, so the idle period is not counted as missed frames
+ * @param sched Scheduler context
+ */
+void led_scheduler_reset(struct led_scheduler *sched);
+
+/**
+ * Request a new frame rate, applied at the next frame boundary
+ * @param sched Scheduler context
+ * @param fps Frame rate (frames per second)
+ * @return 0 on success, -EINVAL if fps is zero or above LED_SCHEDULER_MAX_FPS
+ */
+int led_scheduler_set_fps(struct led_scheduler *sched, uint32_t fps);
+
+/**
+ * Move the frame grid onto frames of an external clock: the pending deadline
+ * goes to the nearest origin + n / fps. Origins still ahead are ignored.
+ * Applies a pending frame rate change.
+ * @param sched Scheduler context
+ * @param origin Time of a frame boundary (frame 0) in local ticks
+ */
+void led_scheduler_align(struct led_scheduler *sched, k_ticks_t origin);
+
+/**
+ * Finish the current frame and sleep until the next deadline
+ * @param sched Scheduler context
+ */
+void led_scheduler_wait(struct led_scheduler *sched);
+
+/**
+ * Get frame timing statistics
+ * @param sched Scheduler context
+ * @param stats Pointer to store statistics
+ */
+void led_scheduler_get_stats(const struct led_scheduler *sched, struct led_scheduler_stats *stats);
+
+#endif // LED_SCHEDULER_H
@@ -0,0 +1,678 @@
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include "led_vm.h"
+#include "led_math.h"
+
+LOG_MODULE_REGISTER(led_vm, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define REG_INDEX 0
+#define REG_COUNT 1
+#define REG_FRAME 2
+#define REG_SPEED 3
+#define REG_COLOR 4
+#define REG_OUT 7
+
+// Internal ops the decoder fuses instructions into
+#define VM_OP_SCALE_RGB LED_VM_OP_COUNT // Three SCALEs by one factor on consecutive registers
+#define VM_OP_MADD (LED_VM_OP_COUNT + 1)   // MUL then ADD, imm holds the addend register
+#define VM_OP_SIN_BAM (LED_VM_OP_COUNT + 2)   // SIN of lhs as a 32-bit angle, for SHR by 16 then SIN
+#define VM_OP_WAVE_BAM (LED_VM_OP_COUNT + 3)  // WAVE of lhs as a 32-bit angle, for SHR by 16 then WAVE
+#define VM_OP_FRAME_END (LED_VM_OP_COUNT + 4) // End of the per-frame part
+#define VM_OP_COUNT (LED_VM_OP_COUNT + 5)
+
+// Pre-decoded instruction: handler address plus operands
+struct led_vm_insn
+{
+    const void *handler;
+    int32_t imm;
+    uint8_t dst;
+    uint8_t src;
+    uint8_t lhs; // Left operand of two-operand ops, dst unless a MOV was folded in
+};
+
+struct led_vm_program
+{
+    // Per-frame part and per-pixel part, each terminated by an END
+    struct led_vm_insn code[LED_VM_MAX_INSNS + 2];
+    uint16_t len;
+    uint16_t kernel;     // Index of the first per-pixel instruction
+    uint16_t kernel_len; // Per-pixel instructions, 0 if every pixel gets the same color
+    uint16_t restore;    // Registers a pixel may read after the pixel before changed them
+};
+
+// Instruction as read from the wire, before it is threaded
+struct vm_op
+{
+    uint8_t op;
+    uint8_t dst;
+    uint8_t src;
+    uint8_t lhs;
+    int32_t imm;
+};
+
+static struct led_vm_program active_program;
+static struct led_vm_program staging_program;
+static bool program_loaded;
+static K_MUTEX_DEFINE(program_lock);
+static K_MUTEX_DEFINE(load_lock);
+
+static bool opcode_has_imm(uint8_t op)
+{
+    return op == LED_VM_OP_LDI || op == LED_VM_OP_ADDI || op == LED_VM_OP_MULI ||
+           op == LED_VM_OP_SKIPZ || op == LED_VM_OP_SKIPNZ || op == LED_VM_OP_RAD;
+}
+
+static bool opcode_is_skip(uint8_t op)
+{
+    return op == LED_VM_OP_SKIPZ || op == LED_VM_OP_SKIPNZ;
+}
+
+// Ops that update dst from its own value
+static bool opcode_has_lhs(uint8_t op)
+{
+    return (op >= LED_VM_OP_ADD && op <= LED_VM_OP_MAX) || op == LED_VM_OP_ADDI ||
+           op == LED_VM_OP_MULI || op == LED_VM_OP_SCALE || op == LED_VM_OP_RAD;
+}
+
+static uint16_t op_reads(const struct vm_op *o)
+{
+    switch (o->op)
+    {
+    case LED_VM_OP_END:
+    case LED_VM_OP_LDI:
+        return 0;
+    case LED_VM_OP_ADDI:
+    case LED_VM_OP_MULI:
+    case LED_VM_OP_RAD:
+    case VM_OP_SIN_BAM:
+    case VM_OP_WAVE_BAM:
+        return BIT(o->lhs);
+    case VM_OP_SCALE_RGB:
+        return BIT(o->lhs) | BIT(o->lhs + 1) | BIT(o->lhs + 2) | BIT(o->src);
+    case VM_OP_MADD:
+        return BIT(o->lhs) | BIT(o->src) | BIT(o->imm);
+    default:
+        return (opcode_has_lhs(o->op) ? BIT(o->lhs) : 0) | BIT(o->src);
+    }
+}
+
+static uint16_t op_writes(const struct vm_op *o)
+{
+    switch (o->op)
+    {
+    case LED_VM_OP_END:
+    case LED_VM_OP_SKIPZ:
+    case LED_VM_OP_SKIPNZ:
+        return 0;
+    case LED_VM_OP_HUE:
+        return BIT(REG_OUT) | BIT(REG_OUT + 1) | BIT(REG_OUT + 2);
+    case VM_OP_SCALE_RGB:
+        return BIT(o->dst) | BIT(o->dst + 1) | BIT(o->dst + 2);
+    default:
+        return BIT(o->dst);
+    }
+}
+
+static inline struct led_rgb vm_output(const int32_t *reg)
+{
+    return (struct led_rgb){
+        CLAMP(reg[REG_OUT], 0, 255),
+        CLAMP(reg[REG_OUT + 1], 0, 255),
+        CLAMP(reg[REG_OUT + 2], 0, 255)};
+}
+
+/*
+ * Direct-threaded interpreter. Runs the per-frame part on the inputs in
+ * reg, then the per-pixel part for each pixel; an END in it stores the
+ * pixel and starts the next. Called with prog == NULL it only hands out its
+ * label table, which is how the decoder resolves opcodes to handlers.
+ */
+static const void *const *vm_exec(const struct led_vm_program *prog, int32_t *reg,
+                                  struct led_rgb *leds, size_t count)
+{
+    static const void *const labels[VM_OP_COUNT] = {
+        [LED_VM_OP_END] = &&op_end,
+        [LED_VM_OP_LDI] = &&op_ldi,
+        [LED_VM_OP_MOV] = &&op_mov,
+        [LED_VM_OP_ADD] = &&op_add,
+        [LED_VM_OP_SUB] = &&op_sub,
+        [LED_VM_OP_MUL] = &&op_mul,
+        [LED_VM_OP_DIV] = &&op_div,
+        [LED_VM_OP_MOD] = &&op_mod,
+        [LED_VM_OP_AND] = &&op_and,
+        [LED_VM_OP_OR] = &&op_or,
+        [LED_VM_OP_XOR] = &&op_xor,
+        [LED_VM_OP_SHL] = &&op_shl,
+        [LED_VM_OP_SHR] = &&op_shr,
+        [LED_VM_OP_MIN] = &&op_min,
+        [LED_VM_OP_MAX] = &&op_max,
+        [LED_VM_OP_ADDI] = &&op_addi,
+        [LED_VM_OP_MULI] = &&op_muli,
+        [LED_VM_OP_SCALE] = &&op_scale,
+        [LED_VM_OP_SIN] = &&op_sin,
+        [LED_VM_OP_WAVE] = &&op_wave,
+        [LED_VM_OP_HUE] = &&op_hue,
+        [LED_VM_OP_SKIPZ] = &&op_skipz,
+        [LED_VM_OP_SKIPNZ] = &&op_skipnz,
+        [LED_VM_OP_RAD] = &&op_rad,
+        [VM_OP_SCALE_RGB] = &&op_scale_rgb,
+        [VM_OP_MADD] = &&op_madd,
+        [VM_OP_SIN_BAM] = &&op_sin_bam,
+        [VM_OP_WAVE_BAM] = &&op_wave_bam,
+        [VM_OP_FRAME_END] = &&op_frame_end,
+    };
+
+    if (prog == NULL)
+    {
+        return labels;
+    }
+
+    const struct led_vm_insn *ip = prog->code;
+    const struct led_vm_insn *kernel = &prog->code[prog->kernel];
+    int32_t frame_reg[LED_VM_NUM_REGS];
+    size_t i = 0;
+    int32_t a, b;
+
+#define DISPATCH() goto *ip->handler
+#define NEXT()        \
+    do                \
+    {                 \
+        ip++;         \
+        DISPATCH();   \
+    } while (0)
+#define OPERANDS()        \
+    a = reg[ip->lhs];     \
+    b = reg[ip->src]
+
+    DISPATCH();
+
+op_ldi:
+    reg[ip->dst] = ip->imm;
+    NEXT();
+op_mov:
+    reg[ip->dst] = reg[ip->src];
+    NEXT();
+op_add:
+    OPERANDS();
+    reg[ip->dst] = (int32_t)((uint32_t)a + (uint32_t)b);
+    NEXT();
+op_sub:
+    OPERANDS();
+    reg[ip->dst] = (int32_t)((uint32_t)a - (uint32_t)b);
+    NEXT();
+op_mul:
+    OPERANDS();
+    reg[ip->dst] = (int32_t)((uint32_t)a * (uint32_t)b);
+    NEXT();
+op_div:
+    OPERANDS();
+    reg[ip->dst] = (b == 0) ? 0 : (b == -1) ? (int32_t)(0U - (uint32_t)a) : a / b;
+    NEXT();
+op_mod:
+    OPERANDS();
+    reg[ip->dst] = (b == 0 || b == -1) ? 0 : a % b;
+    NEXT();
+op_and:
+    OPERANDS();
+    reg[ip->dst] = a & b;
+    NEXT();
+op_or:
+    OPERANDS();
+    reg[ip->dst] = a | b;
+    NEXT();
+op_xor:
+    OPERANDS();
+    reg[ip->dst] = a ^ b;
+    NEXT();
+op_shl:
+    OPERANDS();
+    reg[ip->dst] = (int32_t)((uint32_t)a << (b & 31));
+    NEXT();
+op_shr:
+    OPERANDS();
+    reg[ip->dst] = (int32_t)((uint32_t)a >> (b & 31));
+    NEXT();
+op_min:
+    OPERANDS();
+    reg[ip->dst] = MIN(a, b);
+    NEXT();
+op_max:
+    OPERANDS();
+    reg[ip->dst] = MAX(a, b);
+    NEXT();
+op_addi:
+    reg[ip->dst] = (int32_t)((uint32_t)reg[ip->lhs] + (uint32_t)ip->imm);
+    NEXT();
+op_muli:
+    reg[ip->dst] = (int32_t)((uint32_t)reg[ip->lhs] * (uint32_t)ip->imm);
+    NEXT();
+op_scale:
+    OPERANDS();
+    reg[ip->dst] = (int32_t)(((int64_t)a * b) / 255);
+    NEXT();
+op_sin:
+    reg[ip->dst] = ksb_sin_q15((uint32_t)reg[ip->src] << 16);
+    NEXT();
+op_wave:
+    reg[ip->dst] = ksb_wave_q16((uint32_t)reg[ip->src] << 16) >> 8;
+    NEXT();
+op_hue:
+{
+    struct led_rgb c = ksb_hue_wheel((uint32_t)reg[ip->src] % 360, 255);
+
+    reg[REG_OUT] = c.r;
+    reg[REG_OUT + 1] = c.g;
+    reg[REG_OUT + 2] = c.b;
+    NEXT();
+}
+op_skipz:
+    if (reg[ip->src] == 0)
+    {
+        ip = &prog->code[ip->imm];
+        DISPATCH();
+    }
+    NEXT();
+op_skipnz:
+    if (reg[ip->src] != 0)
+    {
+        ip = &prog->code[ip->imm];
+        DISPATCH();
+    }
+    NEXT();
+op_scale_rgb:
+    // The factor is read first, it may be one of the registers written
+    b = reg[ip->src];
+    reg[ip->dst] = (int32_t)(((int64_t)reg[ip->lhs] * b) / 255);
+    reg[ip->dst + 1] = (int32_t)(((int64_t)reg[ip->lhs + 1] * b) / 255);
+    reg[ip->dst + 2] = (int32_t)(((int64_t)reg[ip->lhs + 2] * b) / 255);
+    NEXT();
+op_madd:
+    OPERANDS();
+    reg[ip->dst] = (int32_t)((uint32_t)a * (uint32_t)b + (uint32_t)reg[ip->imm]);
+    NEXT();
+op_sin_bam:
+    reg[ip->dst] = ksb_sin_q15(reg[ip->lhs]);
+    NEXT();
+op_wave_bam:
+    reg[ip->dst] = ksb_wave_q16(reg[ip->lhs]) >> 8;
+    NEXT();
+op_rad:
+    reg[ip->dst] = ksb_rad_to_bam((uint32_t)reg[ip->lhs], ip->imm);
+    NEXT();
+op_frame_end:
+    if (prog->kernel_len == 0)
+    {
+        struct led_rgb color = vm_output(reg);
+
+        for (; i < count; i++)
+        {
+            leds[i] = color;
+        }
+        return NULL;
+    }
+    memcpy(frame_reg, reg, sizeof(frame_reg));
+    goto next_pixel;
+op_end:
+    leds[i++] = vm_output(reg);
+next_pixel:
+    if (i == count)
+    {
+        return NULL;
+    }
+    for (uint16_t m = prog->restore; m != 0; m &= m - 1)
+    {
+        reg[__builtin_ctz(m)] = frame_reg[__builtin_ctz(m)];
+    }
+    reg[REG_INDEX] = i;
+    ip = kernel;
+    DISPATCH();
+
+#undef OPERANDS
+#undef NEXT
+#undef DISPATCH
+}
+
+// Read and check the wire format, skip targets become absolute indices
+static int vm_parse(struct vm_op *ops, size_t *count, const uint8_t *bytecode, size_t len)
+{
+    if (len < LED_VM_HEADER_SIZE || bytecode[0] != 'K' || bytecode[1] != 'V' ||
+        bytecode[2] != LED_VM_VERSION || bytecode[3] > LED_VM_MAX_INSNS)
+    {
+        return -EINVAL;
+    }
+
+    size_t n = bytecode[3];
+    size_t pos = LED_VM_HEADER_SIZE;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        struct vm_op *o = &ops[i];
+
+        if (pos + 2 > len || bytecode[pos] >= LED_VM_OP_COUNT)
+        {
+            return -EINVAL;
+        }
+
+        o->op = bytecode[pos];
+        o->dst = bytecode[pos + 1] >> 4;
+        o->src = bytecode[pos + 1] & 0x0F;
+        o->lhs = o->dst;
+        o->imm = 0;
+        pos += 2;
+
+        if (opcode_has_imm(o->op))
+        {
+            if (pos + 2 > len)
+            {
+                return -EINVAL;
+            }
+            o->imm = (int16_t)sys_get_le16(&bytecode[pos]);
+            pos += 2;
+        }
+
+        // Skips are forward only
+        if (opcode_is_skip(o->op))
+        {
+            if (o->imm < 0 || i + 1 + o->imm > n)
+            {
+                return -EINVAL;
+            }
+            o->imm = i + 1 + o->imm;
+        }
+        if (o->op == LED_VM_OP_RAD && o->imm <= 0)
+        {
+            return -EINVAL;
+        }
+    }
+
+    if (pos != len)
+    {
+        return -EINVAL;
+    }
+
+    *count = n;
+    return 0;
+}
+
+static void vm_skip_targets(const struct vm_op *ops, size_t n, bool *target)
+{
+    memset(target, 0, (n + 1) * sizeof(*target));
+    for (size_t i = 0; i < n; i++)
+    {
+        if (opcode_is_skip(ops[i].op))
+        {
+            target[ops[i].imm] = true;
+        }
+    }
+}
+
+// Drop the instructions merged into a neighbour and renumber the skip targets
+static size_t vm_compact(struct vm_op *ops, size_t n, const bool *merged)
+{
+    uint8_t map[LED_VM_MAX_INSNS + 1];
+    size_t out = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        map[i] = out;
+        if (!merged[i])
+        {
+            ops[out++] = ops[i];
+        }
+    }
+    map[n] = out;
+
+    for (size_t i = 0; i < out; i++)
+    {
+        if (opcode_is_skip(ops[i].op))
+        {
+            ops[i].imm = map[ops[i].imm];
+        }
+    }
+    return out;
+}
+
+// Fuse common sequences into fewer instructions, never across a skip target
+static size_t vm_fuse(struct vm_op *ops, size_t n)
+{
+    bool target[LED_VM_MAX_INSNS + 1];
+    bool merged[LED_VM_MAX_INSNS] = {false};
+
+    // "MOV d, s" then "OP d, x" is d = s OP x
+    vm_skip_targets(ops, n, target);
+    for (size_t i = 0; i + 1 < n; i++)
+    {
+        struct vm_op *next = &ops[i + 1];
+
+        if (ops[i].op == LED_VM_OP_MOV && !target[i + 1] && opcode_has_lhs(next->op) &&
+            next->dst == ops[i].dst && next->lhs == next->dst)
+        {
+            next->lhs = ops[i].src;
+            if (next->src == ops[i].dst)
+            {
+                next->src = ops[i].src;
+            }
+            merged[i++] = true;
+        }
+    }
+    n = vm_compact(ops, n, merged);
+
+    // "MUL d, x" then "ADD d, y" as one multiply-add, as for an index to a phase,
+    // "SHR d, 16" then "SIN/WAVE d, d" as SIN/WAVE of a 32-bit angle (both only
+    // use its top 16 bits), and three SCALEs of consecutive registers by one
+    // factor, as for a color. Shift counts are known when loaded with LDI.
+    uint16_t known = 0;
+    int32_t value[LED_VM_NUM_REGS];
+
+    vm_skip_targets(ops, n, target);
+    memset(merged, 0, sizeof(merged));
+    for (size_t i = 0; i + 1 < n; i++)
+    {
+        struct vm_op *o = &ops[i];
+
+        if (target[i])
+        {
+            known = 0;
+        }
+
+        bool madd = o->op == LED_VM_OP_MUL && o[1].op == LED_VM_OP_ADD && !target[i + 1] &&
+                    o[1].dst == o->dst && o[1].lhs == o->dst && o[1].src != o->dst;
+        bool bam = o->op == LED_VM_OP_SHR && (known & BIT(o->src)) &&
+                   (value[o->src] & 31) == 16 && !target[i + 1] &&
+                   (o[1].op == LED_VM_OP_SIN || o[1].op == LED_VM_OP_WAVE) &&
+                   o[1].src == o->dst && o[1].dst == o->dst;
+        bool rgb = i + 2 < n && !target[i + 1] && !target[i + 2] && o->src != o->dst &&
+                   o->src != o->dst + 1;
+
+        for (size_t k = 0; rgb && k < 3; k++)
+        {
+            rgb = o[k].op == LED_VM_OP_SCALE && o[k].dst == o->dst + k &&
+                  o[k].lhs == o->lhs + k && o[k].src == o->src;
+        }
+        if (madd)
+        {
+            o->op = VM_OP_MADD;
+            o->imm = o[1].src;
+            merged[++i] = true;
+        }
+        else if (bam)
+        {
+            o->op = o[1].op == LED_VM_OP_SIN ? VM_OP_SIN_BAM : VM_OP_WAVE_BAM;
+            merged[++i] = true;
+        }
+        else if (rgb)
+        {
+            o->op = VM_OP_SCALE_RGB;
+            merged[i + 1] = true;
+            merged[i + 2] = true;
+            i += 2;
+        }
+
+        known &= ~op_writes(o);
+        if (o->op == LED_VM_OP_LDI)
+        {
+            known |= BIT(o->dst);
+            value[o->dst] = o->imm;
+        }
+    }
+    return vm_compact(ops, n, merged);
+}
+
+/*
+ * Thread the program, moving the instructions that do not depend on the
+ * pixel index into a part run once per frame. An instruction moves if it
+ * reads no register derived from r0 and the per-pixel code before it has
+ * not touched the register it writes. Everything from the first skip on
+ * stays per pixel.
+ */
+static void vm_thread(struct led_vm_program *prog, const struct vm_op *ops, size_t n)
+{
+    const void *const *labels = vm_exec(NULL, NULL, NULL, 0);
+    uint16_t varying = BIT(REG_INDEX);
+    uint16_t touched = BIT(REG_INDEX);
+    bool per_pixel[LED_VM_MAX_INSNS] = {false};
+    bool branched = false;
+    uint16_t written = 0;
+    uint16_t defined = 0;
+    uint16_t live_in = 0;
+    uint8_t map[LED_VM_MAX_INSNS + 1];
+    size_t pos = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint16_t reads = op_reads(&ops[i]);
+        uint16_t writes = op_writes(&ops[i]);
+
+        branched |= opcode_is_skip(ops[i].op) || ops[i].op == LED_VM_OP_END;
+        if (branched || (reads & varying) || (writes & touched))
+        {
+            per_pixel[i] = true;
+            varying |= writes;
+            touched |= reads | writes;
+
+            // Values left by the previous pixel are only seen if read before written,
+            // and a write behind a skip may not happen
+            live_in |= reads & ~defined;
+            written |= writes;
+            if (!branched)
+            {
+                defined |= writes;
+            }
+        }
+    }
+    // The output is read after the last instruction
+    live_in |= (BIT(REG_OUT) | BIT(REG_OUT + 1) | BIT(REG_OUT + 2)) & ~defined;
+    prog->restore = written & live_in & ~BIT(REG_INDEX);
+
+    for (int part = 0; part < 2; part++)
+    {
+        if (part == 1)
+        {
+            prog->code[pos++] = (struct led_vm_insn){.handler = labels[VM_OP_FRAME_END]};
+            prog->kernel = pos;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            if (per_pixel[i] == part)
+            {
+                map[i] = pos;
+                prog->code[pos++] = (struct led_vm_insn){
+                    .handler = labels[ops[i].op],
+                    .imm = ops[i].imm,
+                    .dst = ops[i].dst,
+                    .src = ops[i].src,
+                    .lhs = ops[i].lhs,
+                };
+            }
+        }
+    }
+    map[n] = pos;
+    prog->code[pos] = (struct led_vm_insn){.handler = labels[LED_VM_OP_END]};
+    prog->kernel_len = pos - prog->kernel;
+
+    // Skips and their targets are all per pixel
+    for (size_t i = prog->kernel; i < pos; i++)
+    {
+        if (prog->code[i].handler == labels[LED_VM_OP_SKIPZ] ||
+            prog->code[i].handler == labels[LED_VM_OP_SKIPNZ])
+        {
+            prog->code[i].imm = map[prog->code[i].imm];
+        }
+    }
+}
+
+static int vm_decode(struct led_vm_program *prog, const uint8_t *bytecode, size_t len)
+{
+    struct vm_op ops[LED_VM_MAX_INSNS];
+    size_t n;
+    int ret = vm_parse(ops, &n, bytecode, len);
+
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    vm_thread(prog, ops, vm_fuse(ops, n));
+    prog->len = n;
+    return 0;
+}
+
+int led_vm_load(const uint8_t *bytecode, size_t len)
+{
+    int ret;
+
+    k_mutex_lock(&load_lock, K_FOREVER);
+
+    ret = vm_decode(&staging_program, bytecode, len);
+    if (ret == 0)
+    {
+        k_mutex_lock(&program_lock, K_FOREVER);
+        memcpy(&active_program, &staging_program, sizeof(active_program));
+        program_loaded = true;
+        k_mutex_unlock(&program_lock);
+
+        LOG_INF("Effect program loaded: %d instructions, %d per pixel", staging_program.len,
+                staging_program.kernel_len);
+    }
+    else
+    {
+        LOG_WRN("Rejected effect program (%zu bytes)", len);
+    }
+
+    k_mutex_unlock(&load_lock);
+    return ret;
+}
+
+bool led_vm_is_loaded(void)
+{
+    return program_loaded;
+}
+
+void led_vm_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                   const struct led_layer *layer)
+{
+    int32_t reg[LED_VM_NUM_REGS] = {
+        [REG_COUNT] = count,
+        [REG_FRAME] = frame,
+        [REG_SPEED] = layer->speed,
+        [REG_COLOR] = layer->color.r,
+        [REG_COLOR + 1] = layer->color.g,
+        [REG_COLOR + 2] = layer->color.b,
+    };
+
+    k_mutex_lock(&program_lock, K_FOREVER);
+
+    if (!program_loaded || count == 0)
+    {
+        k_mutex_unlock(&program_lock);
+        memset(leds, 0, count * sizeof(*leds));
+        return;
+    }
+
+    vm_exec(&active_program, reg, leds, count);
+
+    k_mutex_unlock(&program_lock);
+}
@@ -0,0 +1,101 @@
+#ifndef LED_VM_H
+#define LED_VM_H
+
+#include <stddef.h>
+#include "ksb_common.h"
+#include "led_compositor.h"
+
+/*
+ * Effect bytecode VM.
+ *
+ * A program is a per-pixel kernel run once for every LED of the frame on
+ * sixteen 32-bit registers. Before each pixel the inputs are loaded:
+ *
+ *   r0 pixel index     r1 pixel count    r2 frame number   r3 layer speed
+ *   r4-r6 layer color (R, G, B)
+ *   r7-r9 output color (R, G, B), start at 0 and are clamped to 0..255
+ *   r10-r15 scratch, start at 0
+ *
+ * There are no backward jumps, so a kernel runs at most
+ * LED_VM_MAX_INSNS instructions per pixel and frame time is bounded.
+ *
+ * Wire format (little-endian):
+ *   'K' 'V' version insn_count, then per instruction
+ *   opcode, (dst << 4 | src), and an int16 immediate for LDI, ADDI,
+ *   MULI, SKIPZ, SKIPNZ and RAD (imm > 0).
+ *
+ * RAD converts the way the native patterns do (ksb_rad_to_bam()), so a
+ * phase summed in 32-bit binary angles and shifted right by 16 for SIN or
+ * WAVE renders exactly as they do.
+ */
+
+#define LED_VM_VERSION 1
+#define LED_VM_MAX_INSNS 64
+#define LED_VM_NUM_REGS 16
+#define LED_VM_HEADER_SIZE 4
+#define LED_VM_MAX_BYTECODE (LED_VM_HEADER_SIZE + LED_VM_MAX_INSNS * 4)
+
+// VM opcodes
+enum led_vm_opcode
+{
+    LED_VM_OP_END,    // Stop, output r7-r9
+    LED_VM_OP_LDI,    // dst = imm
+    LED_VM_OP_MOV,    // dst = src
+    LED_VM_OP_ADD,    // dst += src
+    LED_VM_OP_SUB,    // dst -= src
+    LED_VM_OP_MUL,    // dst *= src
+    LED_VM_OP_DIV,    // dst /= src (0 if src is 0)
+    LED_VM_OP_MOD,    // dst %= src (0 if src is 0)
+    LED_VM_OP_AND,    // dst &= src
+    LED_VM_OP_OR,     // dst |= src
+    LED_VM_OP_XOR,    // dst ^= src
+    LED_VM_OP_SHL,    // dst <<= src & 31
+    LED_VM_OP_SHR,    // dst >>= src & 31 (logical)
+    LED_VM_OP_MIN,    // dst = min(dst, src)
+    LED_VM_OP_MAX,    // dst = max(dst, src)
+    LED_VM_OP_ADDI,   // dst += imm
+    LED_VM_OP_MULI,   // dst *= imm
+    LED_VM_OP_SCALE,  // dst = dst * src / 255
+    LED_VM_OP_SIN,    // dst = sin(src / 65536 turn) in Q15
+    LED_VM_OP_WAVE,   // dst = (sin(src / 65536 turn) + 1) / 2 in 0..255
+    LED_VM_OP_HUE,    // r7-r9 = hue wheel color at src degrees
+    LED_VM_OP_SKIPZ,  // if src == 0 skip the next imm instructions
+    LED_VM_OP_SKIPNZ, // if src != 0 skip the next imm instructions
+    LED_VM_OP_RAD,    // dst = dst / imm rad as a 32-bit binary angle (2^32 per turn)
+    LED_VM_OP_COUNT
+};
+
+/**
+ * Validate bytecode and make it the active program
+ *
+ * The program is decoded into a direct-threaded form once, here, so the
+ * per-pixel loop does no decoding or bounds checks. A MOV into the register
+ * the next instruction updates is folded into it, common sequences (MUL then
+ * ADD, SHR by 16 then SIN or WAVE, SCALE of r7-r9 by one factor) become one
+ * instruction, and instructions that do not depend on the pixel index (r0)
+ * run once per frame; a program without any renders one color and fills the
+ * strip with it.
+ *
+ * @param bytecode Program in wire format
+ * @param len Length in bytes
+ * @return 0 on success, -EINVAL if the program is malformed
+ */
+int led_vm_load(const uint8_t *bytecode, size_t len);
+
+/**
+ * Check if a program has been loaded
+ * @return true if a program is active
+ */
+bool led_vm_is_loaded(void);
+
+/**
+ * Render one frame with the active program (black if none is loaded)
+ * @param leds Output pixels
+ * @param count Number of pixels
+ * @param frame Frame number
+ * @param layer Layer parameters (speed and color inputs)
+ */
+void led_vm_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                   const struct led_layer *layer);
+
+#endif // LED_VM_H
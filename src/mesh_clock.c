@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "mesh_clock.h"
+
+LOG_MODULE_REGISTER(mesh_clock, CONFIG_LOG_DEFAULT_LEVEL);
+
+// Exchanges the shortest round trip is picked from
+#define CLOCK_FILTER_LEN 8
+// Errors beyond this are stepped, smaller ones slewed
+#define CLOCK_STEP_US 10000
+#define CLOCK_MAX_DRIFT_PPB 500000
+#define PPB 1000000000LL
+
+struct clock_sample
+{
+    int64_t offset;
+    uint32_t delay;
+    uint64_t local;
+};
+
+static struct mesh_clock_context
+{
+    struct k_spinlock lock;
+    // mesh = local + offset + (local - ref) * drift
+    int64_t offset;
+    uint64_t ref;
+    int32_t drift_ppb;
+    struct clock_sample samples[CLOCK_FILTER_LEN];
+    size_t num_samples;
+    size_t next_sample;
+    uint64_t last_used;
+    struct mesh_clock_stats stats;
+} clock_ctx;
+
+static int64_t offset_at(uint64_t local)
+{
+    return clock_ctx.offset + ((int64_t)(local - clock_ctx.ref) * clock_ctx.drift_ppb) / PPB;
+}
+
+void mesh_clock_reset(bool master)
+{
+    k_spinlock_key_t key = k_spin_lock(&clock_ctx.lock);
+    clock_ctx.offset = 0;
+    clock_ctx.ref = mesh_clock_local_us();
+    clock_ctx.drift_ppb = 0;
+    clock_ctx.num_samples = 0;
+    clock_ctx.next_sample = 0;
+    clock_ctx.last_used = 0;
+    clock_ctx.stats = (struct mesh_clock_stats){.synced = master};
+    k_spin_unlock(&clock_ctx.lock, key);
+}
+
+uint64_t mesh_clock_local_us(void)
+{
+    return k_ticks_to_us_near64(k_uptime_ticks());
+}
+
+uint64_t mesh_clock_now_us(void)
+{
+    return mesh_clock_from_local_us(mesh_clock_local_us());
+}
+
+uint32_t mesh_clock_now_ms(void)
+{
+    return mesh_clock_now_us() / USEC_PER_MSEC;
+}
+
+uint64_t mesh_clock_from_local_us(uint64_t local_us)
+{
+    k_spinlock_key_t key = k_spin_lock(&clock_ctx.lock);
+    uint64_t mesh = local_us + offset_at(local_us);
+    k_spin_unlock(&clock_ctx.lock, key);
+
+    return mesh;
+}
+
+bool mesh_clock_is_synced(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&clock_ctx.lock);
+    bool synced = clock_ctx.stats.synced;
+    k_spin_unlock(&clock_ctx.lock, key);
+
+    return synced;
+}
+
+uint64_t mesh_clock_to_local_us(uint64_t mesh_us)
+{
+    k_spinlock_key_t key = k_spin_lock(&clock_ctx.lock);
+    // The offset barely moves over the difference, one refinement is enough
+    uint64_t local = mesh_us - clock_ctx.offset;
+    local = mesh_us - offset_at(local);
+    k_spin_unlock(&clock_ctx.lock, key);
+
+    return local;
+}
+
+void mesh_clock_add_sample(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4)
+{
+    int64_t delay = (int64_t)(t4 - t1) - (int64_t)(t3 - t2);
+    struct clock_sample sample = {
+        .offset = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2,
+        .delay = MAX(delay, 0),
+        .local = t1 + (t4 - t1) / 2,
+    };
+
+    k_spinlock_key_t key = k_spin_lock(&clock_ctx.lock);
+    struct mesh_clock_stats *st = &clock_ctx.stats;
+
+    clock_ctx.samples[clock_ctx.next_sample] = sample;
+    clock_ctx.next_sample = (clock_ctx.next_sample + 1) % CLOCK_FILTER_LEN;
+    clock_ctx.num_samples = MIN(clock_ctx.num_samples + 1, CLOCK_FILTER_LEN);
+
+    // Queueing only ever adds delay, so the fastest exchange is the most accurate
+    const struct clock_sample *best = &clock_ctx.samples[0];
+    for (size_t i = 1; i < clock_ctx.num_samples; i++)
+    {
+        if (clock_ctx.samples[i].delay < best->delay)
+        {
+            best = &clock_ctx.samples[i];
+        }
+    }
+
+    if (best->local <= clock_ctx.last_used)
+    {
+        k_spin_unlock(&clock_ctx.lock, key);
+        return;
+    }
+
+    int64_t error = best->offset - offset_at(best->local);
+
+    if (!st->synced || llabs(error) > CLOCK_STEP_US)
+    {
+        clock_ctx.offset = best->offset;
+        st->steps++;
+        st->synced = true;
+    }
+    else
+    {
+        int64_t dt = best->local - clock_ctx.ref;
+
+        // A quarter of the error goes into the offset now, a slow integral
+        // term into the frequency so a single late exchange barely moves it
+        clock_ctx.offset = offset_at(best->local) + error / 4;
+        if (dt > 0)
+        {
+            clock_ctx.drift_ppb = CLAMP(clock_ctx.drift_ppb + (error * PPB / dt) / 64,
+                                        -CLOCK_MAX_DRIFT_PPB, CLOCK_MAX_DRIFT_PPB);
+        }
+        st->error_avg_us += ((int32_t)llabs(error) - (int32_t)st->error_avg_us) / 16;
+    }
+
+    clock_ctx.ref = best->local;
+    clock_ctx.last_used = best->local;
+
+    st->samples++;
+    st->offset_us = clock_ctx.offset;
+    st->drift_ppb = clock_ctx.drift_ppb;
+    st->error_us = CLAMP(error, INT32_MIN, INT32_MAX);
+    st->delay_us = best->delay;
+    k_spin_unlock(&clock_ctx.lock, key);
+
+    LOG_DBG("Clock offset %lld us, error %lld us, delay %u us, drift %d ppb",
+            best->offset, error, best->delay, clock_ctx.drift_ppb);
+}
+
+void mesh_clock_get_stats(struct mesh_clock_stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&clock_ctx.lock);
+    *stats = clock_ctx.stats;
+    k_spin_unlock(&clock_ctx.lock, key);
+}
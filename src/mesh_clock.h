@@ -0,0 +1,89 @@
+#ifndef MESH_CLOCK_H
+#define MESH_CLOCK_H
+
+#include <zephyr/kernel.h>
+
+/*
+ * Mesh-wide clock: the master's uptime, estimated on clients from
+ * NTP-style request/response exchanges with the master
+ *
+ *   offset = ((t2 - t1) + (t3 - t4)) / 2,  delay = (t4 - t1) - (t3 - t2)
+ *
+ * where t1/t4 are the client's send/receive times and t2/t3 the master's.
+ * Of the last few exchanges the one with the shortest round trip is used,
+ * and the local clock is slewed towards it with a PI loop that also learns
+ * the frequency error, so the estimate holds between exchanges.
+ */
+
+struct mesh_clock_stats
+{
+    bool synced;           // Clock follows the master (always true on the master)
+    uint32_t samples;      // Exchanges used to discipline the clock
+    uint32_t steps;        // Times the clock was stepped rather than slewed
+    int32_t offset_us;     // Mesh clock minus local clock
+    int32_t drift_ppb;     // Local clock frequency error against the master
+    int32_t error_us;      // Last measured offset minus the predicted offset
+    uint32_t error_avg_us; // Smoothed absolute sync error
+    uint32_t delay_us;     // Round trip of the exchange last used
+};
+
+/**
+ * Reset the clock estimate
+ * @param master true if this node is the time source for the mesh
+ */
+void mesh_clock_reset(bool master);
+
+/**
+ * Get the local clock the exchanges are timestamped with
+ * @return Local uptime in microseconds
+ */
+uint64_t mesh_clock_local_us(void);
+
+/**
+ * Get the mesh time, the local clock until the first exchange completes
+ * @return Mesh time in microseconds
+ */
+uint64_t mesh_clock_now_us(void);
+
+/**
+ * Get the mesh time in milliseconds, as carried in mesh commands
+ * @return Mesh time in milliseconds, truncated to 32 bits
+ */
+uint32_t mesh_clock_now_ms(void);
+
+/**
+ * Convert a local clock time to mesh time
+ * @param local_us Local uptime in microseconds (mesh_clock_local_us())
+ * @return Mesh time in microseconds
+ */
+uint64_t mesh_clock_from_local_us(uint64_t local_us);
+
+/**
+ * Check whether the mesh time follows the master
+ * @return true on the master and on clients after their first exchange
+ */
+bool mesh_clock_is_synced(void);
+
+/**
+ * Convert a mesh time to the local clock
+ * @param mesh_us Mesh time in microseconds
+ * @return Local uptime in microseconds
+ */
+uint64_t mesh_clock_to_local_us(uint64_t mesh_us);
+
+/**
+ * Feed a completed exchange with the master
+ * @param t1 Request sent (local clock)
+ * @param t2 Request received (master clock)
+ * @param t3 Response sent (master clock)
+ * @param t4 Response received (local clock)
+ */
+void mesh_clock_add_sample(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4);
+
+/**
+ * Get clock synchronization statistics
+ * @param stats Pointer to store statistics
+ */
+void mesh_clock_get_stats(struct mesh_clock_stats *stats);
+
+#endif // MESH_CLOCK_H
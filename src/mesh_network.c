@@ -1,24 +1,113 @@
 #include <zephyr/kernel.h>
+#include <zephyr/net/net_if.h>
 #include <zephyr/net/socket.h>
 #include <zephyr/net/wifi_mgmt.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/random/random.h>
 #include <zephyr/posix/unistd.h>
+#include <zephyr/posix/poll.h>
+#include <zephyr/posix/sys/eventfd.h>
 #include "ksb_common.h"
+#include "frame_codec.h"
 #include "mesh_network.h"
 #include "led_control.h"
+#include "led_vm.h"
+#include "mesh_clock.h"
+#include "mesh_proto.h"
+#include "nvs_storage.h"
+#include "pixel_stream.h"
 
 LOG_MODULE_REGISTER(mesh_network, CONFIG_LOG_DEFAULT_LEVEL);
 
+BUILD_ASSERT(LED_VM_MAX_BYTECODE <= MESH_PROTO_MAX_PROGRAM,
+             "Effect programs must fit in one mesh message");
+
+// Recent (origin, sequence) pairs remembered to drop repeated datagrams
+#define MESH_SEEN_CACHE 32
+#define MESH_SEEN_KEY(origin, seq) (BIT(24) | ((uint32_t)(origin) << 16) | (seq))
+// Datagrams with this node's ID and one of its last sequence numbers are its own,
+// relayed back by the master
+#define MESH_OWN_SEQ_WINDOW 256
+
+// Broadcasts go out at the basic rate: PHY preamble plus 802.11 MAC and
+// LLC/SNAP, IPv4 and UDP headers around each datagram
+#define MESH_AIR_PREAMBLE_US 192
+#define MESH_AIR_OVERHEAD_BYTES (28 + 8 + 20 + 8)
+
+// Streamed frames go out in spans of this many pixels, one datagram each
+#define MESH_FRAME_SPAN 256
+#define MESH_FRAME_SPANS DIV_ROUND_UP(KSB_LED_MAX_COUNT, MESH_FRAME_SPAN)
+// Least time between two keyframe requests of a node
+#define MESH_KEY_REQUEST_MS 100
+
+BUILD_ASSERT(MESH_FRAME_SPANS <= 32, "Keyframe spans are tracked in a 32-bit mask");
+// Header, TARGET message and FRAME message fields ahead of the pixels
+BUILD_ASSERT(MESH_PROTO_HEADER_SIZE + 4 + 17 + FRAME_CODEC_MAX_SIZE(MESH_FRAME_SPAN) <=
+                 MESH_PROTO_MAX_DATAGRAM,
+             "A frame span must fit in one mesh datagram");
+
 static struct mesh_context
 {
     char network_name[KSB_MAX_NETWORK_NAME_LEN];
     bool is_connected;
     bool is_master;
     int mesh_socket;
+    // Wakes the receive thread out of poll() for shutdown
+    int wake_fd;
+    volatile bool rx_running;
     struct sockaddr_in mesh_addr;
     uint8_t node_id;
     uint8_t master_node_id;
+    struct mesh_rx_stats rx_stats;
+    uint64_t rx_handle_sum_us;
+    uint64_t rx_latency_sum_us;
+    // Send time of the outstanding clock request, to match its response
+    uint64_t sync_t1;
+    atomic_t tx_seq;
+    uint32_t seen[MESH_SEEN_CACHE];
+    size_t seen_next;
+    // Lamport clock, and the (clock, origin) of the pattern shown
+    struct k_spinlock order_lock;
+    uint32_t lamport;
+    uint32_t state_clock;
+    uint8_t state_origin;
+    struct mesh_tx_stats tx_stats;
+    // Zones this node belongs to, and the multicast groups it has joined
+    uint8_t zones;
+    uint8_t joined;
+#ifdef CONFIG_KSB_MESH_FRAMES
+    // Last keyframe sent (master) or the spans of it received (node), and
+    // the pixels of one span encoded or decoded
+    struct led_rgb frame_key[MESH_FRAME_SPANS * MESH_FRAME_SPAN];
+    size_t frame_key_count;
+    uint32_t frame_key_spans;
+    uint8_t frame_key_id;
+    atomic_t frame_key_wanted;
+    uint32_t frames_since_key;
+    // Encoded size of the last delta since the current keyframe, 0 if none
+    size_t frame_delta_len;
+    uint16_t frame_seq;
+    int frame_rx_seq;
+    int64_t key_request_ms;
+    uint64_t frame_codec_cycles;
+    struct mesh_frame_stats frame_stats;
+    uint8_t frame_buf[FRAME_CODEC_MAX_SIZE(MESH_FRAME_SPAN)];
+    struct led_rgb frame_span[MESH_FRAME_SPAN];
+    // Frames handed over by the render thread: it copies into frame_tx[frame_fill]
+    // under frame_lock, frame_work takes that buffer and sends it from the system
+    // work queue, so the render thread never encodes or waits on the socket
+    struct k_mutex frame_lock;
+    struct k_work frame_work;
+    struct led_rgb frame_tx[2][KSB_LED_MAX_COUNT];
+    size_t frame_tx_count;
+    uint8_t frame_tx_zones;
+    uint8_t frame_fill;
+    bool frame_pending;
+#endif
+    struct k_mutex tx_lock;
+    uint8_t tx_buf[MESH_PROTO_MAX_DATAGRAM];
+    uint8_t rx_buf[MESH_PROTO_MAX_DATAGRAM];
+    struct k_work_delayable sync_work;
     struct k_thread rx_thread;
     K_KERNEL_STACK_MEMBER(rx_stack, 2048);
 } mesh_ctx;
@@ -75,39 +164,657 @@ static int wifi_connect(const char *ssid, const char *password)
 }
 
 // Mesh networking
-static void mesh_rx_thread(void *arg1, void *arg2, void *arg3)
+static uint32_t mesh_airtime_us(size_t len)
+{
+    return MESH_AIR_PREAMBLE_US +
+           ((len + MESH_AIR_OVERHEAD_BYTES) * 8 * 1000) / CONFIG_KSB_MESH_TX_RATE_KBPS;
+}
+
+// One zone is reached through its multicast group, several through the broadcast address
+static struct sockaddr_in mesh_zone_addr(uint8_t zones)
+{
+    struct sockaddr_in addr = mesh_ctx.mesh_addr;
+
+    if (IS_ENABLED(CONFIG_KSB_MESH_MULTICAST) && zones != KSB_ZONES_ALL &&
+        IS_POWER_OF_TWO(zones))
+    {
+        addr.sin_addr.s_addr = htonl(KSB_MESH_GROUP_ADDR(find_lsb_set(zones) - 1));
+    }
+    return addr;
+}
+
+// Join the multicast groups of the zones this node receives and leave the others, the
+// relaying master receives every zone
+static void mesh_zones_join(void)
+{
+#ifdef CONFIG_KSB_MESH_MULTICAST
+    uint8_t want = IS_ENABLED(CONFIG_KSB_MESH_MASTER_RELAY) && mesh_ctx.is_master
+                       ? KSB_ZONES_ALL
+                       : mesh_ctx.zones;
+
+    for (int zone = 0; zone < KSB_MAX_ZONES; zone++)
+    {
+        struct ip_mreqn mreq = {.imr_multiaddr.s_addr = htonl(KSB_MESH_GROUP_ADDR(zone))};
+        bool join = want & BIT(zone);
+
+        if (join == !!(mesh_ctx.joined & BIT(zone)))
+        {
+            continue;
+        }
+
+        if (setsockopt(mesh_ctx.mesh_socket, IPPROTO_IP,
+                       join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+        {
+            LOG_WRN("Failed to %s zone %d group: %d", join ? "join" : "leave", zone + 1, errno);
+            continue;
+        }
+        mesh_ctx.joined ^= BIT(zone);
+    }
+#endif
+}
+
+// Encode messages into one datagram on behalf of origin and send it, addressed to the
+// zones in the mask; dst NULL picks the zones' address
+static int mesh_send(const struct mesh_msg *msgs, size_t count, uint8_t origin, uint16_t seq,
+                     uint8_t zones, const struct sockaddr_in *dst)
 {
+    struct sockaddr_in zone_addr = mesh_zone_addr(zones);
+    struct mesh_writer w;
+    bool command = false;
     int ret;
-    struct sockaddr_in src_addr;
-    socklen_t addrlen = sizeof(src_addr);
-    struct ksb_led_command cmd;
 
-    while (mesh_ctx.is_connected)
+    if (dst == NULL)
     {
-        ret = recvfrom(mesh_ctx.mesh_socket, &cmd, sizeof(cmd), 0,
-                       (struct sockaddr *)&src_addr, &addrlen);
+        dst = &zone_addr;
+    }
 
-        if (ret == sizeof(cmd))
+    k_mutex_lock(&mesh_ctx.tx_lock, K_FOREVER);
+    mesh_proto_begin(&w, mesh_ctx.tx_buf, sizeof(mesh_ctx.tx_buf), origin, seq);
+    if (zones != KSB_ZONES_ALL)
+    {
+        struct mesh_msg target = {.type = MESH_MSG_TARGET, .zones = zones};
+
+        mesh_proto_put(&w, &target);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        ret = mesh_proto_put(&w, &msgs[i]);
+        if (ret != 0)
         {
-            LOG_DBG("Received LED command: pattern=%d", cmd.pattern);
+            k_mutex_unlock(&mesh_ctx.tx_lock);
+            return ret;
+        }
+        command |= msgs[i].type == MESH_MSG_PATTERN || msgs[i].type == MESH_MSG_PROGRAM;
+    }
 
-            // Apply LED command locally
-            led_control_set_pattern(cmd.pattern, cmd.color, cmd.brightness, cmd.speed);
+    ret = sendto(mesh_ctx.mesh_socket, w.buf, w.len, 0, (const struct sockaddr *)dst,
+                 sizeof(*dst));
+    if (ret >= 0)
+    {
+        struct mesh_tx_stats *st = &mesh_ctx.tx_stats;
+        uint32_t airtime = mesh_airtime_us(w.len);
 
-            // If we're master, forward to other nodes
-            if (mesh_ctx.is_master)
+        st->datagrams++;
+        st->airtime_us += airtime;
+        if (command)
+        {
+            // Relays cost airtime but the action is the origin's, so the
+            // airtime per action covers the whole command round
+            st->command_airtime_us += airtime;
+            if (origin == mesh_ctx.node_id)
             {
-                mesh_broadcast_led_command(&cmd);
+                st->actions++;
             }
         }
-        else if (ret < 0 && errno != EAGAIN)
+        if (origin != mesh_ctx.node_id)
         {
+            st->relayed++;
+        }
+    }
+    k_mutex_unlock(&mesh_ctx.tx_lock);
+
+    return ret < 0 ? -errno : 0;
+}
+
+// True the first time a datagram from origin with this sequence number is seen
+static bool mesh_seen_first(uint8_t origin, uint16_t seq)
+{
+    uint32_t key = MESH_SEEN_KEY(origin, seq);
+
+    for (size_t i = 0; i < MESH_SEEN_CACHE; i++)
+    {
+        if (mesh_ctx.seen[i] == key)
+        {
+            return false;
+        }
+    }
+
+    mesh_ctx.seen[mesh_ctx.seen_next] = key;
+    mesh_ctx.seen_next = (mesh_ctx.seen_next + 1) % MESH_SEEN_CACHE;
+    return true;
+}
+
+// Last writer wins: take a command only if it is later than the pattern shown,
+// ties between concurrent commands go to the higher node ID
+static bool mesh_order_accept(uint32_t clock, uint8_t origin)
+{
+    k_spinlock_key_t key = k_spin_lock(&mesh_ctx.order_lock);
+    bool later = clock > mesh_ctx.state_clock ||
+                 (clock == mesh_ctx.state_clock && origin > mesh_ctx.state_origin);
+
+    mesh_ctx.lamport = MAX(mesh_ctx.lamport, clock);
+    if (later)
+    {
+        mesh_ctx.state_clock = clock;
+        mesh_ctx.state_origin = origin;
+    }
+    k_spin_unlock(&mesh_ctx.order_lock, key);
+
+    return later;
+}
+
+// Timestamp a command of this node, which becomes the pattern shown
+static uint32_t mesh_order_next(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&mesh_ctx.order_lock);
+    uint32_t clock = ++mesh_ctx.lamport;
+
+    mesh_ctx.state_clock = clock;
+    mesh_ctx.state_origin = mesh_ctx.node_id;
+    k_spin_unlock(&mesh_ctx.order_lock, key);
+
+    return clock;
+}
+
+// Take in the Lamport clock of another node, so commands after rejoining are not stale
+static void mesh_order_observe(uint32_t clock)
+{
+    k_spinlock_key_t key = k_spin_lock(&mesh_ctx.order_lock);
+    mesh_ctx.lamport = MAX(mesh_ctx.lamport, clock);
+    k_spin_unlock(&mesh_ctx.order_lock, key);
+}
+
+// Send messages originating from this node
+static int mesh_send_own(const struct mesh_msg *msgs, size_t count, uint8_t zones,
+                         const struct sockaddr_in *dst)
+{
+    return mesh_send(msgs, count, mesh_ctx.node_id, (uint16_t)atomic_inc(&mesh_ctx.tx_seq),
+                     zones, dst);
+}
+
+// Send time for PATTERN and FRAME messages, 0 while our mesh time is only the local
+// clock, which would give receivers a meaningless latency
+static uint32_t mesh_sent_us(void)
+{
+    return mesh_clock_is_synced() ? MAX((uint32_t)mesh_clock_now_us(), 1) : 0;
+}
+
+// If we're master, forward a command to other nodes on behalf of its origin, once: every
+// node drops the copies it has already seen
+static void mesh_relay(const struct mesh_header *hdr, const struct mesh_msg *msg, uint8_t zones)
+{
+    if (IS_ENABLED(CONFIG_KSB_MESH_MASTER_RELAY) && mesh_ctx.is_master)
+    {
+        mesh_send(msg, 1, hdr->sender, hdr->seq, zones, NULL);
+    }
+}
+
+// Forget the keyframe state of a previous mesh session
+static void mesh_frames_reset(void)
+{
+#ifdef CONFIG_KSB_MESH_FRAMES
+    mesh_ctx.frame_key_count = 0;
+    mesh_ctx.frame_delta_len = 0;
+    mesh_ctx.frame_pending = false;
+    mesh_ctx.frame_key_spans = 0;
+    mesh_ctx.frame_rx_seq = -1;
+    atomic_clear(&mesh_ctx.frame_key_wanted);
+#endif
+}
+
+#ifdef CONFIG_KSB_MESH_FRAMES
+// Ask the master for a keyframe, at most every MESH_KEY_REQUEST_MS while deltas keep
+// arriving without one
+static void mesh_frame_request_key(const struct sockaddr_in *master_addr)
+{
+    int64_t now = k_uptime_get();
+    struct mesh_msg msg = {.type = MESH_MSG_KEY_REQUEST};
+
+    if (now - mesh_ctx.key_request_ms < MESH_KEY_REQUEST_MS)
+    {
+        return;
+    }
+
+    mesh_ctx.key_request_ms = now;
+    if (mesh_send_own(&msg, 1, KSB_ZONES_ALL, master_addr) == 0)
+    {
+        mesh_ctx.frame_stats.key_requests++;
+    }
+}
+
+// Decode a span of a streamed frame into the pixel stream, the frame is shown with its
+// last span
+static void mesh_frame_receive(const struct mesh_msg_frame *f, const struct sockaddr_in *src_addr)
+{
+    struct mesh_frame_stats *st = &mesh_ctx.frame_stats;
+    size_t span = f->first / MESH_FRAME_SPAN;
+    bool key = f->flags & MESH_FRAME_KEY;
+    bool last = f->flags & MESH_FRAME_LAST;
+    struct led_rgb *px;
+    size_t count;
+
+    if (f->first % MESH_FRAME_SPAN != 0 || f->count == 0 || f->count > MESH_FRAME_SPAN)
+    {
+        mesh_ctx.rx_stats.malformed++;
+        return;
+    }
+
+    if (f->seq != mesh_ctx.frame_rx_seq)
+    {
+        uint16_t gap = f->seq - mesh_ctx.frame_rx_seq - 1;
+
+        if (mesh_ctx.frame_rx_seq >= 0 && gap < 0x8000)
+        {
+            st->missed += gap;
+        }
+        mesh_ctx.frame_rx_seq = f->seq;
+    }
+
+    if (span >= MESH_FRAME_SPANS)
+    {
+        // Pixels past the longest strip, only the end of the frame matters
+        if (last && pixel_stream_lock(&count) != NULL)
+        {
+            pixel_stream_unlock(true);
+        }
+        return;
+    }
+
+    if (key && f->key_id != mesh_ctx.frame_key_id)
+    {
+        mesh_ctx.frame_key_id = f->key_id;
+        mesh_ctx.frame_key_spans = 0;
+    }
+    else if (!key && (f->key_id != mesh_ctx.frame_key_id ||
+                      !(mesh_ctx.frame_key_spans & BIT(span))))
+    {
+        st->undecodable++;
+        mesh_frame_request_key(src_addr);
+        return;
+    }
+
+    uint32_t start = k_cycle_get_32();
+    int ret = frame_codec_decode(f->data, f->len, mesh_ctx.frame_span,
+                                 key ? NULL : &mesh_ctx.frame_key[f->first], f->count);
+
+    mesh_ctx.frame_codec_cycles += k_cycle_get_32() - start;
+    if (ret < 0)
+    {
+        mesh_ctx.rx_stats.malformed++;
+        return;
+    }
+
+    if (key)
+    {
+        memcpy(&mesh_ctx.frame_key[f->first], mesh_ctx.frame_span,
+               f->count * sizeof(struct led_rgb));
+        mesh_ctx.frame_key_spans |= BIT(span);
+    }
+
+    px = pixel_stream_lock(&count);
+    if (px == NULL)
+    {
+        return;
+    }
+    if (f->first < count)
+    {
+        memcpy(&px[f->first], mesh_ctx.frame_span,
+               MIN(f->count, count - f->first) * sizeof(struct led_rgb));
+    }
+    pixel_stream_unlock(last);
+
+    st->bytes += f->len;
+    st->raw_bytes += f->count * sizeof(struct led_rgb);
+    if (last)
+    {
+        st->frames++;
+        st->keyframes += key;
+    }
+}
+#endif
+
+static void mesh_handle_message(const struct mesh_header *hdr, struct mesh_msg *msg,
+                                uint8_t zones, uint64_t rx_us, const struct sockaddr_in *src_addr)
+{
+    // Commands for other zones never reach the LEDs, the master only passes them on
+    if ((msg->type == MESH_MSG_PATTERN || msg->type == MESH_MSG_PROGRAM ||
+         msg->type == MESH_MSG_FRAME) &&
+        !(zones & mesh_ctx.zones))
+    {
+        if (msg->type == MESH_MSG_PATTERN)
+        {
+            mesh_order_observe(msg->pattern.clock);
+        }
+        mesh_ctx.rx_stats.rejected++;
+        mesh_relay(hdr, msg, zones);
+        return;
+    }
+
+    switch (msg->type)
+    {
+    case MESH_MSG_PATTERN:
+    {
+        struct ksb_led_command *cmd = &msg->pattern;
+
+        if (!mesh_order_accept(cmd->clock, hdr->sender))
+        {
+            LOG_DBG("Dropped stale LED command from %d", hdr->sender);
+            mesh_ctx.rx_stats.stale++;
+            return;
+        }
+
+        LOG_DBG("Received LED command from %d: pattern=%d", hdr->sender, cmd->pattern);
+
+        // Apply LED command locally, in phase with the sender through the mesh clock
+        led_control_fade_to_pattern(cmd->pattern, cmd->color, cmd->brightness, cmd->speed,
+                                    cmd->seed, cmd->transition_ms, cmd->start_ms);
+        break;
+    }
+    case MESH_MSG_PROGRAM:
+        LOG_DBG("Received effect program from %d: %zu bytes", hdr->sender, msg->program.len);
+        led_control_load_program(msg->program.bytecode, msg->program.len);
+        break;
+    case MESH_MSG_TIME_REQUEST:
+        mesh_order_observe(msg->time.clock);
+        if (mesh_ctx.is_master)
+        {
+            // Answer straight back to the requester, the master's local clock is the mesh clock
+            msg->type = MESH_MSG_TIME_RESPONSE;
+            msg->time.t2 = rx_us;
+            msg->time.t3 = mesh_clock_local_us();
+            msg->time.clock = mesh_ctx.lamport;
+            mesh_send_own(msg, 1, KSB_ZONES_ALL, src_addr);
+        }
+        return;
+    case MESH_MSG_TIME_RESPONSE:
+        mesh_order_observe(msg->time.clock);
+        if (!mesh_ctx.is_master && msg->time.node_id == mesh_ctx.node_id &&
+            msg->time.t1 == mesh_ctx.sync_t1)
+        {
+            mesh_ctx.sync_t1 = 0;
+            mesh_clock_add_sample(msg->time.t1, msg->time.t2, msg->time.t3, rx_us);
+        }
+        return;
+#ifdef CONFIG_KSB_MESH_FRAMES
+    case MESH_MSG_FRAME:
+        if (!mesh_ctx.is_master)
+        {
+            mesh_frame_receive(&msg->frame, src_addr);
+        }
+        return;
+    case MESH_MSG_KEY_REQUEST:
+        if (mesh_ctx.is_master)
+        {
+            // The next frame goes out as a keyframe, however many nodes asked
+            atomic_set(&mesh_ctx.frame_key_wanted, 1);
+            mesh_ctx.frame_stats.key_requests++;
+        }
+        return;
+#endif
+    default:
+        return;
+    }
+
+    mesh_relay(hdr, msg, zones);
+}
+
+// Clients ask the master for its clock, quickly until synced, then at the configured interval
+static void mesh_sync_work_handler(struct k_work *work)
+{
+    struct mesh_clock_stats clock;
+    struct mesh_msg msg = {
+        .type = MESH_MSG_TIME_REQUEST,
+        .time = {.node_id = mesh_ctx.node_id},
+    };
+
+    if (!mesh_ctx.is_connected || mesh_ctx.is_master)
+    {
+        return;
+    }
+
+    msg.time.t1 = mesh_clock_local_us();
+    msg.time.clock = mesh_ctx.lamport;
+    mesh_ctx.sync_t1 = msg.time.t1;
+    int ret = mesh_send_own(&msg, 1, KSB_ZONES_ALL, &mesh_ctx.mesh_addr);
+    if (ret < 0)
+    {
+        LOG_WRN("Failed to send clock request: %d", ret);
+    }
+
+    mesh_clock_get_stats(&clock);
+    k_work_schedule(&mesh_ctx.sync_work,
+                    K_MSEC(clock.samples < 8 ? 250 : CONFIG_KSB_MESH_TIME_SYNC_INTERVAL_MS));
+}
+
+// A datagram with our node ID is our own if it comes from one of our addresses, or from
+// the master's relay with a sequence number we sent recently
+static bool mesh_is_own(const struct sockaddr_in *src_addr, uint16_t seq)
+{
+    uint16_t age = (uint16_t)atomic_get(&mesh_ctx.tx_seq) - seq;
+
+    if (net_if_ipv4_addr_lookup(&src_addr->sin_addr, NULL) != NULL)
+    {
+        return true;
+    }
+    return age != 0 && age <= MESH_OWN_SEQ_WINDOW;
+}
+
+// Node IDs are picked at random, two nodes sharing one would drop each other's commands
+// as echoes and tie in the command order. A node that notices moves to a new random ID.
+static void mesh_node_id_collision(const struct sockaddr_in *src_addr)
+{
+    char addr[NET_IPV4_ADDR_LEN];
+    uint8_t old_id = mesh_ctx.node_id;
+    uint8_t new_id;
+
+    do
+    {
+        new_id = sys_rand32_get() & 0xFF;
+    } while (new_id == old_id);
+
+    mesh_ctx.node_id = new_id;
+    if (mesh_ctx.is_master)
+    {
+        mesh_ctx.master_node_id = new_id;
+    }
+    mesh_ctx.rx_stats.collisions++;
+
+    net_addr_ntop(AF_INET, &src_addr->sin_addr, addr, sizeof(addr));
+    LOG_WRN("Node ID %d is also used by %s, now using %d", old_id, addr, new_id);
+}
+
+// Handle every datagram queued on the socket, ready is when poll() reported it readable
+static int mesh_rx_drain(uint32_t ready)
+{
+    struct mesh_rx_stats *st = &mesh_ctx.rx_stats;
+    uint32_t batch = 0;
+
+    while (true)
+    {
+        struct sockaddr_in src_addr;
+        socklen_t addrlen = sizeof(src_addr);
+        struct mesh_reader r;
+        struct mesh_msg msg;
+        uint8_t zones = KSB_ZONES_ALL;
+        uint32_t sent_us = 0;
+
+        int ret = recvfrom(mesh_ctx.mesh_socket, mesh_ctx.rx_buf, sizeof(mesh_ctx.rx_buf),
+                           MSG_DONTWAIT, (struct sockaddr *)&src_addr, &addrlen);
+        uint64_t rx_us = mesh_clock_local_us();
+
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
             LOG_ERR("Mesh receive error: %d", errno);
+            return -errno;
+        }
+
+        batch++;
+        st->airtime_us += mesh_airtime_us(ret);
+        if (mesh_proto_open(&r, mesh_ctx.rx_buf, ret) != 0)
+        {
+            st->dropped++;
+            continue;
+        }
+
+        // Our own broadcasts come back, and relayed commands arrive more than once. Another
+        // node sending with our ID is not an echo: move to a new ID and take its datagram
+        if (r.header.sender == mesh_ctx.node_id)
+        {
+            if (mesh_is_own(&src_addr, r.header.seq))
+            {
+                st->echoes++;
+                continue;
+            }
+            mesh_node_id_collision(&src_addr);
+        }
+        if (!mesh_seen_first(r.header.sender, r.header.seq))
+        {
+            st->duplicates++;
+            continue;
+        }
+
+        while ((ret = mesh_proto_next(&r, &msg)) > 0)
+        {
+            if (msg.type == MESH_MSG_TARGET)
+            {
+                zones = msg.zones;
+                continue;
+            }
+            if (msg.type == MESH_MSG_PATTERN)
+            {
+                sent_us = msg.pattern.sent_us;
+            }
+            else if (msg.type == MESH_MSG_FRAME)
+            {
+                sent_us = msg.frame.sent_us;
+            }
+            mesh_handle_message(&r.header, &msg, zones, rx_us, &src_addr);
+        }
+        if (ret < 0)
+        {
+            st->malformed++;
+        }
+
+        // Socket readable to datagram handled, including datagrams queued ahead of it.
+        // Time in flight and in the IP stack before poll() returns is not included.
+        uint32_t handle_us = k_cyc_to_us_near32(k_cycle_get_32() - ready);
+
+        st->datagrams++;
+        st->handle_us = handle_us;
+        st->handle_max_us = MAX(st->handle_max_us, handle_us);
+        mesh_ctx.rx_handle_sum_us += handle_us;
+        st->handle_avg_us = mesh_ctx.rx_handle_sum_us / st->datagrams;
+
+        // Origin sent to received, both in mesh time, so it spans the origin's stack, the
+        // air, a relay hop if any and the wait in the socket, give or take the sync error
+        if (sent_us != 0 && mesh_clock_is_synced())
+        {
+            int32_t latency_us = (uint32_t)mesh_clock_from_local_us(rx_us) - sent_us;
+
+            st->latency_us = MAX(latency_us, 0);
+            st->latency_max_us = MAX(st->latency_max_us, st->latency_us);
+            st->latency_count++;
+            mesh_ctx.rx_latency_sum_us += st->latency_us;
+            st->latency_avg_us = mesh_ctx.rx_latency_sum_us / st->latency_count;
+        }
+    }
+
+    st->max_batch = MAX(st->max_batch, batch);
+    return 0;
+}
+
+static void mesh_rx_thread(void *arg1, void *arg2, void *arg3)
+{
+    struct pollfd fds[] = {
+        {.fd = mesh_ctx.mesh_socket, .events = POLLIN},
+        {.fd = mesh_ctx.wake_fd, .events = POLLIN},
+    };
+
+    while (mesh_ctx.rx_running)
+    {
+        int ret = poll(fds, ARRAY_SIZE(fds), -1);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERR("Mesh poll error: %d", errno);
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            eventfd_t value;
+
+            eventfd_read(mesh_ctx.wake_fd, &value);
+            continue;
+        }
+
+        if (fds[0].revents & (POLLERR | POLLNVAL))
+        {
+            LOG_ERR("Mesh socket error");
             break;
         }
 
-        k_msleep(10);
+        if (fds[0].revents & POLLIN)
+        {
+            mesh_ctx.rx_stats.wakeups++;
+            if (mesh_rx_drain(k_cycle_get_32()) != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    LOG_DBG("Mesh receive thread stopped");
+}
+
+static int mesh_rx_start(void)
+{
+    mesh_ctx.wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (mesh_ctx.wake_fd < 0)
+    {
+        LOG_ERR("Failed to create mesh wakeup eventfd");
+        return -errno;
     }
+
+    mesh_ctx.rx_running = true;
+    k_thread_create(&mesh_ctx.rx_thread, mesh_ctx.rx_stack,
+                    K_KERNEL_STACK_SIZEOF(mesh_ctx.rx_stack),
+                    mesh_rx_thread, NULL, NULL, NULL,
+                    6, 0, K_NO_WAIT);
+    k_thread_name_set(&mesh_ctx.rx_thread, "mesh_rx");
+    return 0;
+}
+
+static void mesh_rx_stop(void)
+{
+    if (!mesh_ctx.rx_running)
+    {
+        return;
+    }
+
+    mesh_ctx.rx_running = false;
+    eventfd_write(mesh_ctx.wake_fd, 1);
+    k_thread_join(&mesh_ctx.rx_thread, K_FOREVER);
+
+    close(mesh_ctx.wake_fd);
+    mesh_ctx.wake_fd = -1;
 }
 
 int mesh_network_init(const char *network_name)
@@ -118,6 +825,21 @@ int mesh_network_init(const char *network_name)
     mesh_ctx.is_connected = false;
     mesh_ctx.is_master = false;
     mesh_ctx.node_id = g_ksb_ctx.config.device_id;
+    mesh_ctx.mesh_socket = -1;
+    mesh_ctx.wake_fd = -1;
+    k_work_init_delayable(&mesh_ctx.sync_work, mesh_sync_work_handler);
+    k_mutex_init(&mesh_ctx.tx_lock);
+#ifdef CONFIG_KSB_MESH_FRAMES
+    k_work_init(&mesh_ctx.frame_work, mesh_frame_work_handler);
+    k_mutex_init(&mesh_ctx.frame_lock);
+#endif
+    // Sequence numbers from before a reboot may still be in other nodes' caches
+    atomic_set(&mesh_ctx.tx_seq, sys_rand32_get());
+
+    if (nvs_storage_load_zones(&mesh_ctx.zones) != 0 || mesh_ctx.zones == 0)
+    {
+        mesh_ctx.zones = KSB_ZONES_ALL;
+    }
 
     // Initialize WiFi callbacks
     k_sem_init(&wifi_connected, 0, 1);
@@ -194,13 +916,22 @@ int mesh_network_join(void)
 
     mesh_ctx.is_connected = true;
     mesh_ctx.is_master = false;
+    mesh_zones_join();
+    mesh_frames_reset();
 
     // Start receive thread
-    k_thread_create(&mesh_ctx.rx_thread, mesh_ctx.rx_stack,
-                    K_KERNEL_STACK_SIZEOF(mesh_ctx.rx_stack),
-                    mesh_rx_thread, NULL, NULL, NULL,
-                    6, 0, K_NO_WAIT);
-    k_thread_name_set(&mesh_ctx.rx_thread, "mesh_rx");
+    ret = mesh_rx_start();
+    if (ret < 0)
+    {
+        close(mesh_ctx.mesh_socket);
+        mesh_ctx.mesh_socket = -1;
+        mesh_ctx.is_connected = false;
+        return ret;
+    }
+
+    // Follow the master's clock
+    mesh_clock_reset(false);
+    k_work_schedule(&mesh_ctx.sync_work, K_NO_WAIT);
 
     LOG_INF("Joined mesh network successfully");
     return 0;
@@ -277,14 +1008,20 @@ int mesh_network_create(void)
 
     mesh_ctx.is_connected = true;
     mesh_ctx.is_master = true;
+    mesh_zones_join();
+    mesh_frames_reset();
+    mesh_clock_reset(true);
     mesh_ctx.master_node_id = mesh_ctx.node_id;
 
     // Start receive thread
-    k_thread_create(&mesh_ctx.rx_thread, mesh_ctx.rx_stack,
-                    K_KERNEL_STACK_SIZEOF(mesh_ctx.rx_stack),
-                    mesh_rx_thread, NULL, NULL, NULL,
-                    6, 0, K_NO_WAIT);
-    k_thread_name_set(&mesh_ctx.rx_thread, "mesh_rx");
+    ret = mesh_rx_start();
+    if (ret < 0)
+    {
+        close(mesh_ctx.mesh_socket);
+        mesh_ctx.mesh_socket = -1;
+        mesh_ctx.is_connected = false;
+        return ret;
+    }
 
     LOG_INF("Created mesh network successfully: %s", ap_ssid);
     return 0;
@@ -295,27 +1032,236 @@ bool mesh_network_is_connected(void)
     return mesh_ctx.is_connected;
 }
 
-int mesh_broadcast_led_command(struct ksb_led_command *cmd)
+int mesh_broadcast_led_command(struct ksb_led_command *cmd, uint8_t zones)
 {
     if (!mesh_ctx.is_connected)
     {
         return -ENOTCONN;
     }
+    if (zones == 0)
+    {
+        return -EINVAL;
+    }
 
-    int ret = sendto(mesh_ctx.mesh_socket, cmd, sizeof(*cmd), 0,
-                     (struct sockaddr *)&mesh_ctx.mesh_addr,
-                     sizeof(mesh_ctx.mesh_addr));
+    cmd->clock = mesh_order_next();
+    cmd->sent_us = mesh_sent_us();
+
+    struct mesh_msg msg = {.type = MESH_MSG_PATTERN, .pattern = *cmd};
+    int ret = mesh_send_own(&msg, 1, zones, NULL);
 
     if (ret < 0)
     {
-        LOG_ERR("Failed to broadcast LED command: %d", errno);
-        return -errno;
+        LOG_ERR("Failed to broadcast LED command: %d", ret);
+        return ret;
     }
 
     LOG_DBG("Broadcasted LED command: pattern=%d", cmd->pattern);
     return 0;
 }
 
+int mesh_broadcast_program(const uint8_t *bytecode, size_t len, uint8_t zones)
+{
+    if (!mesh_ctx.is_connected)
+    {
+        return -ENOTCONN;
+    }
+    if (zones == 0)
+    {
+        return -EINVAL;
+    }
+
+    struct mesh_msg msg = {
+        .type = MESH_MSG_PROGRAM,
+        .program = {.bytecode = bytecode, .len = len},
+    };
+    int ret = mesh_send_own(&msg, 1, zones, NULL);
+
+    if (ret < 0)
+    {
+        LOG_ERR("Failed to broadcast effect program: %d", ret);
+        return ret;
+    }
+
+    LOG_DBG("Broadcasted effect program: %zu bytes", len);
+    return 0;
+}
+
+#ifdef CONFIG_KSB_MESH_FRAMES
+// Encode a frame and send it span by span, from the frame work item
+static int mesh_frame_send(const struct led_rgb *frame, size_t count, uint8_t zones)
+{
+    struct mesh_frame_stats *st = &mesh_ctx.frame_stats;
+
+    if (!mesh_ctx.is_connected)
+    {
+        return -ENOTCONN;
+    }
+
+    // Deltas are coded against the last keyframe; a new one goes out when a node asks
+    // for it, at the configured interval, or once the last delta shows the frames have
+    // drifted so far from it that deltas save little. The size of a keyframe says
+    // nothing about that, so it is not taken into account.
+    bool key = atomic_clear(&mesh_ctx.frame_key_wanted) || count != mesh_ctx.frame_key_count ||
+               mesh_ctx.frames_since_key >= CONFIG_KSB_MESH_FRAME_KEY_INTERVAL ||
+               2 * mesh_ctx.frame_delta_len > count * sizeof(struct led_rgb);
+    uint16_t seq = mesh_ctx.frame_seq++;
+    size_t total = 0;
+
+    if (key)
+    {
+        memcpy(mesh_ctx.frame_key, frame, count * sizeof(struct led_rgb));
+        mesh_ctx.frame_key_count = count;
+        mesh_ctx.frame_key_id++;
+        mesh_ctx.frames_since_key = 0;
+    }
+
+    for (size_t first = 0; first < count; first += MESH_FRAME_SPAN)
+    {
+        size_t n = MIN(count - first, MESH_FRAME_SPAN);
+        uint32_t start = k_cycle_get_32();
+        int len = frame_codec_encode(mesh_ctx.frame_buf, sizeof(mesh_ctx.frame_buf),
+                                     &frame[first], key ? NULL : &mesh_ctx.frame_key[first], n);
+
+        mesh_ctx.frame_codec_cycles += k_cycle_get_32() - start;
+        if (len < 0)
+        {
+            return len;
+        }
+
+        struct mesh_msg msg = {
+            .type = MESH_MSG_FRAME,
+            .frame = {
+                .flags = (key ? MESH_FRAME_KEY : 0) | (first + n == count ? MESH_FRAME_LAST : 0),
+                .key_id = mesh_ctx.frame_key_id,
+                .seq = seq,
+                .sent_us = mesh_sent_us(),
+                .first = first,
+                .count = n,
+                .data = mesh_ctx.frame_buf,
+                .len = len,
+            },
+        };
+        int ret = mesh_send_own(&msg, 1, zones, NULL);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        total += len;
+    }
+
+    mesh_ctx.frames_since_key++;
+    mesh_ctx.frame_delta_len = key ? 0 : total;
+    st->frames++;
+    st->keyframes += key;
+    st->bytes += total;
+    st->raw_bytes += count * sizeof(struct led_rgb);
+    return 0;
+}
+
+static void mesh_frame_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&mesh_ctx.frame_lock, K_FOREVER);
+    if (!mesh_ctx.frame_pending)
+    {
+        k_mutex_unlock(&mesh_ctx.frame_lock);
+        return;
+    }
+
+    // Take the filled buffer, the next frame goes into the other one
+    const struct led_rgb *frame = mesh_ctx.frame_tx[mesh_ctx.frame_fill];
+    size_t count = mesh_ctx.frame_tx_count;
+    uint8_t zones = mesh_ctx.frame_tx_zones;
+
+    mesh_ctx.frame_fill ^= 1;
+    mesh_ctx.frame_pending = false;
+    k_mutex_unlock(&mesh_ctx.frame_lock);
+
+    int ret = mesh_frame_send(frame, count, zones);
+    if (ret < 0)
+    {
+        LOG_WRN("Failed to broadcast frame: %d", ret);
+    }
+}
+
+int mesh_broadcast_frame(const struct led_rgb *frame, size_t count, uint8_t zones)
+{
+    if (!mesh_ctx.is_connected)
+    {
+        return -ENOTCONN;
+    }
+    if (!mesh_ctx.is_master)
+    {
+        return -EPERM;
+    }
+    if (zones == 0 || count == 0)
+    {
+        return -EINVAL;
+    }
+
+    count = MIN(count, KSB_LED_MAX_COUNT);
+
+    // A frame still waiting to be sent is replaced, the nodes only need the latest
+    k_mutex_lock(&mesh_ctx.frame_lock, K_FOREVER);
+    if (mesh_ctx.frame_pending)
+    {
+        mesh_ctx.frame_stats.replaced++;
+    }
+    memcpy(mesh_ctx.frame_tx[mesh_ctx.frame_fill], frame, count * sizeof(struct led_rgb));
+    mesh_ctx.frame_tx_count = count;
+    mesh_ctx.frame_tx_zones = zones;
+    mesh_ctx.frame_pending = true;
+    k_mutex_unlock(&mesh_ctx.frame_lock);
+
+    k_work_submit(&mesh_ctx.frame_work);
+    return 0;
+}
+
+void mesh_network_get_frame_stats(struct mesh_frame_stats *stats)
+{
+    *stats = mesh_ctx.frame_stats;
+    stats->size_pct = stats->raw_bytes ? stats->bytes * 100 / stats->raw_bytes : 0;
+    stats->codec_us =
+        stats->frames ? k_cyc_to_us_near64(mesh_ctx.frame_codec_cycles) / stats->frames : 0;
+}
+#endif
+
+int mesh_network_set_zones(uint8_t zones)
+{
+    if (zones == 0)
+    {
+        return -EINVAL;
+    }
+
+    mesh_ctx.zones = zones;
+    if (mesh_ctx.is_connected)
+    {
+        mesh_zones_join();
+    }
+
+    LOG_INF("Node zones set to 0x%02x", zones);
+    return nvs_storage_save_zones(zones);
+}
+
+uint8_t mesh_network_get_zones(void)
+{
+    return mesh_ctx.zones;
+}
+
+void mesh_network_get_rx_stats(struct mesh_rx_stats *stats)
+{
+    *stats = mesh_ctx.rx_stats;
+}
+
+void mesh_network_get_tx_stats(struct mesh_tx_stats *stats)
+{
+    k_mutex_lock(&mesh_ctx.tx_lock, K_FOREVER);
+    *stats = mesh_ctx.tx_stats;
+    k_mutex_unlock(&mesh_ctx.tx_lock);
+
+    stats->airtime_per_action_us =
+        stats->actions ? stats->command_airtime_us / stats->actions : 0;
+}
+
 void mesh_network_process(void)
 {
     // Process any pending mesh operations
@@ -334,15 +1280,22 @@ void mesh_network_reset(void)
 
     mesh_ctx.is_connected = false;
 
+    // Stop the receive thread and clock requests before their socket goes away
+    struct k_work_sync sync;
+
+    k_work_cancel_delayable_sync(&mesh_ctx.sync_work, &sync);
+#ifdef CONFIG_KSB_MESH_FRAMES
+    k_work_cancel_sync(&mesh_ctx.frame_work, &sync);
+#endif
+    mesh_rx_stop();
+
     if (mesh_ctx.mesh_socket >= 0)
     {
         close(mesh_ctx.mesh_socket);
         mesh_ctx.mesh_socket = -1;
+        mesh_ctx.joined = 0;
     }
 
-    // Terminate receive thread
-    k_thread_abort(&mesh_ctx.rx_thread);
-
     // Disconnect WiFi
     struct net_if *iface = net_if_get_default();
     if (mesh_ctx.is_master)
@@ -3,6 +3,52 @@
 
 #include "ksb_common.h"
 
+struct mesh_rx_stats
+{
+    uint32_t datagrams;      // Mesh datagrams received
+    uint32_t dropped;        // Datagrams that were not mesh protocol or of another version
+    uint32_t malformed;      // Datagrams cut short by a malformed message
+    uint32_t echoes;         // Own broadcasts received back
+    uint32_t collisions;     // Datagrams from another node with this node's ID
+    uint32_t duplicates;     // Datagrams already received (relayed copies)
+    uint32_t stale;          // Commands older than the pattern shown
+    uint32_t rejected;       // Commands for zones this node is not in
+    uint64_t airtime_us;     // Estimated airtime of the datagrams received
+    uint32_t wakeups;        // Times the receive thread woke up with data
+    uint32_t max_batch;      // Most datagrams handled in one wakeup
+    uint32_t handle_us;      // Last socket readable to datagram handled time, not end to end
+    uint32_t handle_avg_us;  // Mean socket readable to handled time
+    uint32_t handle_max_us;  // Worst socket readable to handled time
+    uint32_t latency_us;     // Last origin sent to received time, in mesh time
+    uint32_t latency_avg_us; // Mean origin sent to received time
+    uint32_t latency_max_us; // Worst origin sent to received time
+    uint32_t latency_count;  // Datagrams the latency was measured on
+};
+
+struct mesh_tx_stats
+{
+    uint32_t datagrams;              // Datagrams sent
+    uint32_t relayed;                // Commands forwarded for other nodes
+    uint64_t airtime_us;             // Estimated airtime of everything sent
+    uint64_t command_airtime_us;     // Estimated airtime of commands sent and relayed
+    uint32_t actions;                // Commands this node originated
+    uint32_t airtime_per_action_us;  // Command airtime, relays included, per action
+};
+
+struct mesh_frame_stats
+{
+    uint32_t frames;       // Frames sent (master) or shown (node)
+    uint32_t keyframes;    // Keyframes among them
+    uint32_t key_requests; // Keyframe requests received (master) or sent (node)
+    uint32_t missed;       // Frames missing from the sequence numbers
+    uint32_t undecodable;  // Delta spans that arrived without their keyframe
+    uint32_t replaced;     // Frames replaced by a newer one before they were sent (master)
+    uint64_t bytes;        // Encoded pixel bytes
+    uint64_t raw_bytes;    // The same pixels as RGB
+    uint32_t size_pct;     // Encoded size in percent of RGB
+    uint32_t codec_us;     // Mean encode (master) or decode (node) time per frame
+};
+
 /**
  * Initialize mesh networking subsystem
  * @param network_name Name of the mesh network
@@ -36,11 +82,65 @@ int mesh_network_create(void);
 bool mesh_network_is_connected(void);
 
 /**
- * Broadcast LED command to all mesh nodes
- * @param cmd LED command to broadcast
+ * Set the zones this node belongs to and save them to NVS
+ * @param zones Zone mask, bit n for zone n + 1
+ * @return 0 on success, -EINVAL for an empty mask, negative error code on failure
+ */
+int mesh_network_set_zones(uint8_t zones);
+
+/**
+ * Get the zones this node belongs to
+ * @return Zone mask, KSB_ZONES_ALL unless set
+ */
+uint8_t mesh_network_get_zones(void);
+
+/**
+ * Send LED command to the mesh nodes of some zones
+ * @param cmd LED command to broadcast, its Lamport clock is filled in
+ * @param zones Target zone mask, KSB_ZONES_ALL for every node
  * @return 0 on success, negative error code on failure
  */
-int mesh_broadcast_led_command(struct ksb_led_command *cmd);
+int mesh_broadcast_led_command(struct ksb_led_command *cmd, uint8_t zones);
+
+/**
+ * Get mesh receive path statistics
+ * @param stats Pointer to store statistics
+ */
+void mesh_network_get_rx_stats(struct mesh_rx_stats *stats);
+
+/**
+ * Get mesh transmit statistics, airtime is estimated at CONFIG_KSB_MESH_TX_RATE_KBPS
+ * @param stats Pointer to store statistics
+ */
+void mesh_network_get_tx_stats(struct mesh_tx_stats *stats);
+
+/**
+ * Send an effect program (see led_vm.h) to the mesh nodes of some zones
+ * @param bytecode Program bytecode
+ * @param len Program length, at most MESH_PROTO_MAX_PROGRAM
+ * @param zones Target zone mask, KSB_ZONES_ALL for every node
+ * @return 0 on success, negative error code on failure
+ */
+int mesh_broadcast_program(const uint8_t *bytecode, size_t len, uint8_t zones);
+
+/**
+ * Queue a streamed frame for the mesh nodes of some zones, delta coded
+ * against the last keyframe (see frame_codec.h); only the master sends
+ * frames. The frame is copied and encoded and sent from the system work
+ * queue, a frame still waiting there is replaced.
+ * @param frame Pixels
+ * @param count Number of pixels
+ * @param zones Target zone mask, KSB_ZONES_ALL for every node
+ * @return 0 if queued, -EPERM if this node is not the master,
+ *         negative error code on failure
+ */
+int mesh_broadcast_frame(const struct led_rgb *frame, size_t count, uint8_t zones);
+
+/**
+ * Get streamed frame statistics (compression, keyframes, codec time)
+ * @param stats Pointer to store statistics
+ */
+void mesh_network_get_frame_stats(struct mesh_frame_stats *stats);
 
 /**
  * Process mesh network operations (called periodically)
@@ -0,0 +1,327 @@
+#include <errno.h>
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+#include "mesh_proto.h"
+
+#define TIME_REQUEST_SIZE 9
+#define TIME_RESPONSE_SIZE 25
+#define PATTERN_FIXED_SIZE 13
+#define PATTERN_SENT_SIZE 4
+#define FRAME_FIXED_SIZE 8
+
+static size_t varint_size(uint32_t value)
+{
+    size_t n = 1;
+
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+// Reads a varint of at most 32 bits from [*p, end), false if truncated or too long
+static bool get_varint(const uint8_t **p, const uint8_t *end, uint32_t *value)
+{
+    uint32_t v = 0;
+
+    for (int shift = 0; shift < 35 && *p < end; shift += 7)
+    {
+        uint8_t b = *(*p)++;
+
+        if (shift == 28 && (b & 0x70))
+        {
+            return false;
+        }
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int payload_size(const struct mesh_msg *msg)
+{
+    switch (msg->type)
+    {
+    case MESH_MSG_PATTERN:
+        return PATTERN_FIXED_SIZE + varint_size(msg->pattern.speed) +
+               varint_size(msg->pattern.transition_ms) + varint_size(msg->pattern.clock) +
+               PATTERN_SENT_SIZE;
+    case MESH_MSG_TIME_REQUEST:
+        return TIME_REQUEST_SIZE + varint_size(msg->time.clock);
+    case MESH_MSG_TIME_RESPONSE:
+        return TIME_RESPONSE_SIZE + varint_size(msg->time.clock);
+    case MESH_MSG_PROGRAM:
+        return msg->program.len <= MESH_PROTO_MAX_PROGRAM ? (int)msg->program.len : -EINVAL;
+    case MESH_MSG_TARGET:
+        return varint_size(msg->zones);
+    case MESH_MSG_FRAME:
+        return FRAME_FIXED_SIZE + varint_size(msg->frame.first) + varint_size(msg->frame.count) +
+               msg->frame.len;
+    case MESH_MSG_KEY_REQUEST:
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+int mesh_proto_begin(struct mesh_writer *w, uint8_t *buf, size_t size, uint8_t sender,
+                     uint16_t seq)
+{
+    if (size < MESH_PROTO_HEADER_SIZE)
+    {
+        return -ENOSPC;
+    }
+
+    buf[0] = MESH_PROTO_MAGIC;
+    buf[1] = MESH_PROTO_VERSION;
+    buf[2] = sender;
+    sys_put_le16(seq, &buf[3]);
+
+    w->buf = buf;
+    w->size = size;
+    w->len = MESH_PROTO_HEADER_SIZE;
+    return 0;
+}
+
+int mesh_proto_put(struct mesh_writer *w, const struct mesh_msg *msg)
+{
+    int len = payload_size(msg);
+
+    if (len < 0)
+    {
+        return len;
+    }
+    if (w->len + 1 + varint_size(len) + len > w->size)
+    {
+        return -ENOSPC;
+    }
+
+    uint8_t *p = w->buf + w->len;
+
+    *p++ = msg->type;
+    p = put_varint(p, len);
+
+    switch (msg->type)
+    {
+    case MESH_MSG_PATTERN:
+        *p++ = msg->pattern.pattern;
+        *p++ = msg->pattern.color.r;
+        *p++ = msg->pattern.color.g;
+        *p++ = msg->pattern.color.b;
+        *p++ = msg->pattern.brightness;
+        p = put_varint(p, msg->pattern.speed);
+        p = put_varint(p, msg->pattern.transition_ms);
+        sys_put_le32(msg->pattern.seed, p);
+        sys_put_le32(msg->pattern.start_ms, p + 4);
+        p = put_varint(p + 8, msg->pattern.clock);
+        sys_put_le32(msg->pattern.sent_us, p);
+        p += PATTERN_SENT_SIZE;
+        break;
+    case MESH_MSG_TIME_RESPONSE:
+        sys_put_le64(msg->time.t2, p + 9);
+        sys_put_le64(msg->time.t3, p + 17);
+        p[0] = msg->time.node_id;
+        sys_put_le64(msg->time.t1, p + 1);
+        p = put_varint(p + TIME_RESPONSE_SIZE, msg->time.clock);
+        break;
+    case MESH_MSG_TIME_REQUEST:
+        p[0] = msg->time.node_id;
+        sys_put_le64(msg->time.t1, p + 1);
+        p = put_varint(p + TIME_REQUEST_SIZE, msg->time.clock);
+        break;
+    case MESH_MSG_PROGRAM:
+        memcpy(p, msg->program.bytecode, len);
+        p += len;
+        break;
+    case MESH_MSG_TARGET:
+        p = put_varint(p, msg->zones);
+        break;
+    case MESH_MSG_FRAME:
+        p[0] = msg->frame.flags;
+        p[1] = msg->frame.key_id;
+        sys_put_le16(msg->frame.seq, p + 2);
+        sys_put_le32(msg->frame.sent_us, p + 4);
+        p = put_varint(p + FRAME_FIXED_SIZE, msg->frame.first);
+        p = put_varint(p, msg->frame.count);
+        memcpy(p, msg->frame.data, msg->frame.len);
+        p += msg->frame.len;
+        break;
+    case MESH_MSG_KEY_REQUEST:
+        break;
+    }
+
+    w->len = p - w->buf;
+    return 0;
+}
+
+int mesh_proto_open(struct mesh_reader *r, const uint8_t *buf, size_t len)
+{
+    if (len < MESH_PROTO_HEADER_SIZE || buf[0] != MESH_PROTO_MAGIC)
+    {
+        return -EBADMSG;
+    }
+    if (buf[1] != MESH_PROTO_VERSION)
+    {
+        return -EPROTONOSUPPORT;
+    }
+
+    r->buf = buf;
+    r->len = len;
+    r->pos = MESH_PROTO_HEADER_SIZE;
+    r->header = (struct mesh_header){
+        .version = buf[1],
+        .sender = buf[2],
+        .seq = sys_get_le16(&buf[3]),
+    };
+    return 0;
+}
+
+static bool decode_pattern(const uint8_t *p, const uint8_t *end, struct ksb_led_command *cmd)
+{
+    uint32_t speed;
+    uint32_t transition_ms;
+
+    if (end - p < PATTERN_FIXED_SIZE)
+    {
+        return false;
+    }
+
+    *cmd = (struct ksb_led_command){
+        .pattern = p[0],
+        .color = {.r = p[1], .g = p[2], .b = p[3]},
+        .brightness = p[4],
+    };
+    p += 5;
+
+    if (!get_varint(&p, end, &speed) || !get_varint(&p, end, &transition_ms) || end - p < 8)
+    {
+        return false;
+    }
+
+    cmd->speed = speed;
+    cmd->transition_ms = MIN(transition_ms, UINT16_MAX);
+    cmd->seed = sys_get_le32(p);
+    cmd->start_ms = sys_get_le32(p + 4);
+    p += 8;
+    if (p == end)
+    {
+        return true;
+    }
+    if (!get_varint(&p, end, &cmd->clock))
+    {
+        return false;
+    }
+    if (end - p >= PATTERN_SENT_SIZE)
+    {
+        cmd->sent_us = sys_get_le32(p);
+        return true;
+    }
+    return p == end;
+}
+
+int mesh_proto_next(struct mesh_reader *r, struct mesh_msg *msg)
+{
+    while (r->pos < r->len)
+    {
+        const uint8_t *p = r->buf + r->pos;
+        const uint8_t *end = r->buf + r->len;
+        uint8_t type = *p++;
+        uint32_t len;
+
+        if (!get_varint(&p, end, &len) || len > (size_t)(end - p))
+        {
+            r->pos = r->len;
+            return -EBADMSG;
+        }
+
+        const uint8_t *payload = p;
+
+        r->pos = (payload + len) - r->buf;
+        end = payload + len;
+        msg->type = type;
+
+        switch (type)
+        {
+        case MESH_MSG_PATTERN:
+            if (!decode_pattern(payload, end, &msg->pattern))
+            {
+                return -EBADMSG;
+            }
+            return 1;
+        case MESH_MSG_TIME_REQUEST:
+        case MESH_MSG_TIME_RESPONSE:
+            if (len < (type == MESH_MSG_TIME_REQUEST ? TIME_REQUEST_SIZE : TIME_RESPONSE_SIZE))
+            {
+                return -EBADMSG;
+            }
+            msg->time = (struct mesh_msg_time){
+                .node_id = payload[0],
+                .t1 = sys_get_le64(payload + 1),
+            };
+            p = payload + TIME_REQUEST_SIZE;
+            if (type == MESH_MSG_TIME_RESPONSE)
+            {
+                msg->time.t2 = sys_get_le64(payload + 9);
+                msg->time.t3 = sys_get_le64(payload + 17);
+                p = payload + TIME_RESPONSE_SIZE;
+            }
+            if (p < end && !get_varint(&p, end, &msg->time.clock))
+            {
+                return -EBADMSG;
+            }
+            return 1;
+        case MESH_MSG_PROGRAM:
+            if (len > MESH_PROTO_MAX_PROGRAM)
+            {
+                return -EBADMSG;
+            }
+            msg->program = (struct mesh_msg_program){.bytecode = payload, .len = len};
+            return 1;
+        case MESH_MSG_TARGET:
+            p = payload;
+            if (!get_varint(&p, end, &msg->zones))
+            {
+                return -EBADMSG;
+            }
+            return 1;
+        case MESH_MSG_FRAME:
+            p = payload + FRAME_FIXED_SIZE;
+            if (len < FRAME_FIXED_SIZE || !get_varint(&p, end, &msg->frame.first) ||
+                !get_varint(&p, end, &msg->frame.count))
+            {
+                return -EBADMSG;
+            }
+            msg->frame.flags = payload[0];
+            msg->frame.key_id = payload[1];
+            msg->frame.seq = sys_get_le16(payload + 2);
+            msg->frame.sent_us = sys_get_le32(payload + 4);
+            msg->frame.data = p;
+            msg->frame.len = end - p;
+            return 1;
+        case MESH_MSG_KEY_REQUEST:
+            return 1;
+        default:
+            // Newer message type, skip it
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+#ifndef MESH_PROTO_H
+#define MESH_PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ksb_common.h"
+
+/*
+ * Mesh wire protocol.
+ *
+ * A datagram is a header followed by one or more messages, all fields
+ * little-endian:
+ *
+ *   header   'K' version, u8 sender node ID, u16 sequence number
+ *   message  u8 type, varint payload length, payload
+ *
+ * Varints are unsigned LEB128 (7 bits per byte, low bits first). Receivers
+ * skip messages of unknown types by their length, so new types can be added
+ * without a version bump; likewise trailing fields may be missing (read as
+ * 0) or followed by fields added later. Payloads:
+ *
+ *   PATTERN        u8 pattern, u8 R, G, B, u8 brightness, varint speed,
+ *                  varint transition_ms, u32 seed, u32 start_ms,
+ *                  varint Lamport clock, u32 sent_us
+ *   TIME_REQUEST   u8 node ID, u64 t1, varint Lamport clock
+ *   TIME_RESPONSE  u8 node ID, u64 t1, u64 t2, u64 t3, varint Lamport clock
+ *   PROGRAM        effect bytecode (see led_vm.h), up to
+ *                  MESH_PROTO_MAX_PROGRAM bytes
+ *   TARGET         varint zone mask
+ *   FRAME          u8 flags, u8 keyframe ID, u16 frame sequence number,
+ *                  u32 sent_us, varint first pixel, varint pixel count,
+ *                  encoded pixels (see frame_codec.h)
+ *   KEY_REQUEST    empty
+ *
+ * A TARGET message addresses the messages after it in the datagram to the
+ * nodes in any of its zones; without one a datagram is for every node.
+ *
+ * A FRAME carries a span of the pixels of one streamed frame, either a
+ * keyframe or a delta against the keyframe with its ID. A node that lacks
+ * the keyframe for a delta sends the master a KEY_REQUEST.
+ *
+ * sent_us is the mesh time (see mesh_clock.h) in microseconds, truncated to
+ * 32 bits, at which the origin sent the command or frame, and 0 if the
+ * origin's clock did not follow the master yet. Relays pass it on unchanged,
+ * so receivers measure the latency from the origin.
+ *
+ * The codec only works on caller buffers and makes no kernel calls.
+ */
+
+#define MESH_PROTO_MAGIC 'K'
+#define MESH_PROTO_VERSION 1
+#define MESH_PROTO_HEADER_SIZE 5
+#define MESH_PROTO_MAX_DATAGRAM 1024
+#define MESH_PROTO_MAX_PROGRAM 260
+
+enum mesh_msg_type
+{
+    MESH_MSG_PATTERN = 1,
+    MESH_MSG_TIME_REQUEST,
+    MESH_MSG_TIME_RESPONSE,
+    MESH_MSG_PROGRAM,
+    MESH_MSG_TARGET,
+    MESH_MSG_FRAME,
+    MESH_MSG_KEY_REQUEST,
+};
+
+// Frame flags
+#define MESH_FRAME_KEY BIT(0)  // Keyframe, otherwise a delta against the keyframe
+#define MESH_FRAME_LAST BIT(1) // Last span of the frame, show it
+
+struct mesh_header
+{
+    uint8_t version;
+    uint8_t sender;
+    uint16_t seq;
+};
+
+// Mesh clock exchange, see mesh_clock.h
+struct mesh_msg_time
+{
+    uint8_t node_id; // Requesting node
+    uint64_t t1;     // Request sent, client clock
+    uint64_t t2;     // Request received, master clock
+    uint64_t t3;     // Response sent, master clock
+    uint32_t clock;  // Sender's Lamport clock
+};
+
+// Effect program, points into the datagram it was decoded from
+struct mesh_msg_program
+{
+    const uint8_t *bytecode;
+    size_t len;
+};
+
+// Span of a streamed frame, the data points into the datagram it was decoded from
+struct mesh_msg_frame
+{
+    uint8_t flags;
+    uint8_t key_id;
+    uint16_t seq;
+    uint32_t sent_us; // Origin's mesh time at sending, 0 if unknown
+    uint32_t first;
+    uint32_t count;
+    const uint8_t *data;
+    size_t len;
+};
+
+struct mesh_msg
+{
+    enum mesh_msg_type type;
+    union
+    {
+        struct ksb_led_command pattern;
+        struct mesh_msg_time time;
+        struct mesh_msg_program program;
+        struct mesh_msg_frame frame;
+        uint32_t zones;
+    };
+};
+
+struct mesh_writer
+{
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+};
+
+struct mesh_reader
+{
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    struct mesh_header header;
+};
+
+/**
+ * Start a datagram
+ * @param w Writer
+ * @param buf Output buffer
+ * @param size Buffer size
+ * @param sender Sending node ID
+ * @param seq Sequence number
+ * @return 0 on success, -ENOSPC if the buffer cannot hold the header
+ */
+int mesh_proto_begin(struct mesh_writer *w, uint8_t *buf, size_t size, uint8_t sender,
+                     uint16_t seq);
+
+/**
+ * Append a message to the datagram, the datagram is w->len bytes long
+ * @param w Writer
+ * @param msg Message to append
+ * @return 0 on success, -ENOSPC if it does not fit (the datagram is left
+ *         as it was), -EINVAL for an unknown type or oversized program
+ */
+int mesh_proto_put(struct mesh_writer *w, const struct mesh_msg *msg);
+
+/**
+ * Open a received datagram and check its header
+ * @param r Reader, r->header holds the header on success
+ * @param buf Datagram
+ * @param len Datagram length
+ * @return 0 on success, -EBADMSG if it is not a mesh datagram,
+ *         -EPROTONOSUPPORT for another protocol version
+ */
+int mesh_proto_open(struct mesh_reader *r, const uint8_t *buf, size_t len);
+
+/**
+ * Decode the next message, skipping types this node does not know
+ * @param r Reader
+ * @param msg Decoded message
+ * @return 1 if a message was decoded, 0 at the end of the datagram,
+ *         -EBADMSG if the rest of the datagram is malformed
+ */
+int mesh_proto_next(struct mesh_reader *r, struct mesh_msg *msg);
+
+#endif // MESH_PROTO_H
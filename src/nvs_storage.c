@@ -10,6 +10,8 @@ LOG_MODULE_REGISTER(nvs_storage, CONFIG_LOG_DEFAULT_LEVEL);
 
 #define NVS_PARTITION_ID FIXED_PARTITION_ID(storage_partition)
 #define NVS_CONFIG_KEY 1
+#define NVS_PROGRAM_KEY 2
+#define NVS_ZONES_KEY 3
 
 static struct nvs_fs nvs;
 
@@ -124,4 +126,59 @@ int nvs_storage_clear_config(void)
 
     LOG_INF("Configuration cleared from NVS");
     return 0;
-}
\ No newline at end of file
+}
+
+int nvs_storage_save_program(const uint8_t *program, size_t len)
+{
+    int ret = nvs_write(&nvs, NVS_PROGRAM_KEY, program, len);
+    if (ret < 0)
+    {
+        LOG_ERR("Failed to save effect program: %d", ret);
+        return ret;
+    }
+
+    LOG_INF("Effect program saved to NVS (%zu bytes)", len);
+    return 0;
+}
+
+int nvs_storage_load_program(uint8_t *program, size_t max_len)
+{
+    int ret = nvs_read(&nvs, NVS_PROGRAM_KEY, program, max_len);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    // nvs_read reports the stored length even if it did not fit
+    if (ret > max_len)
+    {
+        LOG_WRN("Stored effect program too large: %d bytes", ret);
+        return -ENOMEM;
+    }
+
+    return ret;
+}
+
+int nvs_storage_save_zones(uint8_t zones)
+{
+    int ret = nvs_write(&nvs, NVS_ZONES_KEY, &zones, sizeof(zones));
+    if (ret < 0)
+    {
+        LOG_ERR("Failed to save zones: %d", ret);
+        return ret;
+    }
+
+    LOG_INF("Zones saved to NVS: 0x%02x", zones);
+    return 0;
+}
+
+int nvs_storage_load_zones(uint8_t *zones)
+{
+    int ret = nvs_read(&nvs, NVS_ZONES_KEY, zones, sizeof(*zones));
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    return ret == sizeof(*zones) ? 0 : -EINVAL;
+}
@@ -29,4 +29,34 @@ int nvs_storage_load_config(struct ksb_network_config *config);
  */
 int nvs_storage_clear_config(void);
 
+/**
+ * Save an effect program to NVS
+ * @param program Program bytecode
+ * @param len Length in bytes
+ * @return 0 on success, negative error code on failure
+ */
+int nvs_storage_save_program(const uint8_t *program, size_t len);
+
+/**
+ * Load the effect program from NVS
+ * @param program Buffer to store the bytecode
+ * @param max_len Size of the buffer
+ * @return Length of the program on success, negative error code on failure
+ */
+int nvs_storage_load_program(uint8_t *program, size_t max_len);
+
+/**
+ * Save the zones this node belongs to
+ * @param zones Zone mask
+ * @return 0 on success, negative error code on failure
+ */
+int nvs_storage_save_zones(uint8_t zones);
+
+/**
+ * Load the zones this node belongs to
+ * @param zones Pointer to store the zone mask
+ * @return 0 on success, negative error code if none are stored
+ */
+int nvs_storage_load_zones(uint8_t *zones);
+
 #endif // NVS_STORAGE_H
\ No newline at end of file
@@ -0,0 +1,11 @@
+#include "led_pattern.h"
+#include "led_anim.h"
+
+// Plays the animation stored in the user data partition
+static void animation_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                             const struct led_layer *layer, void *state)
+{
+    led_anim_render(leds, count, frame, layer);
+}
+
+LED_PATTERN_DEFINE(animation, KSB_PATTERN_ANIMATION, 0, NULL, animation_render, false);
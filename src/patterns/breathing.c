@@ -0,0 +1,17 @@
+#include "led_pattern.h"
+#include "led_math.h"
+
+static void breathing_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                             const struct led_layer *layer, void *state)
+{
+    // Sine wave breathing effect, phase advances speed/1000 rad per frame
+    uint16_t breath = ksb_wave_q16(ksb_rad_to_bam(frame * layer->speed, 1000));
+    struct led_rgb color = ksb_scale_rgb(layer->color, breath >> 8);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        leds[i] = color;
+    }
+}
+
+LED_PATTERN_DEFINE(breathing, KSB_PATTERN_BREATHING, 0, NULL, breathing_render, false);
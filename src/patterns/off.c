@@ -0,0 +1,13 @@
+#include "led_pattern.h"
+
+static void off_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                       const struct led_layer *layer, void *state)
+{
+    struct led_rgb black = {0, 0, 0};
+    for (size_t i = 0; i < count; i++)
+    {
+        leds[i] = black;
+    }
+}
+
+LED_PATTERN_DEFINE(off, KSB_PATTERN_OFF, 0, NULL, off_render, true);
@@ -0,0 +1,45 @@
+#include "led_pattern.h"
+#include "led_math.h"
+
+struct rainbow_state
+{
+    // Hue offset between pixels is 360 / count, stepped exactly without a divide
+    uint16_t hue_step;
+    uint16_t hue_rem;
+};
+
+static void rainbow_activate(void *state, const struct led_layer *layer, size_t count)
+{
+    struct rainbow_state *st = state;
+
+    st->hue_step = 360 / count;
+    st->hue_rem = 360 % count;
+}
+
+static void rainbow_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                           const struct led_layer *layer, void *state)
+{
+    const struct rainbow_state *st = state;
+    uint32_t hue = (frame * layer->speed / 10) % 360;
+    uint32_t rem = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        leds[i] = ksb_hue_wheel(hue, 255);
+
+        hue += st->hue_step;
+        rem += st->hue_rem;
+        if (rem >= count)
+        {
+            rem -= count;
+            hue++;
+        }
+        if (hue >= 360)
+        {
+            hue -= 360;
+        }
+    }
+}
+
+LED_PATTERN_DEFINE(rainbow, KSB_PATTERN_RAINBOW, sizeof(struct rainbow_state),
+                   rainbow_activate, rainbow_render, false);
@@ -0,0 +1,40 @@
+#include "led_pattern.h"
+
+struct running_light_state
+{
+    struct led_rgb trail;
+};
+
+static void running_light_activate(void *state, const struct led_layer *layer, size_t count)
+{
+    struct running_light_state *st = state;
+
+    st->trail = (struct led_rgb){
+        layer->color.r / 3,
+        layer->color.g / 3,
+        layer->color.b / 3};
+}
+
+static void running_light_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                                 const struct led_layer *layer, void *state)
+{
+    const struct running_light_state *st = state;
+
+    // Clear all LEDs
+    struct led_rgb black = {0, 0, 0};
+    for (size_t i = 0; i < count; i++)
+    {
+        leds[i] = black;
+    }
+
+    // Calculate position
+    int pos = (frame * layer->speed / 100) % count;
+    leds[pos] = layer->color;
+
+    // Add trail
+    int trail_pos = (pos - 1 + count) % count;
+    leds[trail_pos] = st->trail;
+}
+
+LED_PATTERN_DEFINE(running_light, KSB_PATTERN_RUNNING_LIGHT, sizeof(struct running_light_state),
+                   running_light_activate, running_light_render, false);
@@ -0,0 +1,11 @@
+#include "led_pattern.h"
+#include "led_vm.h"
+
+// Runs the effect program loaded into the bytecode VM
+static void script_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                          const struct led_layer *layer, void *state)
+{
+    led_vm_render(leds, count, frame, layer);
+}
+
+LED_PATTERN_DEFINE(script, KSB_PATTERN_SCRIPT, 0, NULL, script_render, false);
@@ -0,0 +1,12 @@
+#include "led_pattern.h"
+
+static void solid_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                         const struct led_layer *layer, void *state)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        leds[i] = layer->color;
+    }
+}
+
+LED_PATTERN_DEFINE(solid, KSB_PATTERN_SOLID, 0, NULL, solid_render, true);
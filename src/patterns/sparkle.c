@@ -0,0 +1,50 @@
+#include "led_math.h"
+#include "led_pattern.h"
+
+// One spark per this many pixels, so density does not depend on strip length
+#define SPARKLE_PIXELS_PER_SPARK 16
+
+struct sparkle_state
+{
+    struct led_rgb dim;
+    uint32_t period;
+    uint32_t sparks;
+};
+
+static void sparkle_activate(void *state, const struct led_layer *layer, size_t count)
+{
+    struct sparkle_state *st = state;
+
+    st->dim = (struct led_rgb){
+        layer->color.r / 10,
+        layer->color.g / 10,
+        layer->color.b / 10};
+    st->period = layer->speed < 200 ? 200 - layer->speed : 1;
+    st->sparks = DIV_ROUND_UP(count, SPARKLE_PIXELS_PER_SPARK);
+}
+
+static void sparkle_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                           const struct led_layer *layer, void *state)
+{
+    const struct sparkle_state *st = state;
+
+    // Start with dim background
+    for (size_t i = 0; i < count; i++)
+    {
+        leds[i] = st->dim;
+    }
+
+    // Add sparkles, positions depend only on the seed and frame so every node agrees
+    if ((frame % st->period) == 0)
+    {
+        uint32_t key = ksb_rand32(layer->seed, frame);
+
+        for (uint32_t i = 0; i < st->sparks; i++)
+        {
+            leds[ksb_rand_range(ksb_rand32(key, i), count)] = layer->color;
+        }
+    }
+}
+
+LED_PATTERN_DEFINE(sparkle, KSB_PATTERN_SPARKLE, sizeof(struct sparkle_state),
+                   sparkle_activate, sparkle_render, false);
@@ -0,0 +1,33 @@
+#include "led_pattern.h"
+#include "led_math.h"
+
+struct wave_state
+{
+    uint32_t step;
+};
+
+static void wave_activate(void *state, const struct led_layer *layer, size_t count)
+{
+    struct wave_state *st = state;
+
+    // Half a sine period spread across the strip
+    st->step = KSB_BAM_HALF_TURN / count;
+}
+
+static void wave_render(struct led_rgb *leds, size_t count, uint32_t frame,
+                        const struct led_layer *layer, void *state)
+{
+    const struct wave_state *st = state;
+    // Phase advances speed/100 rad per frame
+    uint32_t phase = ksb_rad_to_bam(frame * layer->speed, 100);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint16_t wave = ksb_wave_q16(phase + i * st->step);
+
+        leds[i] = ksb_scale_rgb(layer->color, wave >> 8);
+    }
+}
+
+LED_PATTERN_DEFINE(wave, KSB_PATTERN_WAVE, sizeof(struct wave_state),
+                   wave_activate, wave_render, false);
@@ -0,0 +1,458 @@
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/posix/unistd.h>
+#include <zephyr/posix/poll.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+#include "ksb_common.h"
+#include "pixel_stream.h"
+
+LOG_MODULE_REGISTER(pixel_stream, CONFIG_LOG_DEFAULT_LEVEL);
+
+BUILD_ASSERT(sizeof(struct led_rgb) == 3, "Stream payloads are received straight into RGB pixels");
+
+// DDP: 10 byte header, 4 more with a timecode
+#define DDP_HEADER_SIZE 10
+#define DDP_TIMECODE_SIZE 4
+#define DDP_VERSION_MASK 0xC0
+#define DDP_VERSION_1 0x40
+#define DDP_FLAG_TIMECODE BIT(4)
+#define DDP_FLAG_QUERY BIT(1)
+#define DDP_FLAG_PUSH BIT(0)
+#define DDP_TYPE_RGB24 0x0B
+#define DDP_ID_DISPLAY 1
+
+// E1.31: root, framing and DMP layers ahead of the DMX start code and data
+#define E131_DATA_OFFSET 126
+#define E131_SYNC_SIZE 49
+#define E131_VECTOR_ROOT_DATA 0x00000004
+#define E131_VECTOR_ROOT_EXTENDED 0x00000008
+#define E131_VECTOR_DATA_PACKET 0x00000002
+#define E131_VECTOR_EXTENDED_SYNC 0x00000001
+#define E131_VECTOR_DMP_SET_PROPERTY 0x02
+#define E131_OPT_PREVIEW BIT(7)
+#define E131_OPT_TERMINATED BIT(6)
+#define E131_MAX_UNIVERSES DIV_ROUND_UP(KSB_LED_MAX_COUNT, PIXEL_STREAM_E131_PIXELS)
+#define E131_GROUP_ADDR(universe) (0xEFFF0000U | (universe)) // 239.255.<hi>.<lo>
+
+static const uint8_t e131_acn_id[12] = "ASC-E1.17\0\0";
+
+static struct pixel_stream_context
+{
+    size_t led_count;
+    void (*frame_ready)(void);
+    int ddp_socket;
+    int e131_socket;
+    // Held while a receiver writes into the write buffer
+    struct k_mutex rx_lock;
+    // Triple buffer: write is received into, ready is the latest complete
+    // frame, read is the one the render thread shows
+    struct k_spinlock lock;
+    struct led_rgb buffers[3][KSB_LED_MAX_COUNT];
+    uint8_t write;
+    uint8_t ready;
+    uint8_t read;
+    bool fresh;
+    int64_t last_frame_ms;
+    bool pending;
+    // Last sequence numbers, -1 before the first packet
+    int ddp_seq;
+    int e131_seq[E131_MAX_UNIVERSES];
+    uint16_t e131_sync;
+    uint32_t fps_frames;
+    int64_t fps_start_ms;
+    struct pixel_stream_stats stats;
+    struct k_thread thread;
+    K_KERNEL_STACK_MEMBER(stack, 2048);
+} stream_ctx = {
+    .ddp_socket = -1,
+    .e131_socket = -1,
+    .write = 0,
+    .ready = 1,
+    .read = 2,
+};
+
+// Hand the frame received so far to the render thread
+static void stream_publish(void)
+{
+    int64_t now = k_uptime_get();
+
+    k_spinlock_key_t key = k_spin_lock(&stream_ctx.lock);
+    uint8_t done = stream_ctx.write;
+
+    stream_ctx.write = stream_ctx.ready;
+    stream_ctx.ready = done;
+    stream_ctx.fresh = true;
+    stream_ctx.last_frame_ms = now;
+    k_spin_unlock(&stream_ctx.lock, key);
+
+    // Pixels the next frame does not send carry over; the frame just done is
+    // only ever read by the render thread, so it can be copied without the lock
+    memcpy(stream_ctx.buffers[stream_ctx.write], stream_ctx.buffers[done],
+           stream_ctx.led_count * sizeof(struct led_rgb));
+    stream_ctx.pending = false;
+
+    stream_ctx.stats.frames++;
+    stream_ctx.fps_frames++;
+    if (now - stream_ctx.fps_start_ms >= MSEC_PER_SEC)
+    {
+        stream_ctx.stats.fps = stream_ctx.fps_frames;
+        stream_ctx.fps_frames = 0;
+        stream_ctx.fps_start_ms = now;
+    }
+
+    stream_ctx.frame_ready();
+}
+
+// Drop the datagram at the head of the socket
+static void stream_discard(int sock)
+{
+    uint8_t byte;
+
+    recv(sock, &byte, sizeof(byte), MSG_DONTWAIT);
+}
+
+// Receive the datagram at the head of the socket: header into hdr, payload
+// straight into the write buffer at offset, anything past len is dropped
+static int stream_receive(int sock, uint8_t *hdr, size_t hdr_len, size_t offset, size_t len)
+{
+    struct iovec iov[] = {
+        {.iov_base = hdr, .iov_len = hdr_len},
+        {.iov_base = (uint8_t *)stream_ctx.buffers[stream_ctx.write] + offset, .iov_len = len},
+    };
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = ARRAY_SIZE(iov)};
+
+    int ret = recvmsg(sock, &msg, MSG_DONTWAIT);
+    if (ret < 0)
+    {
+        return -errno;
+    }
+
+    stream_ctx.pending = true;
+    stream_ctx.stats.packets++;
+    return ret;
+}
+
+// Count packets skipped between the last sequence number and seq, both below modulus
+static void stream_sequence(int *last, uint32_t seq, uint32_t modulus)
+{
+    if (*last >= 0)
+    {
+        uint32_t gap = (seq + modulus - *last - 1) % modulus;
+
+        // A step back is a reordered packet or a restarted sender, not loss
+        if (gap < modulus / 2)
+        {
+            stream_ctx.stats.lost += gap;
+        }
+    }
+    *last = seq;
+}
+
+static void ddp_handle(int sock)
+{
+    uint8_t hdr[DDP_HEADER_SIZE + DDP_TIMECODE_SIZE];
+    size_t fb_len = stream_ctx.led_count * sizeof(struct led_rgb);
+
+    int ret = recv(sock, hdr, sizeof(hdr), MSG_PEEK | MSG_DONTWAIT);
+    if (ret < DDP_HEADER_SIZE || (hdr[0] & DDP_VERSION_MASK) != DDP_VERSION_1 ||
+        (hdr[0] & DDP_FLAG_QUERY) || hdr[3] != DDP_ID_DISPLAY ||
+        (hdr[2] != 0 && hdr[2] != 1 && hdr[2] != DDP_TYPE_RGB24))
+    {
+        stream_discard(sock);
+        stream_ctx.stats.dropped++;
+        return;
+    }
+
+    size_t hdr_len = DDP_HEADER_SIZE + (hdr[0] & DDP_FLAG_TIMECODE ? DDP_TIMECODE_SIZE : 0);
+    uint32_t offset = sys_get_be32(&hdr[4]);
+    uint16_t len = sys_get_be16(&hdr[8]);
+
+    if (offset >= fb_len)
+    {
+        // Data for pixels past the strip, a push may still complete the frame
+        if (len > 0)
+        {
+            stream_ctx.stats.dropped++;
+        }
+        offset = 0;
+        len = 0;
+    }
+
+    ret = stream_receive(sock, hdr, hdr_len, offset, MIN(len, fb_len - offset));
+    if (ret < 0)
+    {
+        return;
+    }
+
+    // Sequence numbers run 1-15, 0 when the sender does not use them
+    if (hdr[1] & 0x0F)
+    {
+        stream_sequence(&stream_ctx.ddp_seq, (hdr[1] & 0x0F) - 1, 15);
+    }
+
+    if (hdr[0] & DDP_FLAG_PUSH)
+    {
+        stream_publish();
+    }
+}
+
+#ifdef CONFIG_NET_IPV4_IGMP
+static void e131_join(int sock, uint16_t universe)
+{
+    struct ip_mreqn mreq = {.imr_multiaddr.s_addr = htonl(E131_GROUP_ADDR(universe))};
+
+    if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+    {
+        LOG_WRN("Failed to join universe %d: %d", universe, errno);
+    }
+}
+#endif
+
+static void e131_handle(int sock)
+{
+    uint8_t hdr[E131_DATA_OFFSET];
+    size_t universes = DIV_ROUND_UP(stream_ctx.led_count, PIXEL_STREAM_E131_PIXELS);
+
+    int ret = recv(sock, hdr, sizeof(hdr), MSG_PEEK | MSG_DONTWAIT);
+    if (ret < E131_SYNC_SIZE || memcmp(&hdr[4], e131_acn_id, sizeof(e131_acn_id)) != 0)
+    {
+        stream_discard(sock);
+        stream_ctx.stats.dropped++;
+        return;
+    }
+
+    uint32_t root_vector = sys_get_be32(&hdr[18]);
+    uint32_t framing_vector = sys_get_be32(&hdr[40]);
+
+    if (root_vector == E131_VECTOR_ROOT_EXTENDED && framing_vector == E131_VECTOR_EXTENDED_SYNC)
+    {
+        stream_discard(sock);
+        if (stream_ctx.pending && stream_ctx.e131_sync != 0 &&
+            sys_get_be16(&hdr[45]) == stream_ctx.e131_sync)
+        {
+            stream_publish();
+        }
+        return;
+    }
+
+    if (ret < E131_DATA_OFFSET || root_vector != E131_VECTOR_ROOT_DATA ||
+        framing_vector != E131_VECTOR_DATA_PACKET || hdr[117] != E131_VECTOR_DMP_SET_PROPERTY ||
+        hdr[125] != 0 || (hdr[112] & E131_OPT_PREVIEW))
+    {
+        stream_discard(sock);
+        stream_ctx.stats.dropped++;
+        return;
+    }
+
+    uint16_t universe = sys_get_be16(&hdr[113]);
+    size_t index = universe - CONFIG_KSB_PIXEL_STREAM_E131_UNIVERSE;
+
+    if (universe < CONFIG_KSB_PIXEL_STREAM_E131_UNIVERSE || index >= universes)
+    {
+        stream_discard(sock);
+        stream_ctx.stats.dropped++;
+        return;
+    }
+
+    if (hdr[112] & E131_OPT_TERMINATED)
+    {
+        // The sender is done, go back to patterns right away
+        stream_discard(sock);
+        k_spinlock_key_t key = k_spin_lock(&stream_ctx.lock);
+        stream_ctx.last_frame_ms = 0;
+        k_spin_unlock(&stream_ctx.lock, key);
+        stream_ctx.frame_ready();
+        return;
+    }
+
+    // Property value count includes the start code
+    size_t offset = index * PIXEL_STREAM_E131_PIXELS * sizeof(struct led_rgb);
+    size_t channels = MAX(sys_get_be16(&hdr[123]), 1) - 1;
+    size_t len = MIN(MIN(channels, PIXEL_STREAM_E131_PIXELS * sizeof(struct led_rgb)),
+                     stream_ctx.led_count * sizeof(struct led_rgb) - offset);
+
+    ret = stream_receive(sock, hdr, sizeof(hdr), offset, len);
+    if (ret < 0)
+    {
+        return;
+    }
+
+    stream_sequence(&stream_ctx.e131_seq[index], hdr[111], 256);
+
+    uint16_t sync = sys_get_be16(&hdr[109]);
+    if (sync != stream_ctx.e131_sync)
+    {
+#ifdef CONFIG_NET_IPV4_IGMP
+        if (sync != 0)
+        {
+            e131_join(sock, sync);
+        }
+#endif
+        stream_ctx.e131_sync = sync;
+    }
+
+    // Unsynchronized senders complete a frame with the universe holding the last pixel
+    if (sync == 0 && index == universes - 1)
+    {
+        stream_publish();
+    }
+}
+
+static int stream_open(uint16_t port)
+{
+    struct sockaddr_in bind_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = INADDR_ANY};
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+        LOG_ERR("Failed to create stream socket: %d", errno);
+        return -errno;
+    }
+
+    if (bind(sock, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0)
+    {
+        LOG_ERR("Failed to bind stream socket to port %d: %d", port, errno);
+        close(sock);
+        return -errno;
+    }
+
+    return sock;
+}
+
+static void pixel_stream_thread(void *arg1, void *arg2, void *arg3)
+{
+    struct pollfd fds[] = {
+        {.fd = stream_ctx.ddp_socket, .events = POLLIN},
+        {.fd = stream_ctx.e131_socket, .events = POLLIN},
+    };
+
+    while (true)
+    {
+        // Negative descriptors of disabled protocols are ignored by poll()
+        int ret = poll(fds, ARRAY_SIZE(fds), -1);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERR("Stream poll error: %d", errno);
+            return;
+        }
+
+        k_mutex_lock(&stream_ctx.rx_lock, K_FOREVER);
+        if (fds[0].revents & POLLIN)
+        {
+            ddp_handle(fds[0].fd);
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            e131_handle(fds[1].fd);
+        }
+        k_mutex_unlock(&stream_ctx.rx_lock);
+    }
+}
+
+int pixel_stream_init(size_t led_count, void (*frame_ready)(void))
+{
+    k_mutex_init(&stream_ctx.rx_lock);
+    stream_ctx.led_count = MIN(led_count, KSB_LED_MAX_COUNT);
+    stream_ctx.frame_ready = frame_ready;
+    stream_ctx.ddp_seq = -1;
+    for (size_t i = 0; i < ARRAY_SIZE(stream_ctx.e131_seq); i++)
+    {
+        stream_ctx.e131_seq[i] = -1;
+    }
+
+#ifdef CONFIG_KSB_PIXEL_STREAM_DDP
+    stream_ctx.ddp_socket = stream_open(PIXEL_STREAM_DDP_PORT);
+    if (stream_ctx.ddp_socket < 0)
+    {
+        return stream_ctx.ddp_socket;
+    }
+#endif
+
+#ifdef CONFIG_KSB_PIXEL_STREAM_E131
+    stream_ctx.e131_socket = stream_open(PIXEL_STREAM_E131_PORT);
+    if (stream_ctx.e131_socket < 0)
+    {
+        return stream_ctx.e131_socket;
+    }
+
+#ifdef CONFIG_NET_IPV4_IGMP
+    for (size_t i = 0; i < DIV_ROUND_UP(stream_ctx.led_count, PIXEL_STREAM_E131_PIXELS); i++)
+    {
+        e131_join(stream_ctx.e131_socket, CONFIG_KSB_PIXEL_STREAM_E131_UNIVERSE + i);
+    }
+#endif
+#endif
+
+    k_thread_create(&stream_ctx.thread, stream_ctx.stack,
+                    K_KERNEL_STACK_SIZEOF(stream_ctx.stack),
+                    pixel_stream_thread, NULL, NULL, NULL,
+                    6, 0, K_NO_WAIT);
+    k_thread_name_set(&stream_ctx.thread, "pixel_stream");
+
+    LOG_INF("Pixel stream receiver started: %zu pixels", stream_ctx.led_count);
+    return 0;
+}
+
+struct led_rgb *pixel_stream_lock(size_t *count)
+{
+    if (stream_ctx.led_count == 0)
+    {
+        return NULL;
+    }
+
+    k_mutex_lock(&stream_ctx.rx_lock, K_FOREVER);
+    *count = stream_ctx.led_count;
+    return stream_ctx.buffers[stream_ctx.write];
+}
+
+void pixel_stream_unlock(bool complete)
+{
+    stream_ctx.pending = true;
+    if (complete)
+    {
+        stream_publish();
+    }
+    k_mutex_unlock(&stream_ctx.rx_lock);
+}
+
+const struct led_rgb *pixel_stream_frame(bool *fresh)
+{
+    const struct led_rgb *frame = NULL;
+
+    k_spinlock_key_t key = k_spin_lock(&stream_ctx.lock);
+    if (stream_ctx.last_frame_ms != 0 &&
+        k_uptime_get() - stream_ctx.last_frame_ms < CONFIG_KSB_PIXEL_STREAM_TIMEOUT_MS)
+    {
+        *fresh = stream_ctx.fresh;
+        if (stream_ctx.fresh)
+        {
+            uint8_t shown = stream_ctx.read;
+
+            stream_ctx.read = stream_ctx.ready;
+            stream_ctx.ready = shown;
+            stream_ctx.fresh = false;
+        }
+        frame = stream_ctx.buffers[stream_ctx.read];
+    }
+    k_spin_unlock(&stream_ctx.lock, key);
+
+    return frame;
+}
+
+void pixel_stream_get_stats(struct pixel_stream_stats *stats)
+{
+    *stats = stream_ctx.stats;
+    if (k_uptime_get() - stream_ctx.last_frame_ms > MSEC_PER_SEC)
+    {
+        stats->fps = 0;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef PIXEL_STREAM_H
+#define PIXEL_STREAM_H
+
+#include <stddef.h>
+#include "ksb_common.h"
+
+/*
+ * Pixel stream receiver for external show controllers (xLights, LedFx,
+ * Jinx!, ...). While frames arrive the LEDs show them as sent, bypassing
+ * the pattern engine; patterns resume CONFIG_KSB_PIXEL_STREAM_TIMEOUT_MS
+ * after the last frame, or as soon as an E1.31 sender terminates its stream.
+ *
+ * DDP (UDP port 4048): RGB data at a byte offset into the strip, the frame
+ * is shown on the packet carrying the push flag.
+ *
+ * E1.31/sACN (UDP port 5568, unicast or multicast): universe
+ * CONFIG_KSB_PIXEL_STREAM_E131_UNIVERSE holds pixels 0-169, each following
+ * universe the next 170 pixels. A frame is shown when the universe holding
+ * the last pixel arrives, or on the sender's synchronization packet if its
+ * data packets name a synchronization universe.
+ *
+ * Payloads are received straight into a frame buffer, the header is peeked
+ * first to find where. Frames distributed over the mesh (see mesh_proto.h)
+ * are decoded into the same buffer through pixel_stream_lock(). Frames are triple buffered so the receiver never
+ * waits for the render thread; pixels a frame does not send keep their
+ * values from the frame before.
+ */
+
+#define PIXEL_STREAM_DDP_PORT 4048
+#define PIXEL_STREAM_E131_PORT 5568
+#define PIXEL_STREAM_E131_PIXELS 170
+
+struct pixel_stream_stats
+{
+    uint32_t packets; // Packets written into a frame
+    uint32_t frames;  // Frames completed
+    uint32_t lost;    // Packets missing from the sequence numbers
+    uint32_t dropped; // Packets malformed, not for this node or outside the strip
+    uint32_t fps;     // Frames completed in the last second
+};
+
+/**
+ * Start listening for pixel streams
+ * @param led_count Number of pixels on the strip
+ * @param frame_ready Called from the receive thread whenever a frame is complete
+ * @return 0 on success, negative error code on failure
+ */
+int pixel_stream_init(size_t led_count, void (*frame_ready)(void));
+
+/**
+ * Take the frame being received, for another receiver to write pixels into
+ * @param count Set to the number of pixels in the frame
+ * @return Frame buffer, NULL if the receiver is not running; release it
+ *         with pixel_stream_unlock()
+ */
+struct led_rgb *pixel_stream_lock(size_t *count);
+
+/**
+ * Release the frame taken with pixel_stream_lock()
+ * @param complete Show the frame
+ */
+void pixel_stream_unlock(bool complete);
+
+/**
+ * Get the frame to show, called from the render thread
+ * @param fresh Set if a frame completed since the last call
+ * @return Latest frame while a stream is active, NULL otherwise
+ */
+const struct led_rgb *pixel_stream_frame(bool *fresh);
+
+/**
+ * Get receiver statistics (frame rate, lost packets)
+ * @param stats Pointer to store statistics
+ */
+void pixel_stream_get_stats(struct pixel_stream_stats *stats);
+
+#endif // PIXEL_STREAM_H
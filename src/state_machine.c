@@ -67,6 +67,7 @@ static void handle_config_mode(void)
             {
                 g_ksb_ctx.config = new_config;
                 nvs_storage_save_config(&g_ksb_ctx.config);
+                nvs_storage_save_zones(web_config_get_zones());
                 LOG_INF("Configuration saved: %s", g_ksb_ctx.config.network_name);
                 web_config_stop();
                 transition_to_state(KSB_STATE_NETWORK_SCAN);
@@ -16,6 +16,7 @@ static struct web_config_context
     bool server_running;
     bool config_received;
     struct ksb_network_config received_config;
+    uint8_t received_zones;
     struct k_thread server_thread;
     K_KERNEL_STACK_MEMBER(server_stack, 4096);
 } web_ctx;
@@ -46,6 +47,8 @@ static const char *index_html =
     "<form action='/config' method='POST'>\n"
     "<label for='network'>Network Name:</label>\n"
     "<input type='text' id='network' name='network' placeholder='Living Room' maxlength='31' required>\n"
+    "<label for='zones'>Zones (1-8, empty for all):</label>\n"
+    "<input type='text' id='zones' name='zones' placeholder='1,3' maxlength='15'>\n"
     "<input type='submit' value='Save Configuration'>\n"
     "</form>\n"
     "</div>\n"
@@ -75,6 +78,33 @@ static const char *success_html =
     "</div>\n"
     "</body></html>";
 
+// Zone mask from the zones form field, a list of zone numbers 1-8
+static uint8_t parse_zones(const char *body)
+{
+    const char *start = strstr(body, "zones=");
+    uint8_t zones = 0;
+
+    if (!start)
+    {
+        return KSB_ZONES_ALL;
+    }
+
+    // Separators arrive URL-encoded, only single digits 1-8 outside an escape are zones
+    for (const char *p = start + strlen("zones="); *p && *p != '&'; p++)
+    {
+        if (*p == '%')
+        {
+            p += p[1] && p[2] ? 2 : 0;
+        }
+        else if (*p >= '1' && *p <= '0' + KSB_MAX_ZONES)
+        {
+            zones |= BIT(*p - '1');
+        }
+    }
+
+    return zones ? zones : KSB_ZONES_ALL;
+}
+
 // Web server thread
 static void web_server_thread(void *arg1, void *arg2, void *arg3)
 {
@@ -204,6 +234,7 @@ static void web_server_thread(void *arg1, void *arg2, void *arg3)
                                     sizeof(web_ctx.received_config.network_name) - 1);
                             web_ctx.received_config.is_configured = true;
                             web_ctx.received_config.device_id = sys_rand32_get() & 0xFF;
+                            web_ctx.received_zones = parse_zones(body);
                             web_ctx.config_received = true;
 
                             LOG_INF("Configuration received: %s", network_name);
@@ -335,4 +366,9 @@ int web_config_get_config(struct ksb_network_config *config)
 
     *config = web_ctx.received_config;
     return 0;
-}
\ No newline at end of file
+}
+
+uint8_t web_config_get_zones(void)
+{
+    return web_ctx.received_zones;
+}
@@ -27,4 +27,10 @@ bool web_config_is_configured(void);
  */
 int web_config_get_config(struct ksb_network_config *config);
 
+/**
+ * Get the zones received with the configuration
+ * @return Zone mask, KSB_ZONES_ALL if none were given
+ */
+uint8_t web_config_get_zones(void);
+
 #endif // WEB_CONFIG_H
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef KSB_TOOLS_BENCH_H
+#define KSB_TOOLS_BENCH_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Monotonic host time for the benchmarks
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Keeps the compiler from dropping a benchmarked result
+static inline void bench_consume(const void *p)
+{
+    __asm__ volatile("" : : "r"(p) : "memory");
+}
+
+#endif // KSB_TOOLS_BENCH_H
@@ -0,0 +1,121 @@
+/*
+ * Mesh frame codec (src/frame_codec.c) on the built-in patterns: renders
+ * each pattern through the pattern registry, codes the frames the way
+ * mesh_broadcast_frame() does (256-pixel spans, deltas against the last
+ * keyframe, a keyframe at the interval or once a delta passes half the raw
+ * size), checks every frame decodes back and reports the encoded size,
+ * keyframes and encode/decode time per frame.
+ *
+ * Usage: frame_codec_bench [pixels] [keyframe interval]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "frame_codec.h"
+#include "led_pattern.h"
+
+#define BENCH_FRAMES 900
+#define FRAME_SPAN 256
+
+static const enum ksb_led_pattern patterns[] = {
+    KSB_PATTERN_SOLID, KSB_PATTERN_BREATHING, KSB_PATTERN_RUNNING_LIGHT,
+    KSB_PATTERN_SPARKLE, KSB_PATTERN_WAVE, KSB_PATTERN_RAINBOW,
+};
+
+int main(int argc, char **argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : 256;
+    uint32_t interval = argc > 2 ? strtoul(argv[2], NULL, 0) : 30;
+    struct led_rgb *px = calloc(count, sizeof(*px));
+    struct led_rgb *key = calloc(count, sizeof(*key));
+    struct led_rgb *out = calloc(count, sizeof(*out));
+    static uint8_t buf[FRAME_CODEC_MAX_SIZE(FRAME_SPAN)];
+
+    if (count == 0 || interval == 0 || px == NULL || key == NULL || out == NULL)
+    {
+        fprintf(stderr, "usage: %s [pixels] [keyframe interval]\n", argv[0]);
+        return 2;
+    }
+
+    led_pattern_registry_init();
+    printf("%zu px, raw %zu B/frame, keyframe every %u frames\n", count,
+           count * sizeof(struct led_rgb), interval);
+
+    for (size_t p = 0; p < ARRAY_SIZE(patterns); p++)
+    {
+        struct led_layer layer = {
+            .pattern = patterns[p],
+            .color = {255, 80, 0},
+            .speed = 50,
+            .seed = 1,
+            .opacity = 255,
+        };
+        struct led_pattern_instance inst = {0};
+        uint64_t encode_ns = 0;
+        uint64_t decode_ns = 0;
+        size_t total = 0;
+        size_t delta_len = 0;
+        size_t max_len = 0;
+        uint32_t since_key = interval;
+        uint32_t keys = 0;
+
+        led_pattern_bind(&inst, &layer, count);
+        for (uint32_t f = 0; f < BENCH_FRAMES; f++)
+        {
+            led_pattern_render(&inst, px, f);
+
+            // The keyframe decision of mesh_broadcast_frame()
+            bool is_key = since_key >= interval || 2 * delta_len > count * sizeof(struct led_rgb);
+            size_t len = 0;
+
+            if (is_key)
+            {
+                memcpy(key, px, count * sizeof(*px));
+                since_key = 0;
+                keys++;
+            }
+
+            for (size_t first = 0; first < count; first += FRAME_SPAN)
+            {
+                size_t n = MIN(count - first, (size_t)FRAME_SPAN);
+                const struct led_rgb *ref = is_key ? NULL : &key[first];
+                uint64_t start = bench_now_ns();
+                int ret = frame_codec_encode(buf, sizeof(buf), &px[first], ref, n);
+
+                encode_ns += bench_now_ns() - start;
+                if (ret < 0)
+                {
+                    fprintf(stderr, "%s: frame %u does not encode\n",
+                            led_pattern_find(patterns[p])->name, f);
+                    return 1;
+                }
+
+                start = bench_now_ns();
+                int dec = frame_codec_decode(buf, ret, &out[first], ref, n);
+
+                decode_ns += bench_now_ns() - start;
+                if (dec != 0 || memcmp(&out[first], &px[first], n * sizeof(*px)) != 0)
+                {
+                    fprintf(stderr, "%s: frame %u does not decode back\n",
+                            led_pattern_find(patterns[p])->name, f);
+                    return 1;
+                }
+                len += ret;
+            }
+
+            since_key++;
+            delta_len = is_key ? 0 : len;
+            total += len;
+            max_len = MAX(max_len, len);
+        }
+
+        printf("%-14s %6.1f B/frame (%5.1f%%), max %4zu B, %3u keyframes, "
+               "encode %6.2f us, decode %6.2f us\n",
+               led_pattern_find(patterns[p])->name, (double)total / BENCH_FRAMES,
+               100.0 * total / ((double)count * sizeof(struct led_rgb) * BENCH_FRAMES), max_len,
+               keys, encode_ns / 1e3 / BENCH_FRAMES, decode_ns / 1e3 / BENCH_FRAMES);
+    }
+
+    return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef KSB_HOST_DEVICE_H
+#define KSB_HOST_DEVICE_H
+
+// Host stand-in for <zephyr/device.h>, nothing the shared modules use
+
+#endif // KSB_HOST_DEVICE_H
@@ -0,0 +1,15 @@
+#ifndef KSB_HOST_LED_STRIP_H
+#define KSB_HOST_LED_STRIP_H
+
+// Host stand-in for <zephyr/drivers/led_strip.h>: the pixel type only
+#include <stddef.h>
+#include <stdint.h>
+
+struct led_rgb
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+#endif // KSB_HOST_LED_STRIP_H
@@ -0,0 +1,68 @@
+#ifndef KSB_HOST_KERNEL_H
+#define KSB_HOST_KERNEL_H
+
+/*
+ * Host stand-in for <zephyr/kernel.h>. The tools are single threaded, so
+ * locks do nothing; cycles are host nanoseconds.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <zephyr/sys/util.h>
+
+#define K_FOREVER 0
+
+struct k_mutex
+{
+    int unused;
+};
+
+struct k_sem
+{
+    int unused;
+};
+
+#define K_MUTEX_DEFINE(name) struct k_mutex name
+
+static inline int k_mutex_lock(struct k_mutex *mutex, int timeout)
+{
+    return 0;
+}
+
+static inline int k_mutex_unlock(struct k_mutex *mutex)
+{
+    return 0;
+}
+
+static inline uint64_t k_host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint32_t k_cycle_get_32(void)
+{
+    return (uint32_t)k_host_ns();
+}
+
+static inline uint64_t k_cyc_to_us_near64(uint64_t cycles)
+{
+    return (cycles + 500) / 1000;
+}
+
+static inline uint32_t k_cyc_to_us_near32(uint32_t cycles)
+{
+    return (cycles + 500) / 1000;
+}
+
+static inline int64_t k_uptime_get(void)
+{
+    return k_host_ns() / 1000000;
+}
+
+#endif // KSB_HOST_KERNEL_H
@@ -0,0 +1,13 @@
+#ifndef KSB_HOST_LOG_H
+#define KSB_HOST_LOG_H
+
+// Host stand-in for <zephyr/logging/log.h>: errors go to stderr, the rest is dropped
+#include <stdio.h>
+
+#define LOG_MODULE_REGISTER(...)
+#define LOG_ERR(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define LOG_WRN(...) ((void)0)
+#define LOG_INF(...) ((void)0)
+#define LOG_DBG(...) ((void)0)
+
+#endif // KSB_HOST_LOG_H
@@ -0,0 +1,68 @@
+#ifndef KSB_HOST_BYTEORDER_H
+#define KSB_HOST_BYTEORDER_H
+
+// Host stand-in for <zephyr/sys/byteorder.h>: unaligned little/big-endian access
+#include <stdint.h>
+
+static inline void sys_put_le16(uint16_t val, uint8_t dst[2])
+{
+    dst[0] = val;
+    dst[1] = val >> 8;
+}
+
+static inline uint16_t sys_get_le16(const uint8_t src[2])
+{
+    return src[0] | (uint16_t)src[1] << 8;
+}
+
+static inline void sys_put_le32(uint32_t val, uint8_t dst[4])
+{
+    sys_put_le16(val, dst);
+    sys_put_le16(val >> 16, dst + 2);
+}
+
+static inline uint32_t sys_get_le32(const uint8_t src[4])
+{
+    return sys_get_le16(src) | (uint32_t)sys_get_le16(src + 2) << 16;
+}
+
+static inline void sys_put_le64(uint64_t val, uint8_t dst[8])
+{
+    sys_put_le32(val, dst);
+    sys_put_le32(val >> 32, dst + 4);
+}
+
+static inline uint64_t sys_get_le64(const uint8_t src[8])
+{
+    return sys_get_le32(src) | (uint64_t)sys_get_le32(src + 4) << 32;
+}
+
+static inline void sys_put_be16(uint16_t val, uint8_t dst[2])
+{
+    dst[0] = val >> 8;
+    dst[1] = val;
+}
+
+static inline uint16_t sys_get_be16(const uint8_t src[2])
+{
+    return (uint16_t)src[0] << 8 | src[1];
+}
+
+static inline void sys_put_be24(uint32_t val, uint8_t dst[3])
+{
+    dst[0] = val >> 16;
+    sys_put_be16(val, dst + 1);
+}
+
+static inline void sys_put_be32(uint32_t val, uint8_t dst[4])
+{
+    sys_put_be16(val >> 16, dst);
+    sys_put_be16(val, dst + 2);
+}
+
+static inline uint32_t sys_get_be32(const uint8_t src[4])
+{
+    return (uint32_t)sys_get_be16(src) << 16 | sys_get_be16(src + 2);
+}
+
+#endif // KSB_HOST_BYTEORDER_H
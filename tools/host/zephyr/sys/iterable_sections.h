@@ -0,0 +1,21 @@
+#ifndef KSB_HOST_ITERABLE_SECTIONS_H
+#define KSB_HOST_ITERABLE_SECTIONS_H
+
+/*
+ * Host stand-in for <zephyr/sys/iterable_sections.h> on ELF hosts: the
+ * linker provides __start_/__stop_ symbols for sections named like C
+ * identifiers. The explicit alignment keeps the compiler from padding
+ * entries apart.
+ */
+#define STRUCT_SECTION_ITERABLE(struct_type, varname)                                     \
+    struct struct_type varname                                                            \
+        __attribute__((__section__("_" #struct_type "_list"), __used__,                  \
+                       __aligned__(__alignof__(struct struct_type))))
+
+#define STRUCT_SECTION_FOREACH(struct_type, iterator)                                     \
+    extern struct struct_type __start__##struct_type##_list[];                            \
+    extern struct struct_type __stop__##struct_type##_list[];                             \
+    for (struct struct_type *iterator = __start__##struct_type##_list;                    \
+         iterator < __stop__##struct_type##_list; iterator++)
+
+#endif // KSB_HOST_ITERABLE_SECTIONS_H
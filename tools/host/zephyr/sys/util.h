@@ -0,0 +1,21 @@
+#ifndef KSB_HOST_SYS_UTIL_H
+#define KSB_HOST_SYS_UTIL_H
+
+// Host stand-in for <zephyr/sys/util.h>: the helpers the shared modules use
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define CLAMP(val, low, high) (((val) <= (low)) ? (low) : MIN(val, high))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+#define BIT(n) (1UL << (n))
+#define IS_POWER_OF_TWO(x) (((x) != 0U) && (((x) & ((x) - 1U)) == 0U))
+#define BUILD_ASSERT(expr, msg) _Static_assert(expr, msg)
+
+#define __packed __attribute__((__packed__))
+#define __aligned(x) __attribute__((__aligned__(x)))
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#define USEC_PER_SEC 1000000U
+#define MSEC_PER_SEC 1000U
+
+#endif // KSB_HOST_SYS_UTIL_H
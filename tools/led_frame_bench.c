@@ -0,0 +1,107 @@
+/*
+ * Per-frame cost of the LED output path at 8, 64, 256 and 1024 pixels: the
+ * pattern render through the pattern registry plus post-processing
+ * (src/led_postproc.c, brightness, gamma and white balance), then the push,
+ * which is the 3-bit WS2812B symbol encoding of ws2812/ws2812b_spi.c with
+ * every pixel changed. The SPI wire time at 3.2 MHz is printed for
+ * comparison; the current limiter (led_power.c) is left out.
+ *
+ * Usage: led_frame_bench [frames]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <zephyr/sys/byteorder.h>
+#include "bench.h"
+#include "led_pattern.h"
+#include "led_postproc.h"
+#include "ws2812b_symbols.h"
+
+#define SPI_HZ 3200000
+#define LATCH_BYTES 112 // 280 us low at 3.2 MHz
+
+static const size_t sizes[] = {8, 64, 256, 1024};
+static const enum ksb_led_pattern patterns[] = {
+    KSB_PATTERN_SOLID, KSB_PATTERN_BREATHING, KSB_PATTERN_RUNNING_LIGHT,
+    KSB_PATTERN_SPARKLE, KSB_PATTERN_WAVE, KSB_PATTERN_RAINBOW,
+};
+
+static uint32_t lut3[256];
+
+static void encode(uint8_t *out, const struct led_rgb *px, size_t count)
+{
+    for (size_t i = 0; i < count; i++, out += 9)
+    {
+        sys_put_be24(lut3[px[i].g], out);
+        sys_put_be24(lut3[px[i].r], out + 3);
+        sys_put_be24(lut3[px[i].b], out + 6);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t frames = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000;
+    size_t max = sizes[ARRAY_SIZE(sizes) - 1];
+    struct led_rgb *leds = calloc(max, sizeof(*leds));
+    struct led_rgb *out = calloc(max, sizeof(*out));
+    uint8_t *tx = calloc(max, 9);
+    static struct led_postproc post;
+
+    if (frames == 0 || leds == NULL || out == NULL || tx == NULL)
+    {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 2;
+    }
+
+    for (int b = 0; b < 256; b++)
+    {
+        lut3[b] = WS2812B_ENC3(b, _);
+    }
+    led_pattern_registry_init();
+    led_postproc_init(&post);
+    led_postproc_set_brightness(&post, 200);
+    led_postproc_set_correction(&post, (struct led_rgb){255, 224, 192});
+
+    for (size_t s = 0; s < ARRAY_SIZE(sizes); s++)
+    {
+        size_t count = sizes[s];
+
+        printf("%zu px (wire %.0f us at %.1f MHz):\n", count,
+               (count * 9 + LATCH_BYTES) * 8 * 1e6 / SPI_HZ, SPI_HZ / 1e6);
+        for (size_t p = 0; p < ARRAY_SIZE(patterns); p++)
+        {
+            struct led_layer layer = {
+                .pattern = patterns[p],
+                .color = {255, 80, 0},
+                .speed = 50,
+                .seed = 1,
+                .opacity = 255,
+            };
+            struct led_pattern_instance inst = {0};
+            uint64_t render_ns = 0;
+            uint64_t push_ns = 0;
+
+            led_pattern_bind(&inst, &layer, count);
+            for (uint32_t f = 0; f < frames; f++)
+            {
+                uint64_t start = bench_now_ns();
+
+                led_pattern_render(&inst, leds, f);
+                led_postproc_apply(&post, leds, out, count);
+                bench_consume(out);
+
+                uint64_t mid = bench_now_ns();
+
+                encode(tx, out, count);
+                bench_consume(tx);
+                render_ns += mid - start;
+                push_ns += bench_now_ns() - mid;
+            }
+
+            printf("  %-14s render %8.2f us, push %7.2f us\n",
+                   led_pattern_find(patterns[p])->name, render_ns / 1e3 / frames,
+                   push_ns / 1e3 / frames);
+        }
+    }
+
+    return 0;
+}
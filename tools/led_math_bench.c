@@ -0,0 +1,190 @@
+/*
+ * Fixed-point pattern math (src/led_math.c) against the float code it
+ * replaced: checks every channel stays within 1 LSB over a sweep of frames,
+ * speeds, brightness levels and colors, then times breathing, wave and
+ * rainbow frames both ways.
+ *
+ * Usage: led_math_bench [pixels]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "led_math.h"
+
+#define SWEEP_PIXELS 8
+#define BENCH_FRAMES 2000
+
+static int max_diff;
+
+static void compare(struct led_rgb ref, struct led_rgb out)
+{
+    int d[] = {abs(ref.r - out.r), abs(ref.g - out.g), abs(ref.b - out.b)};
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (d[i] > max_diff)
+        {
+            max_diff = d[i];
+        }
+    }
+}
+
+// Float patterns as they were in led_control.c, brightness folded in
+
+static void float_breathing(struct led_rgb *leds, size_t count, uint32_t frame,
+                            struct led_rgb color, uint32_t speed, uint8_t brightness)
+{
+    float breath = (sin((frame * speed) / 1000.0f) + 1.0f) / 2.0f;
+    uint8_t b = (uint8_t)(breath * brightness);
+    struct led_rgb c = {(color.r * b) / 255, (color.g * b) / 255, (color.b * b) / 255};
+
+    for (size_t i = 0; i < count; i++)
+    {
+        leds[i] = c;
+    }
+}
+
+static void float_wave(struct led_rgb *leds, size_t count, uint32_t frame,
+                       struct led_rgb color, uint32_t speed, uint8_t brightness)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        float w = (sin((frame * speed / 100.0f) + (i * 3.14159f / count)) + 1.0f) / 2.0f;
+        uint8_t b = (uint8_t)(w * brightness);
+
+        leds[i] = (struct led_rgb){(color.r * b) / 255, (color.g * b) / 255, (color.b * b) / 255};
+    }
+}
+
+static void float_rainbow(struct led_rgb *leds, size_t count, uint32_t frame,
+                          struct led_rgb color, uint32_t speed, uint8_t brightness)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        float hue = ((frame * speed / 10) + (i * 360 / count)) % 360;
+        float c = (float)brightness / 255.0f;
+        float x = c * (1 - fabs(fmod(hue / 60.0f, 2) - 1));
+        float r = hue < 60 || hue >= 300 ? c : (hue < 120 || hue >= 240 ? x : 0);
+        float g = hue < 60 ? x : (hue < 180 ? c : (hue < 240 ? x : 0));
+        float b = hue < 120 ? 0 : (hue < 180 ? x : (hue < 300 ? c : x));
+
+        leds[i] = (struct led_rgb){(uint8_t)(r * 255), (uint8_t)(g * 255), (uint8_t)(b * 255)};
+    }
+}
+
+// The same frames in fixed point, as the patterns compute them
+
+static void fixed_breathing(struct led_rgb *leds, size_t count, uint32_t frame,
+                            struct led_rgb color, uint32_t speed, uint8_t brightness)
+{
+    uint8_t b = ((uint32_t)ksb_wave_q16(ksb_rad_to_bam(frame * speed, 1000)) * brightness) >> 16;
+    struct led_rgb c = ksb_scale_rgb(color, b);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        leds[i] = c;
+    }
+}
+
+static void fixed_wave(struct led_rgb *leds, size_t count, uint32_t frame,
+                       struct led_rgb color, uint32_t speed, uint8_t brightness)
+{
+    uint32_t phase = ksb_rad_to_bam(frame * speed, 100);
+    uint32_t step = KSB_BAM_HALF_TURN / count;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t b = ((uint32_t)ksb_wave_q16(phase + i * step) * brightness) >> 16;
+
+        leds[i] = ksb_scale_rgb(color, b);
+    }
+}
+
+static void fixed_rainbow(struct led_rgb *leds, size_t count, uint32_t frame,
+                          struct led_rgb color, uint32_t speed, uint8_t brightness)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        leds[i] = ksb_hue_wheel(((frame * speed / 10) + (i * 360 / count)) % 360, brightness);
+    }
+}
+
+typedef void (*pattern_fn)(struct led_rgb *leds, size_t count, uint32_t frame,
+                           struct led_rgb color, uint32_t speed, uint8_t brightness);
+
+static const struct
+{
+    const char *name;
+    pattern_fn ref;
+    pattern_fn fixed;
+} patterns[] = {
+    {"breathing", float_breathing, fixed_breathing},
+    {"wave", float_wave, fixed_wave},
+    {"rainbow", float_rainbow, fixed_rainbow},
+};
+
+static double time_frames(pattern_fn fn, struct led_rgb *leds, size_t count)
+{
+    const struct led_rgb color = {255, 80, 0};
+    uint64_t start = bench_now_ns();
+
+    for (uint32_t f = 0; f < BENCH_FRAMES; f++)
+    {
+        fn(leds, count, f, color, 50, 200);
+        bench_consume(leds);
+    }
+    return (double)(bench_now_ns() - start) / BENCH_FRAMES;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct led_rgb colors[] = {
+        {255, 255, 255}, {100, 100, 100}, {255, 0, 0}, {17, 200, 3}};
+    static const uint32_t speeds[] = {1, 7, 50, 100, 150, 199};
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : 256;
+    struct led_rgb *ref = calloc(count, sizeof(*ref));
+    struct led_rgb *out = calloc(count, sizeof(*out));
+
+    if (count < SWEEP_PIXELS || ref == NULL || out == NULL)
+    {
+        fprintf(stderr, "usage: %s [pixels >= %d]\n", argv[0], SWEEP_PIXELS);
+        return 2;
+    }
+
+    for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+    {
+        max_diff = 0;
+        for (size_t c = 0; c < sizeof(colors) / sizeof(colors[0]); c++)
+        {
+            for (size_t s = 0; s < sizeof(speeds) / sizeof(speeds[0]); s++)
+            {
+                for (uint32_t b = 0; b < 256; b += 5)
+                {
+                    for (uint32_t f = 0; f < 20000; f += 7)
+                    {
+                        patterns[p].ref(ref, SWEEP_PIXELS, f, colors[c], speeds[s], b);
+                        patterns[p].fixed(out, SWEEP_PIXELS, f, colors[c], speeds[s], b);
+                        for (size_t i = 0; i < SWEEP_PIXELS; i++)
+                        {
+                            compare(ref[i], out[i]);
+                        }
+                    }
+                }
+            }
+        }
+
+        double float_ns = time_frames(patterns[p].ref, ref, count);
+        double fixed_ns = time_frames(patterns[p].fixed, out, count);
+
+        printf("%-10s max diff %d LSB, %zu px: float %8.0f ns/frame, fixed %8.0f ns/frame "
+               "(%.1fx)\n",
+               patterns[p].name, max_diff, count, float_ns, fixed_ns, float_ns / fixed_ns);
+        if (max_diff > 1)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Mesh wire protocol (src/mesh_proto.c): encodes full datagrams of typical
+ * messages with mesh_proto_put(), decodes them again with mesh_proto_open()
+ * and mesh_proto_next(), checks the round trip and reports time per message
+ * and messages per datagram.
+ *
+ * Usage: mesh_proto_bench [datagrams]
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "mesh_proto.h"
+
+static uint8_t span[200];
+static uint8_t program[64];
+
+// Message i of a workload, fields vary so varints take different lengths
+static void make_pattern(struct mesh_msg *msg, uint32_t i)
+{
+    *msg = (struct mesh_msg){
+        .type = MESH_MSG_PATTERN,
+        .pattern = {
+            .pattern = KSB_PATTERN_RAINBOW,
+            .color = {255, i & 0xFF, 0},
+            .speed = i % 200,
+            .brightness = 200,
+            .start_ms = i * 16,
+            .transition_ms = 500,
+            .seed = i * 2654435761U,
+            .clock = i,
+            .sent_us = i * 16000,
+        },
+    };
+}
+
+static void make_time(struct mesh_msg *msg, uint32_t i)
+{
+    *msg = (struct mesh_msg){
+        .type = MESH_MSG_TIME_RESPONSE,
+        .time = {.node_id = i, .t1 = i * 1000ULL, .t2 = i * 1000ULL + 7, .t3 = i * 1000ULL + 9,
+                 .clock = i},
+    };
+}
+
+static void make_frame(struct mesh_msg *msg, uint32_t i)
+{
+    *msg = (struct mesh_msg){
+        .type = MESH_MSG_FRAME,
+        .frame = {.flags = MESH_FRAME_LAST, .key_id = i, .seq = i, .sent_us = i * 16000,
+                  .first = (i % 4) * 256, .count = 256, .data = span, .len = sizeof(span)},
+    };
+}
+
+static void make_program(struct mesh_msg *msg, uint32_t i)
+{
+    *msg = (struct mesh_msg){
+        .type = MESH_MSG_PROGRAM,
+        .program = {.bytecode = program, .len = sizeof(program) - i % 16},
+    };
+}
+
+static const struct
+{
+    const char *name;
+    void (*make)(struct mesh_msg *msg, uint32_t i);
+} workloads[] = {
+    {"PATTERN", make_pattern},
+    {"TIME_RESPONSE", make_time},
+    {"FRAME 200 B", make_frame},
+    {"PROGRAM", make_program},
+};
+
+// Encodings of two messages are the same bytes
+static bool same_msg(const struct mesh_msg *a, const struct mesh_msg *b)
+{
+    uint8_t buf_a[MESH_PROTO_MAX_DATAGRAM];
+    uint8_t buf_b[MESH_PROTO_MAX_DATAGRAM];
+    struct mesh_writer wa;
+    struct mesh_writer wb;
+
+    mesh_proto_begin(&wa, buf_a, sizeof(buf_a), 0, 0);
+    mesh_proto_begin(&wb, buf_b, sizeof(buf_b), 0, 0);
+    return mesh_proto_put(&wa, a) == 0 && mesh_proto_put(&wb, b) == 0 && wa.len == wb.len &&
+           memcmp(buf_a, buf_b, wa.len) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t datagrams = argc > 1 ? strtoul(argv[1], NULL, 0) : 20000;
+    static uint8_t buf[MESH_PROTO_MAX_DATAGRAM];
+
+    if (datagrams == 0)
+    {
+        fprintf(stderr, "usage: %s [datagrams]\n", argv[0]);
+        return 2;
+    }
+
+    for (size_t i = 0; i < sizeof(span); i++)
+    {
+        span[i] = i * 37;
+    }
+    memset(program, 0x5A, sizeof(program));
+
+    for (size_t w = 0; w < ARRAY_SIZE(workloads); w++)
+    {
+        uint64_t put_ns = 0;
+        uint64_t next_ns = 0;
+        uint64_t msgs = 0;
+        uint64_t bytes = 0;
+
+        for (uint32_t d = 0; d < datagrams; d++)
+        {
+            struct mesh_writer wr;
+            struct mesh_reader rd;
+            struct mesh_msg msg;
+            struct mesh_msg out;
+            uint32_t first = d * 64;
+            uint32_t n = 0;
+            uint64_t start = bench_now_ns();
+
+            // Fill the datagram
+            mesh_proto_begin(&wr, buf, sizeof(buf), 1, d);
+            while (true)
+            {
+                workloads[w].make(&msg, first + n);
+                if (mesh_proto_put(&wr, &msg) != 0)
+                {
+                    break;
+                }
+                n++;
+            }
+            bench_consume(buf);
+            put_ns += bench_now_ns() - start;
+
+            start = bench_now_ns();
+            if (mesh_proto_open(&rd, buf, wr.len) != 0)
+            {
+                fprintf(stderr, "%s: datagram rejected\n", workloads[w].name);
+                return 1;
+            }
+            uint32_t got = 0;
+            int ret;
+
+            while ((ret = mesh_proto_next(&rd, &out)) > 0)
+            {
+                bench_consume(&out);
+                got++;
+            }
+            next_ns += bench_now_ns() - start;
+
+            if (ret < 0 || got != n)
+            {
+                fprintf(stderr, "%s: decoded %u of %u messages (%d)\n", workloads[w].name, got,
+                        n, ret);
+                return 1;
+            }
+
+            // Check the last message of some datagrams field by field through its encoding
+            if (d % 64 == 0)
+            {
+                workloads[w].make(&msg, first + n - 1);
+                if (!same_msg(&msg, &out))
+                {
+                    fprintf(stderr, "%s: round trip differs\n", workloads[w].name);
+                    return 1;
+                }
+            }
+
+            msgs += n;
+            bytes += wr.len;
+        }
+
+        printf("%-14s %3llu msgs/datagram, %4llu B: put %6.1f ns/msg, next %6.1f ns/msg "
+               "(%.0f MB/s decoded)\n",
+               workloads[w].name, (unsigned long long)(msgs / datagrams),
+               (unsigned long long)(bytes / datagrams), (double)put_ns / msgs,
+               (double)next_ns / msgs, bytes * 1e3 / next_ns);
+    }
+
+    return 0;
+}
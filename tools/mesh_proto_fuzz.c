@@ -0,0 +1,375 @@
+/*
+ * Fuzz target for the mesh wire protocol decoder (src/mesh_proto.c). Every
+ * input is opened and decoded to the end; the decoder must stay inside the
+ * datagram, always make progress and only return 1, 0 or -EBADMSG. Every
+ * message it accepts must encode again, and decoding that encoding must
+ * give the same message.
+ *
+ * Built with clang and -DKSB_TOOLS_LIBFUZZER=ON this is a libFuzzer target.
+ * Otherwise main() replays the corpus and then runs seeded random mutations
+ * of it:
+ *
+ *   mesh_proto_fuzz [-n iterations] [-s seed] corpus...
+ *   mesh_proto_fuzz -w dir    write the seed corpus to dir
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mesh_proto.h"
+
+#define FUZZ_MAX_INPUT 2048
+
+#define FUZZ_CHECK(cond, what)                                                             \
+    do                                                                                     \
+    {                                                                                      \
+        if (!(cond))                                                                       \
+        {                                                                                  \
+            fprintf(stderr, "mesh_proto_fuzz: %s\n", what);                                \
+            abort();                                                                       \
+        }                                                                                  \
+    } while (0)
+
+static bool inside(const uint8_t *p, size_t len, const uint8_t *buf, size_t size)
+{
+    return p >= buf && len <= size && p - buf <= (ptrdiff_t)(size - len);
+}
+
+// Encode one message into its own datagram, returns the datagram length
+static size_t encode_one(const struct mesh_msg *msg, uint8_t *buf, size_t size)
+{
+    struct mesh_writer w;
+
+    FUZZ_CHECK(mesh_proto_begin(&w, buf, size, 0, 0) == 0, "begin failed");
+    FUZZ_CHECK(mesh_proto_put(&w, msg) == 0, "decoded message does not encode");
+    return w.len;
+}
+
+static void check_roundtrip(const struct mesh_msg *msg)
+{
+    static uint8_t first[FUZZ_MAX_INPUT + 64];
+    static uint8_t second[FUZZ_MAX_INPUT + 64];
+    struct mesh_reader r;
+    struct mesh_msg again;
+    size_t len = encode_one(msg, first, sizeof(first));
+
+    FUZZ_CHECK(mesh_proto_open(&r, first, len) == 0, "own datagram rejected");
+    FUZZ_CHECK(mesh_proto_next(&r, &again) == 1, "own message not decoded");
+    FUZZ_CHECK(mesh_proto_next(&r, &again) == 0, "own datagram has trailing data");
+
+    // The first decode may have dropped fields (short forms, clamped values), the
+    // encoding of what it kept must be stable
+    mesh_proto_open(&r, first, len);
+    mesh_proto_next(&r, &again);
+    FUZZ_CHECK(encode_one(&again, second, sizeof(second)) == len &&
+                   memcmp(first, second, len) == 0,
+               "message changed in a round trip");
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    struct mesh_reader r;
+    struct mesh_msg msg;
+    int ret;
+
+    if (size > FUZZ_MAX_INPUT || mesh_proto_open(&r, data, size) != 0)
+    {
+        return 0;
+    }
+
+    size_t pos = r.pos;
+
+    while ((ret = mesh_proto_next(&r, &msg)) != 0)
+    {
+        FUZZ_CHECK(ret == 1 || ret == -EBADMSG, "unexpected return value");
+        FUZZ_CHECK(r.pos > pos && r.pos <= size, "reader did not advance within the datagram");
+        pos = r.pos;
+        if (ret < 0)
+        {
+            continue;
+        }
+
+        if (msg.type == MESH_MSG_PROGRAM)
+        {
+            FUZZ_CHECK(inside(msg.program.bytecode, msg.program.len, data, size),
+                       "program outside the datagram");
+            FUZZ_CHECK(msg.program.len <= MESH_PROTO_MAX_PROGRAM, "oversized program");
+        }
+        else if (msg.type == MESH_MSG_FRAME)
+        {
+            FUZZ_CHECK(inside(msg.frame.data, msg.frame.len, data, size),
+                       "frame data outside the datagram");
+        }
+        check_roundtrip(&msg);
+    }
+    FUZZ_CHECK(r.pos == size, "datagram not consumed");
+    return 0;
+}
+
+#ifndef KSB_TOOLS_LIBFUZZER
+
+static const uint8_t seed_program[] = {'K', 'V', 1, 1, 0x01, 0x00};
+static const uint8_t seed_span[] = {0x02, 0x10, 0x20, 0x30, 0x81, 0xC3};
+
+// One datagram per entry, NULL-terminated message lists
+static const struct mesh_msg seed_msgs[][4] = {
+    {{.type = MESH_MSG_PATTERN,
+      .pattern = {.pattern = KSB_PATTERN_WAVE, .color = {255, 80, 0}, .speed = 50,
+                  .brightness = 200, .start_ms = 123456, .transition_ms = 500,
+                  .seed = 0xDEADBEEF, .clock = 300, .sent_us = 987654321}}},
+    {{.type = MESH_MSG_TIME_REQUEST, .time = {.node_id = 7, .t1 = 1000000, .clock = 5}}},
+    {{.type = MESH_MSG_TIME_RESPONSE,
+      .time = {.node_id = 7, .t1 = 1000000, .t2 = 1000400, .t3 = 1000410, .clock = 6}}},
+    {{.type = MESH_MSG_PROGRAM, .program = {seed_program, sizeof(seed_program)}}},
+    {{.type = MESH_MSG_TARGET, .zones = 0x05},
+     {.type = MESH_MSG_PATTERN, .pattern = {.pattern = KSB_PATTERN_SOLID, .clock = UINT32_MAX}}},
+    {{.type = MESH_MSG_FRAME,
+      .frame = {.flags = MESH_FRAME_KEY | MESH_FRAME_LAST, .key_id = 3, .seq = 9, .sent_us = 42,
+                .first = 256, .count = 300, .data = seed_span, .len = sizeof(seed_span)}},
+     {.type = MESH_MSG_KEY_REQUEST}},
+};
+
+// Hand-made datagrams the encoder does not produce
+static const struct
+{
+    const char *name;
+    uint8_t data[24];
+    size_t len;
+} seed_raw[] = {
+    // PATTERN without the trailing Lamport clock
+    {"pattern_short", {'K', 1, 2, 0, 0, 1, 15, 2, 255, 0, 0, 128, 50, 0, 1, 2, 3, 4, 5, 6, 7, 8},
+     22},
+    // PATTERN from before the send time was added
+    {"pattern_no_sent",
+     {'K', 1, 2, 4, 0, 1, 16, 2, 255, 0, 0, 128, 50, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9},
+     23},
+    // Unknown type 0x40 followed by KEY_REQUEST
+    {"unknown_type", {'K', 1, 2, 1, 0, 0x40, 3, 1, 2, 3, 7, 0}, 12},
+    // Five byte varint length that overflows 32 bits
+    {"varint_overflow", {'K', 1, 2, 2, 0, 5, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F}, 11},
+    // Message length past the end of the datagram
+    {"length_past_end", {'K', 1, 2, 3, 0, 1, 40, 2, 255}, 9},
+};
+
+static int write_file(const char *dir, const char *name, const uint8_t *data, size_t len)
+{
+    char path[512];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "wb");
+    if (f == NULL || fwrite(data, 1, len, f) != len)
+    {
+        perror(path);
+        return -1;
+    }
+    return fclose(f);
+}
+
+static int write_corpus(const char *dir)
+{
+    static const char *const names[] = {"pattern", "time_request", "time_response",
+                                        "program", "target_pattern", "frame_key_request"};
+    uint8_t buf[MESH_PROTO_MAX_DATAGRAM];
+
+    for (size_t i = 0; i < ARRAY_SIZE(seed_msgs); i++)
+    {
+        struct mesh_writer w;
+
+        mesh_proto_begin(&w, buf, sizeof(buf), 1, i);
+        for (size_t m = 0; m < ARRAY_SIZE(seed_msgs[i]) && seed_msgs[i][m].type != 0; m++)
+        {
+            FUZZ_CHECK(mesh_proto_put(&w, &seed_msgs[i][m]) == 0, "seed does not encode");
+        }
+        if (write_file(dir, names[i], buf, w.len) != 0)
+        {
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(seed_raw); i++)
+    {
+        if (write_file(dir, seed_raw[i].name, seed_raw[i].data, seed_raw[i].len) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static uint8_t corpus[256][FUZZ_MAX_INPUT];
+static size_t corpus_len[256];
+static size_t corpus_count;
+
+// Run one input from an exactly sized heap copy, so ASan sees reads past its end
+static void run(const uint8_t *data, size_t len)
+{
+    uint8_t *copy = malloc(len ? len : 1);
+
+    memcpy(copy, data, len);
+    LLVMFuzzerTestOneInput(copy, len);
+    free(copy);
+}
+
+static void load_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL || corpus_count == ARRAY_SIZE(corpus))
+    {
+        if (f != NULL)
+        {
+            fclose(f);
+        }
+        return;
+    }
+    corpus_len[corpus_count] = fread(corpus[corpus_count], 1, FUZZ_MAX_INPUT, f);
+    corpus_count++;
+    fclose(f);
+}
+
+static void load(const char *path)
+{
+    DIR *dir = opendir(path);
+    struct dirent *e;
+
+    if (dir == NULL)
+    {
+        load_file(path);
+        return;
+    }
+    while ((e = readdir(dir)) != NULL)
+    {
+        char file[512];
+
+        if (e->d_name[0] != '.')
+        {
+            snprintf(file, sizeof(file), "%s/%s", path, e->d_name);
+            load_file(file);
+        }
+    }
+    closedir(dir);
+}
+
+// A few random edits: bit flips, byte values, truncation, insertion, runs, splicing
+static size_t mutate(uint8_t *buf, size_t len)
+{
+    int edits = 1 + rand() % 4;
+
+    for (int e = 0; e < edits; e++)
+    {
+        size_t at = len ? rand() % len : 0;
+
+        switch (rand() % 7)
+        {
+        case 0:
+            if (len)
+            {
+                buf[at] ^= 1 << (rand() % 8);
+            }
+            break;
+        case 1:
+            if (len)
+            {
+                static const uint8_t edge[] = {0x00, 0x01, 0x7F, 0x80, 0xFF};
+
+                buf[at] = edge[rand() % ARRAY_SIZE(edge)];
+            }
+            break;
+        case 2:
+            len = at;
+            break;
+        case 3:
+            if (len < FUZZ_MAX_INPUT)
+            {
+                memmove(buf + at + 1, buf + at, len - at);
+                buf[at] = rand();
+                len++;
+            }
+            break;
+        case 4:
+        {
+            // Long payloads, for the size limits
+            size_t n = MIN(1 + (size_t)rand() % 512, (size_t)FUZZ_MAX_INPUT - len);
+
+            memmove(buf + at + n, buf + at, len - at);
+            memset(buf + at, rand(), n);
+            len += n;
+            break;
+        }
+        case 5:
+        {
+            size_t other = rand() % corpus_count;
+            size_t n = MIN(corpus_len[other], (size_t)FUZZ_MAX_INPUT - at);
+
+            memcpy(buf + at, corpus[other], n);
+            len = MAX(len, at + n);
+            break;
+        }
+        default:
+            if (len)
+            {
+                buf[at] += rand() % 16 - 8;
+            }
+            break;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = 1000000;
+    unsigned int seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:w:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            return write_corpus(optarg);
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-s seed] corpus... | -w dir\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    for (int i = optind; i < argc; i++)
+    {
+        load(argv[i]);
+    }
+    if (corpus_count == 0)
+    {
+        fprintf(stderr, "no corpus files\n");
+        return 2;
+    }
+
+    for (size_t i = 0; i < corpus_count; i++)
+    {
+        run(corpus[i], corpus_len[i]);
+    }
+
+    static uint8_t input[FUZZ_MAX_INPUT];
+
+    srand(seed);
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        size_t from = rand() % corpus_count;
+
+        memcpy(input, corpus[from], corpus_len[from]);
+        run(input, mutate(input, corpus_len[from]));
+    }
+
+    printf("%zu corpus files, %lu mutations, no failures\n", corpus_count, iterations);
+    return 0;
+}
+
+#endif // KSB_TOOLS_LIBFUZZER
@@ -0,0 +1,251 @@
+/*
+ * DDP and E1.31 sender for testing the pixel stream receiver
+ * (src/pixel_stream.c) on native_sim or a board, without show control
+ * software. Sends frames at a fixed rate, pixel bytes (frame + byte index)
+ * so a received frame can be checked, and can leave out every Nth packet
+ * to check the receiver's loss count.
+ *
+ * Usage: pixel_stream_gen [-p ddp|e131] [-n pixels] [-r fps] [-f frames]
+ *                         [-d drop every] [-u universe] [-S sync universe]
+ *                         [-t] [host]
+ *
+ * -r 0 sends as fast as possible, -t ends an E1.31 stream with a stream
+ * terminated packet. The host defaults to 127.0.0.1.
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zephyr/sys/byteorder.h>
+#include "bench.h"
+#include "pixel_stream.h"
+
+#define DDP_HEADER_SIZE 10
+#define DDP_MAX_DATA 1440
+#define DDP_FLAGS_V1 0x40
+#define DDP_FLAG_PUSH 0x01
+#define DDP_TYPE_RGB24 0x0B
+#define DDP_ID_DISPLAY 1
+
+#define E131_DATA_OFFSET 126
+#define E131_SYNC_SIZE 49
+#define E131_OPT_TERMINATED 0x40
+
+static const uint8_t e131_acn_id[] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+
+struct gen
+{
+    int sock;
+    struct sockaddr_in dst;
+    size_t pixels;
+    uint32_t drop_every;
+    uint16_t universe;
+    uint16_t sync;
+    uint32_t sent;
+    uint32_t dropped;
+    uint8_t seq;
+    uint8_t pkt[MAX(DDP_HEADER_SIZE + DDP_MAX_DATA, E131_DATA_OFFSET + 512)];
+};
+
+static void gen_send(struct gen *g, size_t len)
+{
+    // Leaving a packet out still uses up its sequence number
+    if (g->drop_every && (g->sent + g->dropped + 1) % g->drop_every == 0)
+    {
+        g->dropped++;
+        return;
+    }
+    if (sendto(g->sock, g->pkt, len, 0, (struct sockaddr *)&g->dst, sizeof(g->dst)) < 0)
+    {
+        perror("sendto");
+        exit(1);
+    }
+    g->sent++;
+}
+
+static void ddp_frame(struct gen *g, uint32_t frame)
+{
+    size_t total = g->pixels * 3;
+
+    for (size_t offset = 0; offset < total; offset += DDP_MAX_DATA)
+    {
+        size_t len = MIN(total - offset, (size_t)DDP_MAX_DATA);
+
+        // Sequence numbers run 1-15
+        g->seq = g->seq % 15 + 1;
+        g->pkt[0] = DDP_FLAGS_V1 | (offset + len == total ? DDP_FLAG_PUSH : 0);
+        g->pkt[1] = g->seq;
+        g->pkt[2] = DDP_TYPE_RGB24;
+        g->pkt[3] = DDP_ID_DISPLAY;
+        sys_put_be32(offset, &g->pkt[4]);
+        sys_put_be16(len, &g->pkt[8]);
+        for (size_t i = 0; i < len; i++)
+        {
+            g->pkt[DDP_HEADER_SIZE + i] = frame + offset + i;
+        }
+        gen_send(g, DDP_HEADER_SIZE + len);
+    }
+}
+
+// Root and framing layers of an E1.31 packet of len bytes
+static void e131_layers(struct gen *g, size_t len, uint32_t root_vector, uint32_t framing_vector)
+{
+    memset(g->pkt, 0, E131_DATA_OFFSET);
+    sys_put_be16(0x0010, &g->pkt[0]);
+    memcpy(&g->pkt[4], e131_acn_id, sizeof(e131_acn_id));
+    sys_put_be16(0x7000 | (len - 16), &g->pkt[16]);
+    sys_put_be32(root_vector, &g->pkt[18]);
+    memcpy(&g->pkt[22], "pixel_stream_gen", 16); // CID
+    sys_put_be16(0x7000 | (len - 38), &g->pkt[38]);
+    sys_put_be32(framing_vector, &g->pkt[40]);
+}
+
+static void e131_frame(struct gen *g, uint32_t frame, bool terminate)
+{
+    size_t total = g->pixels * 3;
+    size_t per_universe = PIXEL_STREAM_E131_PIXELS * 3;
+
+    for (size_t u = 0; u * per_universe < total; u++)
+    {
+        size_t offset = u * per_universe;
+        size_t len = MIN(total - offset, per_universe);
+
+        e131_layers(g, E131_DATA_OFFSET + len, 0x00000004, 0x00000002);
+        snprintf((char *)&g->pkt[44], 64, "pixel_stream_gen");
+        g->pkt[108] = 100; // Priority
+        sys_put_be16(g->sync, &g->pkt[109]);
+        g->pkt[111] = frame;
+        g->pkt[112] = terminate ? E131_OPT_TERMINATED : 0;
+        sys_put_be16(g->universe + u, &g->pkt[113]);
+        sys_put_be16(0x7000 | (len + 11), &g->pkt[115]);
+        g->pkt[117] = 0x02; // Set property
+        g->pkt[118] = 0xA1;
+        sys_put_be16(0, &g->pkt[119]);
+        sys_put_be16(1, &g->pkt[121]);
+        sys_put_be16(len + 1, &g->pkt[123]); // Start code and channels
+        g->pkt[125] = 0;
+        for (size_t i = 0; i < len; i++)
+        {
+            g->pkt[E131_DATA_OFFSET + i] = frame + offset + i;
+        }
+        gen_send(g, E131_DATA_OFFSET + len);
+        if (terminate)
+        {
+            // One terminated packet is enough
+            return;
+        }
+    }
+
+    if (g->sync != 0)
+    {
+        e131_layers(g, E131_SYNC_SIZE, 0x00000008, 0x00000001);
+        g->pkt[44] = frame;
+        sys_put_be16(g->sync, &g->pkt[45]);
+        gen_send(g, E131_SYNC_SIZE);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct gen g = {.pixels = 256, .universe = 1};
+    bool e131 = false;
+    bool terminate = false;
+    uint32_t fps = 40;
+    uint32_t frames = 1000;
+    const char *host = "127.0.0.1";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:n:r:f:d:u:S:t")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            e131 = strcmp(optarg, "e131") == 0;
+            if (!e131 && strcmp(optarg, "ddp") != 0)
+            {
+                fprintf(stderr, "unknown protocol %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'n':
+            g.pixels = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            fps = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            g.drop_every = strtoul(optarg, NULL, 0);
+            break;
+        case 'u':
+            g.universe = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            g.sync = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            terminate = true;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-p ddp|e131] [-n pixels] [-r fps] [-f frames] [-d drop every] "
+                    "[-u universe] [-S sync universe] [-t] [host]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc)
+    {
+        host = argv[optind];
+    }
+
+    g.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    g.dst.sin_family = AF_INET;
+    g.dst.sin_port = htons(e131 ? PIXEL_STREAM_E131_PORT : PIXEL_STREAM_DDP_PORT);
+    if (g.sock < 0 || g.pixels == 0 || inet_pton(AF_INET, host, &g.dst.sin_addr) != 1)
+    {
+        fprintf(stderr, "cannot send to %s\n", host);
+        return 2;
+    }
+
+    uint64_t start = bench_now_ns();
+    uint64_t period = fps ? 1000000000ULL / fps : 0;
+
+    for (uint32_t f = 0; f < frames; f++)
+    {
+        if (e131)
+        {
+            e131_frame(&g, f, false);
+        }
+        else
+        {
+            ddp_frame(&g, f);
+        }
+
+        // Pace against the start time, so the rate does not drift
+        if (period)
+        {
+            int64_t ahead = (int64_t)(start + (f + 1) * period - bench_now_ns());
+
+            if (ahead > 0)
+            {
+                usleep(ahead / 1000);
+            }
+        }
+    }
+    if (e131 && terminate)
+    {
+        e131_frame(&g, frames, true);
+    }
+
+    double secs = (bench_now_ns() - start) / 1e9;
+
+    printf("%s %zu px: %u frames in %.2f s (%.0f fps), %u packets sent, %u left out\n",
+           e131 ? "E1.31" : "DDP", g.pixels, frames, secs, frames / secs, g.sent, g.dropped);
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Effect bytecode VM (src/led_vm.c) against the native patterns it can
+ * replace: each native pattern is timed through the pattern registry, then
+ * an equivalent effect program through the SCRIPT pattern. The programs
+ * compute their phase the way the native patterns do, so the frames must
+ * match exactly. Instructions that do not depend on the pixel index run
+ * once per frame (breathing has none that do, so it fills the strip).
+ *
+ * Usage: vm_bench [pixels]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "led_pattern.h"
+#include "led_vm.h"
+
+#define BENCH_FRAMES 2000
+
+// Instruction encoding, see led_vm.h
+#define REGS(dst, src) (((dst) << 4) | (src))
+#define OP(op, dst, src) LED_VM_OP_##op, REGS(dst, src)
+#define OPI(op, dst, imm) LED_VM_OP_##op, REGS(dst, 0), (uint8_t)(imm), (uint8_t)((imm) >> 8)
+#define PROGRAM(insns, ...)                                                               \
+    {'K', 'V', LED_VM_VERSION, insns, __VA_ARGS__}
+
+// Output color r7-r9 = layer color r4-r6 scaled by r12
+#define SCALE_COLOR                                                                       \
+    OP(MOV, 7, 4), OP(SCALE, 7, 12), OP(MOV, 8, 5), OP(SCALE, 8, 12), OP(MOV, 9, 6),      \
+        OP(SCALE, 9, 12)
+
+// Phase frame * speed / 1000 rad, as breathing
+static const uint8_t breathing_program[] = PROGRAM(
+    12, OP(MOV, 10, 2), OP(MUL, 10, 3), OPI(RAD, 10, 1000), OPI(LDI, 13, 16), OP(SHR, 10, 13),
+    OP(WAVE, 12, 10), SCALE_COLOR);
+
+// Phase frame * speed / 100 rad plus half a turn across the strip, as wave. The step
+// 2^31 / count is built from 2^30 with signed divides: 2 * (2^30 / n) + 2 * (2^30 % n) / n
+static const uint8_t wave_program[] = PROGRAM(
+    25, OP(MOV, 10, 2), OP(MUL, 10, 3), OPI(RAD, 10, 100), OPI(LDI, 11, 1), OPI(LDI, 13, 30),
+    OP(SHL, 11, 13), OP(MOV, 14, 11), OP(MOD, 14, 1), OP(DIV, 11, 1), OP(ADD, 11, 11),
+    OP(ADD, 14, 14), OP(DIV, 14, 1), OP(ADD, 11, 14), OPI(LDI, 13, 16), OP(MOV, 12, 0),
+    OP(MUL, 12, 11), OP(ADD, 12, 10), OP(SHR, 12, 13), OP(WAVE, 12, 12), SCALE_COLOR);
+
+// Hue frame * speed / 10 plus a full turn across the strip, as rainbow
+static const uint8_t rainbow_program[] = PROGRAM(
+    9, OP(MOV, 10, 2), OP(MUL, 10, 3), OPI(LDI, 11, 10), OP(DIV, 10, 11), OP(MOV, 12, 0),
+    OPI(MULI, 12, 360), OP(DIV, 12, 1), OP(ADD, 10, 12), OP(HUE, 0, 10));
+
+static const struct
+{
+    enum ksb_led_pattern native;
+    const uint8_t *program;
+    size_t len;
+} effects[] = {
+    {KSB_PATTERN_BREATHING, breathing_program, sizeof(breathing_program)},
+    {KSB_PATTERN_WAVE, wave_program, sizeof(wave_program)},
+    {KSB_PATTERN_RAINBOW, rainbow_program, sizeof(rainbow_program)},
+};
+
+// Largest channel difference between the two renderings of a frame
+static int frame_diff(enum ksb_led_pattern a, enum ksb_led_pattern b, struct led_rgb *leds,
+                      struct led_rgb *ref, size_t count, uint32_t frame)
+{
+    struct led_layer layer = {.color = {255, 80, 0}, .speed = 50, .opacity = 255};
+    struct led_pattern_instance inst_a = {0};
+    struct led_pattern_instance inst_b = {0};
+    int diff = 0;
+
+    layer.pattern = a;
+    led_pattern_bind(&inst_a, &layer, count);
+    led_pattern_render(&inst_a, ref, frame);
+    layer.pattern = b;
+    led_pattern_bind(&inst_b, &layer, count);
+    led_pattern_render(&inst_b, leds, frame);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        diff = MAX(diff, abs(ref[i].r - leds[i].r));
+        diff = MAX(diff, abs(ref[i].g - leds[i].g));
+        diff = MAX(diff, abs(ref[i].b - leds[i].b));
+    }
+    return diff;
+}
+
+static double time_frames(enum ksb_led_pattern pattern, struct led_rgb *leds, size_t count)
+{
+    struct led_layer layer = {
+        .pattern = pattern,
+        .color = {255, 80, 0},
+        .speed = 50,
+        .opacity = 255,
+    };
+    struct led_pattern_instance inst = {0};
+    uint64_t start = bench_now_ns();
+
+    led_pattern_bind(&inst, &layer, count);
+    for (uint32_t f = 0; f < BENCH_FRAMES; f++)
+    {
+        led_pattern_render(&inst, leds, f);
+        bench_consume(leds);
+    }
+    return (double)(bench_now_ns() - start) / BENCH_FRAMES;
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : 256;
+    struct led_rgb *leds = calloc(count, sizeof(*leds));
+    struct led_rgb *ref = calloc(count, sizeof(*ref));
+
+    if (count == 0 || leds == NULL || ref == NULL)
+    {
+        fprintf(stderr, "usage: %s [pixels]\n", argv[0]);
+        return 2;
+    }
+
+    led_pattern_registry_init();
+
+    for (size_t i = 0; i < ARRAY_SIZE(effects); i++)
+    {
+        if (led_vm_load(effects[i].program, effects[i].len) != 0)
+        {
+            fprintf(stderr, "program for %s rejected\n",
+                    led_pattern_find(effects[i].native)->name);
+            return 1;
+        }
+
+        int diff = frame_diff(effects[i].native, KSB_PATTERN_SCRIPT, leds, ref, count, 100);
+        double native_ns = time_frames(effects[i].native, leds, count);
+        double vm_ns = time_frames(KSB_PATTERN_SCRIPT, leds, count);
+
+        printf("%-10s %zu px: native %8.0f ns/frame, VM %8.0f ns/frame (%.1fx), "
+               "%2d insns, %3zu bytes, max diff %d\n",
+               led_pattern_find(effects[i].native)->name, count, native_ns, vm_ns,
+               vm_ns / native_ns, effects[i].program[3], effects[i].len, diff);
+    }
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * WS2812B SPI symbol encoding (ws2812/ws2812b_spi.c): encodes a strip of
+ * changing pixels through the 4-bit and 3-bit symbol tables, checks the
+ * 3-bit output against a bit-by-bit reference and reports encode throughput,
+ * buffer size and wire time at the overlay SPI frequencies.
+ *
+ * Usage: ws2812b_encode_bench [pixels]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "bench.h"
+#include "ws2812b_symbols.h"
+
+#define BENCH_FRAMES 2000
+
+static uint32_t lut4[256];
+static uint32_t lut3[256];
+
+// The driver encode loop without the shadow skip, every pixel changes
+static void encode4(uint8_t *out, const uint8_t *px, size_t count)
+{
+    for (size_t i = 0; i < count; i++, px += 3, out += 12)
+    {
+        sys_put_be32(lut4[px[1]], out);
+        sys_put_be32(lut4[px[0]], out + 4);
+        sys_put_be32(lut4[px[2]], out + 8);
+    }
+}
+
+static void encode3(uint8_t *out, const uint8_t *px, size_t count)
+{
+    for (size_t i = 0; i < count; i++, px += 3, out += 9)
+    {
+        sys_put_be24(lut3[px[1]], out);
+        sys_put_be24(lut3[px[0]], out + 3);
+        sys_put_be24(lut3[px[2]], out + 6);
+    }
+}
+
+// One symbol per data bit, written out bit by bit
+static int check3(const uint8_t *out, const uint8_t *px, size_t count)
+{
+    static const uint8_t order[] = {1, 0, 2};
+    size_t bit = 0;
+
+    for (size_t i = 0; i < count * 3; i++)
+    {
+        uint8_t v = px[(i / 3) * 3 + order[i % 3]];
+
+        for (int b = 7; b >= 0; b--)
+        {
+            uint8_t sym = ((v >> b) & 1) ? 0x6 : 0x4;
+
+            for (int s = 2; s >= 0; s--, bit++)
+            {
+                if (((out[bit / 8] >> (7 - bit % 8)) & 1) != ((sym >> s) & 1))
+                {
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static double time_frames(void (*fn)(uint8_t *, const uint8_t *, size_t), uint8_t *out,
+                          uint8_t *px, size_t count)
+{
+    uint64_t start = bench_now_ns();
+
+    for (uint32_t f = 0; f < BENCH_FRAMES; f++)
+    {
+        px[(f * 7) % (count * 3)] += f;
+        fn(out, px, count);
+        bench_consume(out);
+    }
+    return (double)(bench_now_ns() - start) / BENCH_FRAMES;
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : 256;
+    uint8_t *px = malloc(count * 3);
+    uint8_t *out = malloc(count * 12);
+
+    if (count == 0 || px == NULL || out == NULL)
+    {
+        fprintf(stderr, "usage: %s [pixels]\n", argv[0]);
+        return 2;
+    }
+
+    for (int b = 0; b < 256; b++)
+    {
+        lut4[b] = WS2812B_ENC4(b, _);
+        lut3[b] = WS2812B_ENC3(b, _);
+    }
+    for (size_t i = 0; i < count * 3; i++)
+    {
+        px[i] = rand();
+    }
+
+    encode3(out, px, count);
+    if (check3(out, px, count) != 0)
+    {
+        fprintf(stderr, "3-bit symbols do not match the reference\n");
+        return 1;
+    }
+
+    static const struct
+    {
+        const char *name;
+        void (*fn)(uint8_t *, const uint8_t *, size_t);
+        size_t pixel_len;
+        double hz;
+    } modes[] = {
+        {"4-bit", encode4, 12, 4000000.0},
+        {"3-bit", encode3, 9, 3200000.0},
+    };
+
+    for (size_t m = 0; m < ARRAY_SIZE(modes); m++)
+    {
+        double ns = time_frames(modes[m].fn, out, px, count);
+        size_t bytes = count * modes[m].pixel_len;
+
+        printf("%s %zu px: encode %8.0f ns/frame (%.1f px/us), %6zu bytes, "
+               "wire %7.1f us at %.1f MHz\n",
+               modes[m].name, count, ns, count * 1000.0 / ns, bytes,
+               bytes * 8 * 1e6 / modes[m].hz, modes[m].hz / 1e6);
+    }
+
+    return 0;
+}
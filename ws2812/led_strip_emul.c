@@ -0,0 +1,295 @@
+#define DT_DRV_COMPAT ksb_led_strip_emul
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/led_strip.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "led_strip_emul.h"
+
+#ifdef CONFIG_ARCH_POSIX
+#include "cmdline.h"
+#include "posix_native_task.h"
+#include "led_strip_emul_native.h"
+#endif
+
+LOG_MODULE_REGISTER(led_strip_emul, CONFIG_LOG_DEFAULT_LEVEL);
+
+struct led_strip_emul_config
+{
+    size_t length;
+    uint32_t bit_period_ns;
+    uint32_t reset_us;
+    uint32_t depth;
+    uint8_t ordinal;
+    /* depth frames of length pixels, plus their metadata */
+    struct led_rgb *ring;
+    struct led_strip_emul_frame *frames;
+    /* One capture record: header then the latched chain */
+    uint8_t *record;
+};
+
+struct led_strip_emul_data
+{
+    struct k_spinlock lock;
+    /* What the chain currently shows */
+    struct led_rgb *latched;
+    uint32_t seq;
+    uint64_t last_latch_us;
+    int32_t last_interval_us;
+    uint64_t interval_sum_us;
+    uint32_t jitter_x16;
+    struct led_strip_emul_stats stats;
+};
+
+#ifdef CONFIG_ARCH_POSIX
+static const char *capture_path;
+static int capture_fd = -1;
+
+static void led_strip_emul_options(void)
+{
+    static struct args_struct_t options[] = {
+        {.option = "ledstrip-capture",
+         .name = "path",
+         .type = 's',
+         .dest = (void *)&capture_path,
+         .descript = "Write every frame shown by the emulated LED strips to this file"},
+        ARG_TABLE_ENDMARKER,
+    };
+
+    native_add_command_line_opts(options);
+}
+
+static void led_strip_emul_cleanup(void)
+{
+    if (capture_fd >= 0)
+    {
+        led_strip_emul_capture_close(capture_fd);
+        capture_fd = -1;
+    }
+}
+
+NATIVE_TASK(led_strip_emul_options, PRE_BOOT_1, 1);
+NATIVE_TASK(led_strip_emul_cleanup, ON_EXIT, 1);
+
+static void led_strip_emul_capture(const struct led_strip_emul_config *cfg,
+                                   struct led_strip_emul_data *data,
+                                   const struct led_strip_emul_frame *frame)
+{
+    uint8_t *rec = cfg->record;
+    uint8_t *out = rec + LED_STRIP_EMUL_RECORD_HEADER;
+
+    if (capture_fd < 0)
+    {
+        return;
+    }
+
+    sys_put_le32(frame->seq, rec);
+    sys_put_le64(frame->latch_us, rec + 4);
+    sys_put_le32(frame->wire_us, rec + 12);
+    sys_put_le16(frame->sent, rec + 16);
+    sys_put_le16(cfg->length, rec + 18);
+    rec[20] = cfg->ordinal;
+    rec[21] = 0;
+
+    for (size_t i = 0; i < cfg->length; i++)
+    {
+        *out++ = data->latched[i].r;
+        *out++ = data->latched[i].g;
+        *out++ = data->latched[i].b;
+    }
+
+    if (led_strip_emul_capture_write(capture_fd, rec, out - rec) != 0)
+    {
+        data->stats.capture_errors++;
+    }
+}
+#endif
+
+static uint64_t led_strip_emul_now_us(void)
+{
+    return k_ticks_to_us_near64(k_uptime_ticks());
+}
+
+static void led_strip_emul_account(struct led_strip_emul_data *data, uint64_t latch_us)
+{
+    struct led_strip_emul_stats *st = &data->stats;
+
+    if (st->frames > 1)
+    {
+        int32_t interval = latch_us - data->last_latch_us;
+
+        st->interval_min_us = MIN(st->interval_min_us, (uint32_t)interval);
+        st->interval_max_us = MAX(st->interval_max_us, (uint32_t)interval);
+        data->interval_sum_us += interval;
+        st->interval_avg_us = data->interval_sum_us / (st->frames - 1);
+
+        // RFC 3550 interarrival jitter: J += (|D| - J) / 16, kept in 1/16 us
+        if (st->frames > 2)
+        {
+            int32_t d = abs(interval - data->last_interval_us);
+
+            data->jitter_x16 += d - ((data->jitter_x16 + 8) >> 4);
+            st->jitter_us = (data->jitter_x16 + 8) >> 4;
+        }
+        data->last_interval_us = interval;
+    }
+    else
+    {
+        st->interval_min_us = UINT32_MAX;
+    }
+
+    data->last_latch_us = latch_us;
+}
+
+static int led_strip_emul_update_rgb(const struct device *dev, struct led_rgb *pixels,
+                                     size_t num_pixels)
+{
+    const struct led_strip_emul_config *cfg = dev->config;
+    struct led_strip_emul_data *data = dev->data;
+    size_t count = MIN(num_pixels, cfg->length);
+    uint32_t wire_us = DIV_ROUND_UP((uint64_t)count * 24 * cfg->bit_period_ns, NSEC_PER_USEC) +
+                       cfg->reset_us;
+
+    // The caller is blocked while the bus would be busy, as with a DMA transfer
+    k_sleep(K_USEC(wire_us));
+
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    uint32_t slot = data->seq % cfg->depth;
+    struct led_strip_emul_frame *frame = &cfg->frames[slot];
+
+    memcpy(data->latched, pixels, count * sizeof(struct led_rgb));
+    memcpy(&cfg->ring[slot * cfg->length], data->latched, cfg->length * sizeof(struct led_rgb));
+
+    frame->seq = data->seq++;
+    frame->latch_us = led_strip_emul_now_us();
+    frame->wire_us = wire_us;
+    frame->sent = count;
+
+    data->stats.frames++;
+    data->stats.pixels_sent += count;
+    data->stats.wire_us += wire_us;
+    led_strip_emul_account(data, frame->latch_us);
+    k_spin_unlock(&data->lock, key);
+
+#ifdef CONFIG_ARCH_POSIX
+    led_strip_emul_capture(cfg, data, frame);
+#endif
+    return 0;
+}
+
+static size_t led_strip_emul_length(const struct device *dev)
+{
+    const struct led_strip_emul_config *cfg = dev->config;
+
+    return cfg->length;
+}
+
+static const struct led_strip_driver_api led_strip_emul_api = {
+    .update_rgb = led_strip_emul_update_rgb,
+    .length = led_strip_emul_length,
+};
+
+int led_strip_emul_get_frame(const struct device *dev, uint32_t age,
+                             struct led_strip_emul_frame *frame,
+                             struct led_rgb *pixels, size_t count)
+{
+    const struct led_strip_emul_config *cfg = dev->config;
+    struct led_strip_emul_data *data = dev->data;
+    int ret = 0;
+
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    if (age >= data->seq || age >= cfg->depth)
+    {
+        ret = -ENOENT;
+    }
+    else
+    {
+        uint32_t slot = (data->seq - 1 - age) % cfg->depth;
+
+        *frame = cfg->frames[slot];
+        memcpy(pixels, &cfg->ring[slot * cfg->length],
+               MIN(count, cfg->length) * sizeof(struct led_rgb));
+    }
+
+    k_spin_unlock(&data->lock, key);
+    return ret;
+}
+
+void led_strip_emul_get_stats(const struct device *dev, struct led_strip_emul_stats *stats)
+{
+    struct led_strip_emul_data *data = dev->data;
+
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    *stats = data->stats;
+    k_spin_unlock(&data->lock, key);
+
+    if (stats->interval_min_us == UINT32_MAX)
+    {
+        stats->interval_min_us = 0;
+    }
+}
+
+static int led_strip_emul_init(const struct device *dev)
+{
+    const struct led_strip_emul_config *cfg = dev->config;
+
+#ifdef CONFIG_ARCH_POSIX
+    if (capture_path != NULL && capture_fd < 0)
+    {
+        capture_fd = led_strip_emul_capture_open(capture_path);
+        if (capture_fd < 0)
+        {
+            LOG_ERR("Cannot open capture file %s: %d", capture_path, capture_fd);
+        }
+        else
+        {
+            LOG_INF("Capturing LED frames to %s", capture_path);
+        }
+    }
+#endif
+
+    LOG_INF("%s: %zu emulated pixels, %u us per full frame", dev->name, cfg->length,
+            (uint32_t)DIV_ROUND_UP((uint64_t)cfg->length * 24 * cfg->bit_period_ns,
+                                   NSEC_PER_USEC) + cfg->reset_us);
+    return 0;
+}
+
+#define LED_STRIP_EMUL_LENGTH(inst) DT_INST_PROP(inst, chain_length)
+#define LED_STRIP_EMUL_DEPTH(inst) DT_INST_PROP(inst, capture_depth)
+
+#define LED_STRIP_EMUL_DEVICE(inst)                                                            \
+    BUILD_ASSERT(LED_STRIP_EMUL_LENGTH(inst) <= CONFIG_WS2812B_MAX_PIXELS,                     \
+                 "chain-length exceeds CONFIG_WS2812B_MAX_PIXELS");                            \
+    BUILD_ASSERT(LED_STRIP_EMUL_DEPTH(inst) > 0, "capture-depth must be at least 1");          \
+                                                                                               \
+    static struct led_rgb led_strip_emul_latched_##inst[LED_STRIP_EMUL_LENGTH(inst)];          \
+    static struct led_rgb                                                                      \
+        led_strip_emul_ring_##inst[LED_STRIP_EMUL_DEPTH(inst) * LED_STRIP_EMUL_LENGTH(inst)];  \
+    static struct led_strip_emul_frame led_strip_emul_frames_##inst[LED_STRIP_EMUL_DEPTH(inst)]; \
+    static uint8_t led_strip_emul_record_##inst[LED_STRIP_EMUL_RECORD_HEADER +                 \
+                                                3 * LED_STRIP_EMUL_LENGTH(inst)];              \
+                                                                                               \
+    static const struct led_strip_emul_config led_strip_emul_config_##inst = {                 \
+        .length = LED_STRIP_EMUL_LENGTH(inst),                                                 \
+        .bit_period_ns = DT_INST_PROP(inst, bit_period_ns),                                    \
+        .reset_us = DT_INST_PROP_OR(inst, reset_delay, CONFIG_WS2812B_RESET_DELAY),            \
+        .depth = LED_STRIP_EMUL_DEPTH(inst),                                                   \
+        .ordinal = inst,                                                                       \
+        .ring = led_strip_emul_ring_##inst,                                                    \
+        .frames = led_strip_emul_frames_##inst,                                                \
+        .record = led_strip_emul_record_##inst,                                                \
+    };                                                                                         \
+                                                                                               \
+    static struct led_strip_emul_data led_strip_emul_data_##inst = {                           \
+        .latched = led_strip_emul_latched_##inst,                                              \
+    };                                                                                         \
+                                                                                               \
+    DEVICE_DT_INST_DEFINE(inst, led_strip_emul_init, NULL, &led_strip_emul_data_##inst,        \
+                          &led_strip_emul_config_##inst, POST_KERNEL,                          \
+                          CONFIG_LED_STRIP_INIT_PRIORITY, &led_strip_emul_api);
+
+DT_INST_FOREACH_STATUS_OKAY(LED_STRIP_EMUL_DEVICE)
@@ -0,0 +1,44 @@
+#pragma once
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/led_strip.h>
+
+/*
+ * Emulated "ksb,led-strip-emul" strip. A frame is what the strip shows
+ * after an update latched: pixels past the sent prefix keep their colors.
+ *
+ * Capture file (--ledstrip-capture=<file>, little-endian): for every frame
+ *   u32 sequence, u64 latch time (us), u32 wire time (us), u16 pixels
+ *   sent, u16 chain length, u8 strip (device ordinal), u8 reserved,
+ *   then chain length RGB triplets
+ */
+
+#define LED_STRIP_EMUL_RECORD_HEADER 22
+
+struct led_strip_emul_frame
+{
+    uint32_t seq;      /* Update number, from 0 */
+    uint64_t latch_us; /* Uptime when the frame latched */
+    uint32_t wire_us;  /* Modelled transmission time */
+    uint16_t sent;     /* Pixels clocked out by the update */
+};
+
+struct led_strip_emul_stats
+{
+    uint32_t frames;          /* Updates received */
+    uint64_t pixels_sent;     /* Pixels clocked out */
+    uint64_t wire_us;         /* Total modelled transmission time */
+    uint32_t interval_min_us; /* Shortest time between two latches */
+    uint32_t interval_max_us; /* Longest time between two latches */
+    uint32_t interval_avg_us; /* Mean time between latches, 1e6 / fps */
+    uint32_t jitter_us;       /* Smoothed frame interval variation (RFC 3550) */
+    uint32_t capture_errors;  /* Frames that could not be written to the capture file */
+};
+
+/* Get a recent frame, age 0 is the last one. Copies at most count pixels.
+ * Returns -ENOENT if the frame is no longer (or not yet) in the ring. */
+int led_strip_emul_get_frame(const struct device *dev, uint32_t age,
+                             struct led_strip_emul_frame *frame,
+                             struct led_rgb *pixels, size_t count);
+
+void led_strip_emul_get_stats(const struct device *dev, struct led_strip_emul_stats *stats);
@@ -0,0 +1,43 @@
+/*
+ * Host side of the emulated strip capture. Built into the native simulator
+ * runner with the host C library, so the capture can go to a regular file,
+ * a FIFO or a file in /dev/shm that a test reads while the app runs.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "led_strip_emul_native.h"
+
+int led_strip_emul_capture_open(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    return fd < 0 ? -errno : fd;
+}
+
+int led_strip_emul_capture_write(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+void led_strip_emul_capture_close(int fd)
+{
+    close(fd);
+}
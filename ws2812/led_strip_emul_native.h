@@ -0,0 +1,7 @@
+#pragma once
+/* Host side of the emulated strip capture, built with the host libc */
+#include <stddef.h>
+
+int led_strip_emul_capture_open(const char *path);
+int led_strip_emul_capture_write(int fd, const void *buf, size_t len);
+void led_strip_emul_capture_close(int fd);
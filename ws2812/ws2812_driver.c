@@ -1,120 +1,455 @@
 #include "ws2812_driver.h"
+#include <zephyr/devicetree.h>
 #include <zephyr/logging/log.h>
-#include <zephyr/random/random.h>
+#include <string.h>
+#include "led_math.h"
 
 LOG_MODULE_REGISTER(ws2812_drv, CONFIG_LOG_DEFAULT_LEVEL);
 
-int ws2812_init(struct ws2812_driver *drv, const char *label)
+struct ws2812_segment_config
+{
+    const struct device *dev;
+    size_t offset;
+    size_t length;
+    bool reverse;
+};
+
+/*
+ * Canvas layout: a "ksb,led-canvas" node maps canvas ranges onto led_strip
+ * devices, otherwise the ledstrip alias is the whole canvas.
+ */
+#define WS2812_CANVAS_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(ksb_led_canvas)
+
+#if DT_NODE_EXISTS(WS2812_CANVAS_NODE)
+#define WS2812_SEGMENT_CONFIG(node)                           \
+    {                                                         \
+        .dev = DEVICE_DT_GET(DT_PHANDLE(node, led_strip)),    \
+        .offset = DT_PROP(node, offset),                      \
+        .length = DT_PROP(node, length),                      \
+        .reverse = DT_PROP(node, reverse),                    \
+    },
+
+static const struct ws2812_segment_config segment_configs[] = {
+    DT_FOREACH_CHILD_STATUS_OKAY(WS2812_CANVAS_NODE, WS2812_SEGMENT_CONFIG)};
+#else
+static const struct ws2812_segment_config segment_configs[] = {
+    {.dev = DEVICE_DT_GET(DT_ALIAS(ledstrip)), .offset = 0, .length = 0, .reverse = false},
+};
+#endif
+
+BUILD_ASSERT(ARRAY_SIZE(segment_configs) <= WS2812_MAX_SEGMENTS,
+             "More canvas segments than CONFIG_WS2812B_MAX_SEGMENTS");
+
+static void ws2812_reverse(struct led_rgb *pixels, size_t count)
+{
+    for (size_t i = 0, j = count - 1; i < j; i++, j--)
+    {
+        struct led_rgb tmp = pixels[i];
+        pixels[i] = pixels[j];
+        pixels[j] = tmp;
+    }
+}
+
+// One transmit thread per segment so strips on separate buses update concurrently
+static void ws2812_segment_thread(void *arg1, void *arg2, void *arg3)
+{
+    struct ws2812_driver *drv = arg1;
+    struct ws2812_segment *seg = arg2;
+
+    while (drv->running)
+    {
+        k_sem_take(&seg->start, K_FOREVER);
+
+        struct led_rgb *buf = drv->tx_buf + seg->offset;
+        size_t count = 0;
+
+        if (seg->offset < drv->tx_count)
+        {
+            // A reversed strip is clocked from the far end of its range
+            count = seg->reverse ? seg->length : MIN(seg->length, drv->tx_count - seg->offset);
+        }
+
+        if (count > 0)
+        {
+            uint32_t start = k_cycle_get_32();
+
+            if (seg->reverse)
+            {
+                ws2812_reverse(buf, count);
+            }
+            led_strip_update_rgb(seg->dev, buf, count);
+            if (seg->reverse && drv->tx_preserve)
+            {
+                ws2812_reverse(buf, count);
+            }
+
+            seg->tx_us = k_cyc_to_us_near32(k_cycle_get_32() - start);
+        }
+
+        seg->tx_pixels += count;
+        seg->full_pixels += seg->length;
+
+        // Last segment to finish completes the frame
+        if (atomic_dec(&drv->tx_remaining) == 1)
+        {
+            drv->tx_us = k_cyc_to_us_near32(k_cycle_get_32() - drv->tx_start);
+            k_sem_give(&drv->tx_idle);
+        }
+    }
+}
+
+// Kick all segments on a buffer, tx_idle must be held by the caller
+static void ws2812_start_tx(struct ws2812_driver *drv, struct led_rgb *buf,
+                            size_t count, bool preserve)
+{
+    drv->tx_buf = buf;
+    drv->tx_count = MIN(count, drv->num_leds);
+    drv->tx_preserve = preserve;
+    drv->tx_start = k_cycle_get_32();
+    atomic_set(&drv->tx_remaining, drv->num_segments);
+
+    for (size_t i = 0; i < drv->num_segments; i++)
+    {
+        k_sem_give(&drv->segments[i].start);
+    }
+}
+
+// Synchronous push of the current draw buffer, used by the blocking effects
+static void ws2812_show(struct ws2812_driver *drv)
+{
+    k_sem_take(&drv->tx_idle, K_FOREVER);
+    ws2812_start_tx(drv, drv->pixels, drv->num_leds, true);
+    ws2812_flush(drv);
+}
+
+static int ws2812_segment_init(struct ws2812_driver *drv, struct ws2812_segment *seg,
+                               const struct ws2812_segment_config *cfg)
 {
-    drv->dev = DEVICE_DT_GET(DT_ALIAS(ledstrip));
-    if (!drv->dev || !device_is_ready(drv->dev))
+    if (!device_is_ready(cfg->dev))
     {
-        LOG_ERR("WS2812 device not ready");
+        LOG_ERR("LED strip %s not ready", cfg->dev->name);
         return -ENODEV;
     }
+
+    size_t chain = led_strip_length(cfg->dev);
+
+    seg->dev = cfg->dev;
+    seg->offset = cfg->offset;
+    seg->length = cfg->length ? MIN(cfg->length, chain) : chain;
+    seg->reverse = cfg->reverse;
+
+    if (seg->length == 0 || seg->offset + seg->length > WS2812_MAX_LEDS)
+    {
+        LOG_ERR("Segment %s [%zu, +%zu) does not fit CONFIG_WS2812B_MAX_PIXELS",
+                cfg->dev->name, seg->offset, seg->length);
+        return -EINVAL;
+    }
+
+    k_sem_init(&seg->start, 0, 1);
+    k_thread_create(&seg->thread, seg->stack,
+                    K_KERNEL_STACK_SIZEOF(seg->stack),
+                    ws2812_segment_thread, drv, seg, NULL,
+                    6, 0, K_NO_WAIT);
+    k_thread_name_set(&seg->thread, "ws2812_tx");
+
+    LOG_INF("Segment %s: canvas [%zu, +%zu)%s", cfg->dev->name,
+            seg->offset, seg->length, seg->reverse ? " reversed" : "");
+    return 0;
+}
+
+int ws2812_init(struct ws2812_driver *drv, const char *label)
+{
+    int ret;
+
+    drv->back = 0;
+    drv->pixels = drv->buffers[0];
+    drv->num_leds = 0;
+    drv->num_segments = 0;
     drv->running = true;
+    k_sem_init(&drv->tx_idle, 1, 1);
+
+    for (size_t i = 0; i < ARRAY_SIZE(segment_configs); i++)
+    {
+        struct ws2812_segment *seg = &drv->segments[i];
+
+        ret = ws2812_segment_init(drv, seg, &segment_configs[i]);
+        if (ret != 0)
+        {
+            drv->running = false;
+            return ret;
+        }
+
+        drv->num_leds = MAX(drv->num_leds, seg->offset + seg->length);
+        drv->num_segments++;
+    }
+
+    drv->dev = drv->segments[0].dev;
+
     ws2812_clear(drv);
-    LOG_INF("WS2812 driver init ok");
+    LOG_INF("WS2812 driver init ok: %zu LEDs on %zu strips", drv->num_leds, drv->num_segments);
     return 0;
 }
 
+void ws2812_submit(struct ws2812_driver *drv, size_t count)
+{
+    // Wait for the previous frame to leave the front buffer
+    k_sem_take(&drv->tx_idle, K_FOREVER);
+
+    struct led_rgb *front = drv->pixels;
+
+    drv->back ^= 1;
+    drv->pixels = drv->buffers[drv->back];
+
+    // The front buffer is redrawn from scratch next time, segments may reorder it in place
+    ws2812_start_tx(drv, front, count, false);
+}
+
+void ws2812_flush(struct ws2812_driver *drv)
+{
+    k_sem_take(&drv->tx_idle, K_FOREVER);
+    k_sem_give(&drv->tx_idle);
+}
+
+void ws2812_get_tx_stats(const struct ws2812_driver *drv, struct ws2812_tx_stats *stats)
+{
+    stats->pixels_sent = 0;
+    stats->pixels_full = 0;
+
+    for (size_t i = 0; i < drv->num_segments; i++)
+    {
+        stats->pixels_sent += drv->segments[i].tx_pixels;
+        stats->pixels_full += drv->segments[i].full_pixels;
+    }
+}
+
 void ws2812_clear(struct ws2812_driver *drv)
 {
     struct led_rgb black = {0, 0, 0};
-    for (int i = 0; i < WS2812_NUM_LEDS; i++)
+    for (int i = 0; i < drv->num_leds; i++)
         drv->pixels[i] = black;
-    led_strip_update_rgb(drv->dev, drv->pixels, WS2812_NUM_LEDS);
+    ws2812_show(drv);
 }
 
 void ws2812_set_all(struct ws2812_driver *drv, struct led_rgb color)
 {
-    for (int i = 0; i < WS2812_NUM_LEDS; i++)
+    for (int i = 0; i < drv->num_leds; i++)
         drv->pixels[i] = color;
-    led_strip_update_rgb(drv->dev, drv->pixels, WS2812_NUM_LEDS);
+    ws2812_show(drv);
 }
 
-void ws2812_running_light(struct ws2812_driver *drv, struct led_rgb color, uint32_t delay_ms, uint32_t duration_ms)
+static void ws2812_effect_start(struct ws2812_effect *fx, struct ws2812_driver *drv,
+                                enum ws2812_effect_type type, struct led_rgb color,
+                                uint32_t period_ms, uint32_t duration_ms)
 {
-    uint32_t end = k_uptime_get_32() + duration_ms;
-    while (k_uptime_get_32() < end && drv->running)
-    {
-        ws2812_clear(drv);
-        for (int i = 0; i < WS2812_NUM_LEDS && drv->running; i++)
-        {
-            drv->pixels[i] = color;
-            led_strip_update_rgb(drv->dev, drv->pixels, WS2812_NUM_LEDS);
-            k_msleep(delay_ms);
-            drv->pixels[i] = (struct led_rgb){0, 0, 0};
-        }
-    }
-    ws2812_clear(drv);
+    uint32_t now = k_uptime_get_32();
+
+    *fx = (struct ws2812_effect){
+        .drv = drv,
+        .type = type,
+        .color = color,
+        .period_ms = MAX(period_ms, 1),
+        .end_ms = now + duration_ms,
+        .next_ms = now,
+        .wheel = {255, 0, 0},
+    };
 }
 
-void ws2812_breathing(struct ws2812_driver *drv, struct led_rgb color, uint32_t duration_ms)
+void ws2812_effect_running_light(struct ws2812_effect *fx, struct ws2812_driver *drv,
+                                 struct led_rgb color, uint32_t delay_ms, uint32_t duration_ms)
+{
+    ws2812_effect_start(fx, drv, WS2812_EFFECT_RUNNING_LIGHT, color, delay_ms, duration_ms);
+}
+
+void ws2812_effect_breathing(struct ws2812_effect *fx, struct ws2812_driver *drv,
+                             struct led_rgb color, uint32_t duration_ms)
+{
+    ws2812_effect_start(fx, drv, WS2812_EFFECT_BREATHING, color, 20, duration_ms);
+}
+
+void ws2812_effect_rainbow(struct ws2812_effect *fx, struct ws2812_driver *drv,
+                           uint32_t delay_ms, uint32_t duration_ms)
+{
+    ws2812_effect_start(fx, drv, WS2812_EFFECT_RAINBOW, (struct led_rgb){0}, delay_ms, duration_ms);
+}
+
+void ws2812_effect_sparkle(struct ws2812_effect *fx, struct ws2812_driver *drv,
+                           struct led_rgb color, uint32_t seed,
+                           uint32_t delay_ms, uint32_t duration_ms)
+{
+    ws2812_effect_start(fx, drv, WS2812_EFFECT_SPARKLE, color, delay_ms, duration_ms);
+    fx->seed = seed;
+}
+
+// Breathing ramps in steps of 5: 52 steps from 0 up to 255, 50 back down to 5
+#define BREATHING_STEP 5
+#define BREATHING_RISE (255 / BREATHING_STEP + 1)
+#define BREATHING_CYCLE (2 * BREATHING_RISE - 2)
+
+static uint8_t breathing_level(uint32_t step)
 {
-    uint32_t end = k_uptime_get_32() + duration_ms;
-    uint8_t max_brightness = 255, step = 5;
+    uint32_t p = step % BREATHING_CYCLE;
 
-    while (k_uptime_get_32() < end && drv->running)
+    return p < BREATHING_RISE ? p * BREATHING_STEP : 255 - (p - BREATHING_RISE + 1) * BREATHING_STEP;
+}
+
+// Advance the color wheel by one pixel
+static void rainbow_advance(struct led_rgb *c)
+{
+    if (c->r == 255 && c->g < 255 && c->b == 0)
+        c->g += 5;
+    else if (c->g == 255 && c->r > 0)
+        c->r -= 5;
+    else if (c->g == 255 && c->b < 255)
+        c->b += 5;
+    else if (c->b == 255 && c->g > 0)
+        c->g -= 5;
+    else if (c->b == 255 && c->r < 255)
+        c->r += 5;
+    else if (c->r == 255 && c->b > 0)
+        c->b -= 5;
+}
+
+bool ws2812_effect_step(struct ws2812_effect *fx)
+{
+    struct ws2812_driver *drv = fx->drv;
+    struct led_rgb *pixels = drv->pixels;
+    size_t n = drv->num_leds;
+
+    if (fx->done)
+    {
+        return false;
+    }
+
+    // Every step redraws the whole canvas, so the asynchronous double buffer can be used
+    if (!drv->running || (int32_t)(k_uptime_get_32() - fx->end_ms) >= 0)
     {
-        for (uint8_t b = 0; b <= max_brightness && drv->running; b += step)
+        memset(pixels, 0, n * sizeof(struct led_rgb));
+        ws2812_submit(drv, n);
+        fx->done = true;
+        return false;
+    }
+
+    switch (fx->type)
+    {
+    case WS2812_EFFECT_RUNNING_LIGHT:
+        memset(pixels, 0, n * sizeof(struct led_rgb));
+        pixels[fx->step % n] = fx->color;
+        break;
+
+    case WS2812_EFFECT_BREATHING:
+    {
+        struct led_rgb c = ksb_scale_rgb(fx->color, breathing_level(fx->step));
+
+        for (size_t i = 0; i < n; i++)
+            pixels[i] = c;
+        break;
+    }
+
+    case WS2812_EFFECT_RAINBOW:
+        for (size_t i = 0; i < n; i++)
         {
-            struct led_rgb c = {(color.r * b) / 255, (color.g * b) / 255, (color.b * b) / 255};
-            ws2812_set_all(drv, c);
-            k_msleep(20);
+            pixels[i] = fx->wheel;
+            rainbow_advance(&fx->wheel);
         }
-        for (uint8_t b = max_brightness; b > 0 && drv->running; b -= step)
+        break;
+
+    case WS2812_EFFECT_SPARKLE:
+    {
+        uint32_t key = ksb_rand32(fx->seed, fx->step);
+        uint32_t sparks = DIV_ROUND_UP(n, 3);
+
+        memset(pixels, 0, n * sizeof(struct led_rgb));
+        for (uint32_t i = 0; i < sparks; i++)
         {
-            struct led_rgb c = {(color.r * b) / 255, (color.g * b) / 255, (color.b * b) / 255};
-            ws2812_set_all(drv, c);
-            k_msleep(20);
+            pixels[ksb_rand_range(ksb_rand32(key, i), n)] = fx->color;
         }
+        break;
     }
-    ws2812_clear(drv);
+    }
+
+    ws2812_submit(drv, n);
+    fx->step++;
+    return true;
 }
 
-void ws2812_rainbow(struct ws2812_driver *drv, uint32_t delay_ms, uint32_t duration_ms)
+int32_t ws2812_effect_poll(struct ws2812_effect *effects, size_t count)
 {
-    uint32_t end = k_uptime_get_32() + duration_ms;
-    uint8_t r = 255, g = 0, b = 0;
+    uint32_t now = k_uptime_get_32();
+    int32_t wait = -1;
 
-    while (k_uptime_get_32() < end && drv->running)
+    for (size_t i = 0; i < count; i++)
     {
-        for (int i = 0; i < WS2812_NUM_LEDS; i++)
+        struct ws2812_effect *fx = &effects[i];
+
+        if (fx->done)
+        {
+            continue;
+        }
+
+        if ((int32_t)(now - fx->next_ms) >= 0)
         {
-            drv->pixels[i] = (struct led_rgb){r, g, b};
-            if (r == 255 && g < 255 && b == 0)
-                g += 5;
-            else if (g == 255 && r > 0)
-                r -= 5;
-            else if (g == 255 && b < 255)
-                b += 5;
-            else if (b == 255 && g > 0)
-                g -= 5;
-            else if (b == 255 && r < 255)
-                r += 5;
-            else if (r == 255 && b > 0)
-                b -= 5;
+            ws2812_effect_step(fx);
+
+            // Keep a fixed cadence, but do not try to catch up after a stall
+            fx->next_ms += fx->period_ms;
+            if ((int32_t)(now - fx->next_ms) >= 0)
+            {
+                fx->next_ms = now + fx->period_ms;
+            }
+
+            if (fx->done)
+            {
+                continue;
+            }
         }
-        led_strip_update_rgb(drv->dev, drv->pixels, WS2812_NUM_LEDS);
-        k_msleep(delay_ms);
+
+        int32_t due = (int32_t)(fx->next_ms - now);
+        wait = (wait < 0) ? due : MIN(wait, due);
     }
-    ws2812_clear(drv);
+
+    return wait;
 }
 
-void ws2812_sparkle(struct ws2812_driver *drv, struct led_rgb color, uint32_t delay_ms, uint32_t duration_ms)
+static void ws2812_effect_run(struct ws2812_effect *fx)
 {
-    uint32_t end = k_uptime_get_32() + duration_ms;
-    while (k_uptime_get_32() < end && drv->running)
+    int32_t wait;
+
+    while ((wait = ws2812_effect_poll(fx, 1)) >= 0)
     {
-        ws2812_clear(drv);
-        for (int i = 0; i < WS2812_NUM_LEDS / 3; i++)
-        {
-            int led = sys_rand32_get() % WS2812_NUM_LEDS;
-            drv->pixels[led] = color;
-        }
-        led_strip_update_rgb(drv->dev, drv->pixels, WS2812_NUM_LEDS);
-        k_msleep(delay_ms);
+        k_msleep(wait);
     }
-    ws2812_clear(drv);
-}
\ No newline at end of file
+    ws2812_flush(fx->drv);
+}
+
+void ws2812_running_light(struct ws2812_driver *drv, struct led_rgb color, uint32_t delay_ms, uint32_t duration_ms)
+{
+    struct ws2812_effect fx;
+
+    ws2812_effect_running_light(&fx, drv, color, delay_ms, duration_ms);
+    ws2812_effect_run(&fx);
+}
+
+void ws2812_breathing(struct ws2812_driver *drv, struct led_rgb color, uint32_t duration_ms)
+{
+    struct ws2812_effect fx;
+
+    ws2812_effect_breathing(&fx, drv, color, duration_ms);
+    ws2812_effect_run(&fx);
+}
+
+void ws2812_rainbow(struct ws2812_driver *drv, uint32_t delay_ms, uint32_t duration_ms)
+{
+    struct ws2812_effect fx;
+
+    ws2812_effect_rainbow(&fx, drv, delay_ms, duration_ms);
+    ws2812_effect_run(&fx);
+}
+
+void ws2812_sparkle(struct ws2812_driver *drv, struct led_rgb color, uint32_t seed,
+                    uint32_t delay_ms, uint32_t duration_ms)
+{
+    struct ws2812_effect fx;
+
+    ws2812_effect_sparkle(&fx, drv, color, seed, delay_ms, duration_ms);
+    ws2812_effect_run(&fx);
+}
@@ -4,24 +4,118 @@
 #include <zephyr/drivers/led_strip.h>
 #include <zephyr/random/random.h>
 
-#define WS2812_NUM_LEDS 8
+/* Buffers are sized for the longest chain, the attached chain length is read at init */
+#define WS2812_MAX_LEDS CONFIG_WS2812B_MAX_PIXELS
+#define WS2812_MAX_SEGMENTS CONFIG_WS2812B_MAX_SEGMENTS
+
+/* Canvas segment: a range of the canvas driven by one led_strip device */
+struct ws2812_segment
+{
+    const struct device *dev;
+    size_t offset;
+    size_t length;
+    bool reverse;
+    uint32_t tx_us;
+    /* Pixels sent, and pixels a full push of every update would have sent */
+    uint64_t tx_pixels;
+    uint64_t full_pixels;
+    struct k_sem start;
+    struct k_thread thread;
+    K_KERNEL_STACK_MEMBER(stack, 1024);
+};
 
 struct ws2812_driver
 {
     const struct device *dev;
-    struct led_rgb pixels[WS2812_NUM_LEDS];
+    /* Two canvas buffers: one being drawn (pixels), one being transmitted */
+    struct led_rgb buffers[2][WS2812_MAX_LEDS];
+    struct led_rgb *pixels;
+    size_t num_leds;
+    uint8_t back;
+    struct ws2812_segment segments[WS2812_MAX_SEGMENTS];
+    size_t num_segments;
+    struct led_rgb *tx_buf;
+    size_t tx_count;
+    bool tx_preserve;
+    uint32_t tx_start;
+    uint32_t tx_us;
+    atomic_t tx_remaining;
+    struct k_sem tx_idle;
     volatile bool running;
 };
 
 /* Init */
 int ws2812_init(struct ws2812_driver *drv, const char *label);
 
+/* Double buffering: draw into drv->pixels, then submit it for transmission.
+ * Submit swaps buffers and returns as soon as the previous frame is out,
+ * so rendering the next frame overlaps sending this one. All segments of
+ * the canvas are pushed concurrently. Only the first count pixels are
+ * clocked out, pixels past them keep their last values (a reversed
+ * segment within the prefix is always sent whole). */
+void ws2812_submit(struct ws2812_driver *drv, size_t count);
+void ws2812_flush(struct ws2812_driver *drv);
+
+/* Transmit statistics summed over all segments */
+struct ws2812_tx_stats
+{
+    uint64_t pixels_sent;
+    uint64_t pixels_full;
+};
+
+void ws2812_get_tx_stats(const struct ws2812_driver *drv, struct ws2812_tx_stats *stats);
+
 /* Utils */
 void ws2812_clear(struct ws2812_driver *drv);
 void ws2812_set_all(struct ws2812_driver *drv, struct led_rgb color);
 
-/* Effects */
+/* Stepped effects: explicit state, advanced by one strip push per step, so
+ * any number of instances (on one or several drivers) can share a thread */
+enum ws2812_effect_type
+{
+    WS2812_EFFECT_RUNNING_LIGHT,
+    WS2812_EFFECT_BREATHING,
+    WS2812_EFFECT_RAINBOW,
+    WS2812_EFFECT_SPARKLE,
+};
+
+struct ws2812_effect
+{
+    struct ws2812_driver *drv;
+    enum ws2812_effect_type type;
+    struct led_rgb color;
+    uint32_t seed;
+    uint32_t period_ms;
+    uint32_t end_ms;
+    uint32_t next_ms;
+    uint32_t step;
+    bool done;
+    /* Rainbow color wheel position carried from step to step */
+    struct led_rgb wheel;
+};
+
+void ws2812_effect_running_light(struct ws2812_effect *fx, struct ws2812_driver *drv,
+                                 struct led_rgb color, uint32_t delay_ms, uint32_t duration_ms);
+void ws2812_effect_breathing(struct ws2812_effect *fx, struct ws2812_driver *drv,
+                             struct led_rgb color, uint32_t duration_ms);
+void ws2812_effect_rainbow(struct ws2812_effect *fx, struct ws2812_driver *drv,
+                           uint32_t delay_ms, uint32_t duration_ms);
+void ws2812_effect_sparkle(struct ws2812_effect *fx, struct ws2812_driver *drv,
+                           struct led_rgb color, uint32_t seed,
+                           uint32_t delay_ms, uint32_t duration_ms);
+
+/* Render and push exactly one step; the step after the duration blanks the
+ * strip. Returns false once the effect has finished. */
+bool ws2812_effect_step(struct ws2812_effect *fx);
+
+/* Step every effect that is due. Returns the ms until the next step is due,
+ * or -1 once all effects have finished. A scheduler thread loops on
+ * k_msleep(ws2812_effect_poll(...)) while the result is non-negative. */
+int32_t ws2812_effect_poll(struct ws2812_effect *effects, size_t count);
+
+/* Blocking effects, run the stepped effect to completion on the caller's thread */
 void ws2812_running_light(struct ws2812_driver *drv, struct led_rgb color, uint32_t delay_ms, uint32_t duration_ms);
 void ws2812_breathing(struct ws2812_driver *drv, struct led_rgb color, uint32_t duration_ms);
 void ws2812_rainbow(struct ws2812_driver *drv, uint32_t delay_ms, uint32_t duration_ms);
-void ws2812_sparkle(struct ws2812_driver *drv, struct led_rgb color, uint32_t delay_ms, uint32_t duration_ms);
\ No newline at end of file
+void ws2812_sparkle(struct ws2812_driver *drv, struct led_rgb color, uint32_t seed,
+                    uint32_t delay_ms, uint32_t duration_ms);
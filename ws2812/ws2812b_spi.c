@@ -0,0 +1,209 @@
+#define DT_DRV_COMPAT ksb_ws2812b_spi
+
+#include <stddef.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/led_strip.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/dt-bindings/led/led.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "ws2812b_spi.h"
+#include "ws2812b_symbols.h"
+
+LOG_MODULE_REGISTER(ws2812b_spi, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*
+ * Symbol tables, see ws2812b_symbols.h. Generated at build time, kept in RAM
+ * so the encoder does not go through the flash cache.
+ */
+static uint32_t ws2812b_lut4[256] = {LISTIFY(256, WS2812B_ENC4, (,))};
+static uint32_t ws2812b_lut3[256] = {LISTIFY(256, WS2812B_ENC3, (,))};
+
+struct ws2812b_spi_config
+{
+    struct spi_dt_spec bus;
+    /* Persistent TX buffer: encoded pixels followed by the latch time as zeros */
+    uint8_t *tx_buf;
+    /* Pixels the TX buffer currently holds symbols for */
+    struct led_rgb *shadow;
+    size_t length;
+    size_t reset_len;
+    uint8_t bits_per_symbol;
+    /* Offsets into struct led_rgb in wire order */
+    uint8_t channel[3];
+};
+
+struct ws2812b_spi_data
+{
+    size_t encoded;
+    uint64_t encode_cycles;
+    struct ws2812b_spi_stats stats;
+};
+
+static inline bool ws2812b_same_pixel(const struct led_rgb *a, const struct led_rgb *b)
+{
+    return a->r == b->r && a->g == b->g && a->b == b->b;
+}
+
+/* Encode changed pixels into the TX buffer, specialised per symbol width */
+static ALWAYS_INLINE uint32_t ws2812b_encode(const struct ws2812b_spi_config *cfg,
+                                             struct ws2812b_spi_data *data,
+                                             const struct led_rgb *pixels, size_t count,
+                                             bool dense)
+{
+    const size_t pixel_len = dense ? 9 : 12;
+    uint32_t encoded = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i < data->encoded && ws2812b_same_pixel(&pixels[i], &cfg->shadow[i]))
+        {
+            continue;
+        }
+
+        const uint8_t *px = (const uint8_t *)&pixels[i];
+        uint8_t *out = cfg->tx_buf + i * pixel_len;
+
+        if (dense)
+        {
+            sys_put_be24(ws2812b_lut3[px[cfg->channel[0]]], out);
+            sys_put_be24(ws2812b_lut3[px[cfg->channel[1]]], out + 3);
+            sys_put_be24(ws2812b_lut3[px[cfg->channel[2]]], out + 6);
+        }
+        else
+        {
+            sys_put_be32(ws2812b_lut4[px[cfg->channel[0]]], out);
+            sys_put_be32(ws2812b_lut4[px[cfg->channel[1]]], out + 4);
+            sys_put_be32(ws2812b_lut4[px[cfg->channel[2]]], out + 8);
+        }
+
+        cfg->shadow[i] = pixels[i];
+        encoded++;
+    }
+
+    data->encoded = MAX(data->encoded, count);
+    return encoded;
+}
+
+static int ws2812b_spi_update_rgb(const struct device *dev, struct led_rgb *pixels,
+                                  size_t num_pixels)
+{
+    const struct ws2812b_spi_config *cfg = dev->config;
+    struct ws2812b_spi_data *data = dev->data;
+    size_t count = MIN(num_pixels, cfg->length);
+    size_t pixel_len = 3 * cfg->bits_per_symbol;
+    uint32_t start = k_cycle_get_32();
+    uint32_t encoded;
+
+    if (cfg->bits_per_symbol == 3)
+    {
+        encoded = ws2812b_encode(cfg, data, pixels, count, true);
+    }
+    else
+    {
+        encoded = ws2812b_encode(cfg, data, pixels, count, false);
+    }
+
+    data->encode_cycles += k_cycle_get_32() - start;
+    data->stats.pixels_encoded += encoded;
+    data->stats.pixels_reused += count - encoded;
+
+    // Only the pixels asked for are clocked out, then the line is held low to latch
+    struct spi_buf bufs[] = {
+        {.buf = cfg->tx_buf, .len = count * pixel_len},
+        {.buf = cfg->tx_buf + cfg->length * pixel_len, .len = cfg->reset_len},
+    };
+    const struct spi_buf_set tx = {.buffers = bufs, .count = ARRAY_SIZE(bufs)};
+
+    int ret = spi_write_dt(&cfg->bus, &tx);
+    if (ret != 0)
+    {
+        LOG_ERR("SPI write failed: %d", ret);
+        return ret;
+    }
+
+    data->stats.updates++;
+    data->stats.bytes_sent += bufs[0].len + bufs[1].len;
+    return 0;
+}
+
+static size_t ws2812b_spi_length(const struct device *dev)
+{
+    const struct ws2812b_spi_config *cfg = dev->config;
+
+    return cfg->length;
+}
+
+static const struct led_strip_driver_api ws2812b_spi_api = {
+    .update_rgb = ws2812b_spi_update_rgb,
+    .length = ws2812b_spi_length,
+};
+
+void ws2812b_spi_get_stats(const struct device *dev, struct ws2812b_spi_stats *stats)
+{
+    const struct ws2812b_spi_data *data = dev->data;
+    uint64_t us = k_cyc_to_us_near64(data->encode_cycles);
+
+    *stats = data->stats;
+    stats->encode_us = us;
+    stats->encode_px_per_ms = us ? (uint64_t)data->stats.pixels_encoded * 1000 / us : 0;
+}
+
+static int ws2812b_spi_init(const struct device *dev)
+{
+    const struct ws2812b_spi_config *cfg = dev->config;
+
+    if (!spi_is_ready_dt(&cfg->bus))
+    {
+        LOG_ERR("SPI bus %s not ready", cfg->bus.bus->name);
+        return -ENODEV;
+    }
+
+    LOG_INF("%s: %zu pixels, %d-bit symbols at %d Hz, %zu byte TX buffer",
+            dev->name, cfg->length, cfg->bits_per_symbol, cfg->bus.config.frequency,
+            cfg->length * 3 * cfg->bits_per_symbol + cfg->reset_len);
+    return 0;
+}
+
+#define WS2812B_SPI_LENGTH(inst) DT_INST_PROP(inst, chain_length)
+#define WS2812B_SPI_PIXEL_LEN(inst) (3 * DT_INST_PROP(inst, bits_per_symbol))
+#define WS2812B_SPI_RESET_LEN(inst)                                                         \
+    DIV_ROUND_UP((uint64_t)DT_INST_PROP_OR(inst, reset_delay, CONFIG_WS2812B_RESET_DELAY) * \
+                     DT_INST_PROP(inst, spi_max_frequency),                                 \
+                 8 * USEC_PER_SEC)
+
+#define WS2812B_SPI_CHANNEL(node, prop, idx)                                     \
+    (DT_PROP_BY_IDX(node, prop, idx) == LED_COLOR_ID_RED     ? offsetof(struct led_rgb, r) \
+     : DT_PROP_BY_IDX(node, prop, idx) == LED_COLOR_ID_GREEN ? offsetof(struct led_rgb, g) \
+                                                             : offsetof(struct led_rgb, b)),
+
+#define WS2812B_SPI_DEVICE(inst)                                                              \
+    BUILD_ASSERT(DT_INST_PROP_LEN(inst, color_mapping) == 3,                                  \
+                 "ksb,ws2812b-spi supports RGB strips only");                                 \
+    BUILD_ASSERT(WS2812B_SPI_LENGTH(inst) <= CONFIG_WS2812B_MAX_PIXELS,                       \
+                 "chain-length exceeds CONFIG_WS2812B_MAX_PIXELS");                           \
+                                                                                              \
+    static uint8_t ws2812b_spi_tx_##inst[WS2812B_SPI_LENGTH(inst) * WS2812B_SPI_PIXEL_LEN(inst) + \
+                                         WS2812B_SPI_RESET_LEN(inst)];                        \
+    static struct led_rgb ws2812b_spi_shadow_##inst[WS2812B_SPI_LENGTH(inst)];                \
+                                                                                              \
+    static const struct ws2812b_spi_config ws2812b_spi_config_##inst = {                      \
+        .bus = SPI_DT_SPEC_INST_GET(inst, SPI_OP_MODE_MASTER | SPI_TRANSFER_MSB |             \
+                                              SPI_WORD_SET(8), 0),                            \
+        .tx_buf = ws2812b_spi_tx_##inst,                                                      \
+        .shadow = ws2812b_spi_shadow_##inst,                                                  \
+        .length = WS2812B_SPI_LENGTH(inst),                                                   \
+        .reset_len = WS2812B_SPI_RESET_LEN(inst),                                             \
+        .bits_per_symbol = DT_INST_PROP(inst, bits_per_symbol),                               \
+        .channel = {DT_INST_FOREACH_PROP_ELEM(inst, color_mapping, WS2812B_SPI_CHANNEL)},     \
+    };                                                                                        \
+                                                                                              \
+    static struct ws2812b_spi_data ws2812b_spi_data_##inst;                                   \
+                                                                                              \
+    DEVICE_DT_INST_DEFINE(inst, ws2812b_spi_init, NULL,                                       \
+                          &ws2812b_spi_data_##inst, &ws2812b_spi_config_##inst,               \
+                          POST_KERNEL, CONFIG_WS2812B_STRIP_INIT_PRIORITY,                    \
+                          &ws2812b_spi_api);
+
+DT_INST_FOREACH_STATUS_OKAY(WS2812B_SPI_DEVICE)
@@ -0,0 +1,17 @@
+#pragma once
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+
+/* Encoder and bus statistics of a "ksb,ws2812b-spi" strip */
+struct ws2812b_spi_stats
+{
+    uint32_t updates;          /* Strip updates sent */
+    uint32_t pixels_encoded;   /* Pixels re-encoded (unchanged pixels are skipped) */
+    uint32_t pixels_reused;    /* Pixels sent from the persistent TX buffer as is */
+    uint64_t encode_us;        /* Total time spent encoding */
+    uint32_t encode_px_per_ms; /* Encode throughput, 1000 = 1 pixel/us */
+    uint64_t bytes_sent;       /* SPI bytes sent including latch time */
+};
+
+/* Get statistics of a strip, dev must be a "ksb,ws2812b-spi" device */
+void ws2812b_spi_get_stats(const struct device *dev, struct ws2812b_spi_stats *stats);
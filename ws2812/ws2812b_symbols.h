@@ -0,0 +1,22 @@
+#pragma once
+
+/*
+ * WS2812B SPI symbols: one table lookup turns a data byte into its eight
+ * symbols, MSB first. Four bits per symbol: 1 -> 1110, 0 -> 1000. Three bits
+ * per symbol: 1 -> 110, 0 -> 100.
+ */
+
+#define WS2812B_SYM4(b, bit) ((((b) >> (bit)) & 1) ? 0xEU : 0x8U)
+#define WS2812B_SYM3(b, bit) ((((b) >> (bit)) & 1) ? 0x6U : 0x4U)
+
+/* Eight 4-bit symbols of byte b in the low 32 bits */
+#define WS2812B_ENC4(b, _)                                                                      \
+    ((WS2812B_SYM4(b, 7) << 28) | (WS2812B_SYM4(b, 6) << 24) | (WS2812B_SYM4(b, 5) << 20) |    \
+     (WS2812B_SYM4(b, 4) << 16) | (WS2812B_SYM4(b, 3) << 12) | (WS2812B_SYM4(b, 2) << 8) |     \
+     (WS2812B_SYM4(b, 1) << 4) | WS2812B_SYM4(b, 0))
+
+/* Eight 3-bit symbols of byte b in the low 24 bits */
+#define WS2812B_ENC3(b, _)                                                                      \
+    ((WS2812B_SYM3(b, 7) << 21) | (WS2812B_SYM3(b, 6) << 18) | (WS2812B_SYM3(b, 5) << 15) |    \
+     (WS2812B_SYM3(b, 4) << 12) | (WS2812B_SYM3(b, 3) << 9) | (WS2812B_SYM3(b, 2) << 6) |      \
+     (WS2812B_SYM3(b, 1) << 3) | WS2812B_SYM3(b, 0))